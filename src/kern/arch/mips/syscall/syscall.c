@@ -95,6 +95,7 @@ syscall(struct trapframe *tf)
 	// FOR THE SYSTEM CALLS THAT RETURN A 64-BIT VALUE (e.g. SYS_lseek()), THE VALUE WILL BE STORED IN
 	// retval_low AND retval_high.
 	int32_t retval_low, retval_high;
+	uint64_t runtime;
 	
 	KASSERT(curthread != NULL);
 	KASSERT(curthread->t_curspl == 0);
@@ -102,6 +103,9 @@ syscall(struct trapframe *tf)
 
 	callno = tf->tf_v0;
 
+	/* Run time from here on is system time (see getrusage). */
+	runtime = thread_runtime();
+
 	/*
 	 * Initialize retval to 0. Many of the system calls don't
 	 * really return a value, just 0 for success and -1 on
@@ -135,6 +139,26 @@ syscall(struct trapframe *tf)
 			err = sys___time((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
 			break;
 
+	    case SYS_nanosleep:
+			err = sys_nanosleep((userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+			break;
+
+	    case SYS_sched_setaffinity:
+			err = sys_sched_setaffinity((pid_t)tf->tf_a0, (uint32_t)tf->tf_a1);
+			break;
+
+	    case SYS_sched_getaffinity:
+			err = sys_sched_getaffinity((pid_t)tf->tf_a0, (userptr_t)tf->tf_a1);
+			break;
+
+	    case SYS_futex_wait:
+			err = sys_futex_wait((userptr_t)tf->tf_a0, (int)tf->tf_a1, (userptr_t)tf->tf_a2);
+			break;
+
+	    case SYS_futex_wake:
+			err = sys_futex_wake((userptr_t)tf->tf_a0, (int)tf->tf_a1, &retval_high);
+			break;
+
 	    /* Add stuff here */
 
 		case SYS_open:
@@ -225,6 +249,30 @@ syscall(struct trapframe *tf)
 			retval_low = 0;
 			break;
 
+		case SYS___thread_create:
+			err = sys_thread_create(tf, &retval_high);
+			retval_low = 0;
+			break;
+
+		case SYS_thread_join:
+			err = sys_thread_join((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+			break;
+
+		case SYS_thread_exit:
+			err = 0;
+			sys_thread_exit((int) tf->tf_a0);
+			break;
+
+		case SYS_getrusage:
+			err = sys_getrusage((int)tf->tf_a0, (userptr_t)tf->tf_a1);
+			break;
+
+		case SYS___spawn:
+			err = sys_spawn((const_userptr_t)tf->tf_a0, (userptr_t)tf->tf_a1,
+					(const_userptr_t)tf->tf_a2, (int)tf->tf_a3, &retval_high);
+			retval_low = 0;
+			break;
+
 	    default:
 			kprintf("Unknown syscall %d\n", callno);
 			err = ENOSYS;
@@ -258,6 +306,8 @@ syscall(struct trapframe *tf)
 
 	tf->tf_epc += 4;
 
+	curthread->t_usage.u_systime += thread_runtime() - runtime;
+
 	/* Make sure the syscall code didn't forget to lower spl */
 	KASSERT(curthread->t_curspl == 0);
 	/* ...or leak any spinlocks */
@@ -35,6 +35,7 @@
 #include <spinlock.h>
 #include <proc.h>
 #include <current.h>
+#include <thread.h>
 #include <mips/tlb.h>
 #include <addrspace.h>
 #include <vm.h>
@@ -59,10 +60,20 @@
 /* (this must be > 64K so argument blocks of size ARG_MAX will fit) */
 #define DUMBVM_STACKPAGES    18
 
+/*
+ * Additional threads get smaller stacks, stacked up below the main
+ * one with an unmapped page under each to catch overflows. Slot N
+ * (1 <= N < THREAD_MAX) tops out at DUMBVM_TSTACKTOP(N).
+ */
+#define DUMBVM_TSTACKPAGES   4
+#define DUMBVM_TSTACKTOP(n) \
+	(USERSTACK - DUMBVM_STACKPAGES * PAGE_SIZE - \
+	 ((n) - 1) * (DUMBVM_TSTACKPAGES + 1) * PAGE_SIZE - PAGE_SIZE)
+
 /*
  * Wrap ram_stealmem in a spinlock.
  */
-static struct spinlock stealmem_lock = SPINLOCK_INITIALIZER;
+static struct spinlock stealmem_lock = SPINLOCK_NAMED_INITIALIZER("stealmem");
 
 void
 vm_bootstrap(void)
@@ -138,6 +149,7 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 {
 	vaddr_t vbase1, vtop1, vbase2, vtop2, stackbase, stacktop;
 	paddr_t paddr;
+	unsigned slot;
 	int i;
 	uint32_t ehi, elo;
 	struct addrspace *as;
@@ -176,6 +188,9 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		return EFAULT;
 	}
 
+	/* Charge the fault to the thread (see getrusage). */
+	curthread->t_usage.u_minflt++;
+
 	/* Assert that the address space has been set up properly. */
 	KASSERT(as->as_vbase1 != 0);
 	KASSERT(as->as_pbase1 != 0);
@@ -207,7 +222,22 @@ vm_fault(int faulttype, vaddr_t faultaddress)
 		paddr = (faultaddress - stackbase) + as->as_stackpbase;
 	}
 	else {
-		return EFAULT;
+		/* Maybe one of the thread stacks. */
+		paddr = 0;
+		for (slot=1; slot<THREAD_MAX; slot++) {
+			stacktop = DUMBVM_TSTACKTOP(slot);
+			stackbase = stacktop - DUMBVM_TSTACKPAGES * PAGE_SIZE;
+			if (as->as_tstackpbase[slot] != 0 &&
+			    faultaddress >= stackbase &&
+			    faultaddress < stacktop) {
+				paddr = (faultaddress - stackbase) +
+					as->as_tstackpbase[slot];
+				break;
+			}
+		}
+		if (paddr == 0) {
+			return EFAULT;
+		}
 	}
 
 	/* make sure it's page-aligned */
@@ -238,6 +268,8 @@ struct addrspace *
 as_create(void)
 {
 	struct addrspace *as = kmalloc(sizeof(struct addrspace));
+	unsigned slot;
+
 	if (as==NULL) {
 		return NULL;
 	}
@@ -249,6 +281,15 @@ as_create(void)
 	as->as_pbase2 = 0;
 	as->as_npages2 = 0;
 	as->as_stackpbase = 0;
+	for (slot=0; slot<THREAD_MAX; slot++) {
+		as->as_tstackpbase[slot] = 0;
+		as->as_tstackused[slot] = false;
+	}
+	/* slot 0 is the main stack */
+	as->as_tstackused[0] = true;
+
+	spinlock_init(&as->as_lock);
+	as->as_refcount = 1;
 
 	return as;
 }
@@ -257,9 +298,34 @@ void
 as_destroy(struct addrspace *as)
 {
 	dumbvm_can_sleep();
+	spinlock_cleanup(&as->as_lock);
 	kfree(as);
 }
 
+void
+as_incref(struct addrspace *as)
+{
+	spinlock_acquire(&as->as_lock);
+	KASSERT(as->as_refcount > 0);
+	as->as_refcount++;
+	spinlock_release(&as->as_lock);
+}
+
+void
+as_decref(struct addrspace *as)
+{
+	unsigned refcount;
+
+	spinlock_acquire(&as->as_lock);
+	KASSERT(as->as_refcount > 0);
+	refcount = --as->as_refcount;
+	spinlock_release(&as->as_lock);
+
+	if (refcount == 0) {
+		as_destroy(as);
+	}
+}
+
 void
 as_activate(void)
 {
@@ -383,10 +449,65 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_define_thread_stack(struct addrspace *as, unsigned *slot,
+		       vaddr_t *stackptr)
+{
+	unsigned i;
+	paddr_t pbase;
+
+	dumbvm_can_sleep();
+
+	spinlock_acquire(&as->as_lock);
+	for (i=1; i<THREAD_MAX; i++) {
+		if (!as->as_tstackused[i]) {
+			break;
+		}
+	}
+	if (i == THREAD_MAX) {
+		spinlock_release(&as->as_lock);
+		return EAGAIN;
+	}
+	as->as_tstackused[i] = true;
+	spinlock_release(&as->as_lock);
+
+	/*
+	 * We can't give memory back, so a stack stays allocated once
+	 * its slot has been used, and is reused by later threads.
+	 * Only the thread that claimed the slot touches it until the
+	 * new thread starts running.
+	 */
+	if (as->as_tstackpbase[i] == 0) {
+		pbase = getppages(DUMBVM_TSTACKPAGES);
+		if (pbase == 0) {
+			as_release_thread_stack(as, i);
+			return ENOMEM;
+		}
+		as->as_tstackpbase[i] = pbase;
+	}
+	as_zero_region(as->as_tstackpbase[i], DUMBVM_TSTACKPAGES);
+
+	*slot = i;
+	*stackptr = DUMBVM_TSTACKTOP(i);
+	return 0;
+}
+
+void
+as_release_thread_stack(struct addrspace *as, unsigned slot)
+{
+	KASSERT(slot > 0 && slot < THREAD_MAX);
+
+	spinlock_acquire(&as->as_lock);
+	KASSERT(as->as_tstackused[slot]);
+	as->as_tstackused[slot] = false;
+	spinlock_release(&as->as_lock);
+}
+
 int
 as_copy(struct addrspace *old, struct addrspace **ret)
 {
 	struct addrspace *new;
+	unsigned slot;
 
 	dumbvm_can_sleep();
 
@@ -422,6 +543,27 @@ as_copy(struct addrspace *old, struct addrspace **ret)
 		(const void *)PADDR_TO_KVADDR(old->as_stackpbase),
 		DUMBVM_STACKPAGES*PAGE_SIZE);
 
+	/*
+	 * Of the other threads' stacks, only copy the one the forking
+	 * thread is running on, if it isn't on the main stack: it
+	 * becomes the child's only thread. Nothing in the child owns
+	 * the rest, so they're left free.
+	 */
+	slot = curthread->t_tid;
+	if (slot != 0) {
+		KASSERT(slot < THREAD_MAX);
+		KASSERT(old->as_tstackused[slot]);
+		new->as_tstackpbase[slot] = getppages(DUMBVM_TSTACKPAGES);
+		if (new->as_tstackpbase[slot] == 0) {
+			as_destroy(new);
+			return ENOMEM;
+		}
+		new->as_tstackused[slot] = true;
+		memmove((void *)PADDR_TO_KVADDR(new->as_tstackpbase[slot]),
+			(const void *)PADDR_TO_KVADDR(old->as_tstackpbase[slot]),
+			DUMBVM_TSTACKPAGES*PAGE_SIZE);
+	}
+
 	*ret = new;
 	return 0;
 }
@@ -76,6 +76,22 @@ mips_timer_set(uint32_t count)
 		:: "r" (count));
 }
 
+static
+uint32_t
+mips_timer_get(void)
+{
+	uint32_t count;
+
+	/* $9 == c0_count */
+	__asm volatile(
+		".set push;"		/* save assembler mode */
+		".set mips32;"		/* allow MIPS32 registers */
+		"mfc0 %0, $9;"		/* do it */
+		".set pop"		/* restore assembler mode */
+		: "=r" (count));
+	return count;
+}
+
 /*
  * LAMEbus data for the system. (We have only one LAMEbus per system.)
  * This does not need to be locked, because it's constant once
@@ -119,6 +135,30 @@ mainbus_bootstrap(void)
 	mips_timer_set(CPU_FREQUENCY / HZ);
 }
 
+/*
+ * Put off the current cpu's next timer interrupt for TICKS hardclock
+ * periods. The interrupt handler always rearms it for one period.
+ *
+ * This is counted from where c0_count is now, not from zero: a cpu
+ * woken early from a long tickless sleep may already have counted
+ * past TICKS periods, and setting c0_compare behind c0_count would
+ * mean no interrupt until the count wraps around.
+ */
+void
+mainbus_settimer(unsigned ticks)
+{
+	const uint32_t period = CPU_FREQUENCY / HZ;
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+	if (ticks > 0xffffffff / period) {
+		/* c0_compare is only 32 bits; sleep less. */
+		ticks = 0xffffffff / period;
+	}
+	mips_timer_set(mips_timer_get() + ticks * period);
+}
+
 /*
  * Start all secondary CPUs.
  */
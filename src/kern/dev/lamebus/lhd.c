@@ -296,6 +296,12 @@ config_lhd(struct lhd_softc *lh, int lhdno)
 		return ENOMEM;
 	}
 
+	/*
+	 * Serve threads waiting for the disk in order; otherwise a
+	 * thread doing a long run of sectors can starve the others.
+	 */
+	sem_set_handoff(lh->lh_clear, true);
+
 	/* Set up the VFS device structure. */
 	lh->lh_dev.d_ops = &lhd_devops;
 	lh->lh_dev.d_blocks = bus_read_register(lh->lh_busdata, lh->lh_buspos,
@@ -36,6 +36,7 @@
 #include <kern/errno.h>
 #include <lib.h>
 #include <uio.h>
+#include <clock.h>
 #include <vfs.h>
 #include <device.h>
 #include <sfs.h>
@@ -88,6 +89,11 @@ sfs_rwblock(struct sfs_fs *sfs, struct uio *uio)
 			goto retry;
 		}
 		else if (tries < 10) {
+			/*
+			 * Back off a little longer each time, in case
+			 * the device just needs a moment.
+			 */
+			clocksleep_ticks(tries);
 			tries++;
 			goto retry;
 		}
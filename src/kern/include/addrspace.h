@@ -35,6 +35,8 @@
  */
 
 
+#include <limits.h>
+#include <spinlock.h>
 #include <vm.h>
 #include "opt-dumbvm.h"
 
@@ -57,9 +59,15 @@ struct addrspace {
         paddr_t as_pbase2;
         size_t as_npages2;
         paddr_t as_stackpbase;
+        paddr_t as_tstackpbase[THREAD_MAX]; /* By slot; [0] unused */
+        bool as_tstackused[THREAD_MAX];
 #else
         /* Put stuff here for your VM system */
 #endif
+
+        /* The threads of a process share its address space. */
+        struct spinlock as_lock;
+        unsigned as_refcount;
 };
 
 /*
@@ -73,7 +81,8 @@ struct addrspace {
  *    as_copy   - create a new address space that is an exact copy of
  *                an old one. Probably calls as_create to get a new
  *                empty address space and fill it in, but that's up to
- *                you.
+ *                you. Of the thread stacks, only the calling thread's
+ *                is copied, since it's the only thread the copy gets.
  *
  *    as_activate - make curproc's address space the one currently
  *                "seen" by the processor.
@@ -83,8 +92,14 @@ struct addrspace {
  *                avoid potentially "seeing" it while it's being
  *                destroyed.
  *
- *    as_destroy - dispose of an address space. You may need to change
- *                the way this works if implementing user-level threads.
+ *    as_destroy - dispose of an address space. Normally called via
+ *                as_decref.
+ *
+ *    as_incref - add a reference to an address space. The process
+ *                holds one; each additional user thread holds another.
+ *
+ *    as_decref - drop a reference. Dropping the last one destroys the
+ *                address space.
  *
  *    as_define_region - set up a region of memory within the address
  *                space.
@@ -99,6 +114,14 @@ struct addrspace {
  *                (Normally called *after* as_complete_load().) Hands
  *                back the initial stack pointer for the new process.
  *
+ *    as_define_thread_stack - set up a user stack for an additional
+ *                thread. Hands back the stack's slot number, from 1
+ *                to THREAD_MAX-1 (slot 0 is the initial stack), and
+ *                its initial stack pointer.
+ *
+ *    as_release_thread_stack - give back a thread stack slot when the
+ *                thread using it is gone.
+ *
  * Note that when using dumbvm, addrspace.c is not used and these
  * functions are found in dumbvm.c.
  */
@@ -108,6 +131,8 @@ int               as_copy(struct addrspace *src, struct addrspace **ret);
 void              as_activate(void);
 void              as_deactivate(void);
 void              as_destroy(struct addrspace *);
+void              as_incref(struct addrspace *);
+void              as_decref(struct addrspace *);
 
 int               as_define_region(struct addrspace *as,
                                    vaddr_t vaddr, size_t sz,
@@ -117,6 +142,11 @@ int               as_define_region(struct addrspace *as,
 int               as_prepare_load(struct addrspace *as);
 int               as_complete_load(struct addrspace *as);
 int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
+int               as_define_thread_stack(struct addrspace *as,
+                                         unsigned *slot,
+                                         vaddr_t *initstackptr);
+void              as_release_thread_stack(struct addrspace *as,
+                                          unsigned slot);
 
 
 /*
@@ -124,9 +154,17 @@ int               as_define_stack(struct addrspace *as, vaddr_t *initstackptr);
  *    load_elf - load an ELF user program executable into the current
  *               address space. Returns the entry point (initial PC)
  *               in the space pointed to by ENTRYPOINT.
+ *
+ *    execcache_written - forget anything cached about executable V
+ *               because it was written or truncated. Call after the
+ *               change.
+ *
+ *    execcache_flush - forget all cached executables (for unmount).
  */
 
 int load_elf(struct vnode *v, vaddr_t *entrypoint);
+void execcache_written(struct vnode *v);
+void execcache_flush(void);
 
 
 #endif /* _ADDRSPACE_H_ */
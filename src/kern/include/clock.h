@@ -48,6 +48,14 @@
 void hardclock_bootstrap(void);
 void hardclock(void);
 
+/*
+ * Tickless idle: the idle loop calls hardclock_idle() (with interrupts
+ * off) before idling and hardclock_unidle() after, to stop and restart
+ * this cpu's hardclocks.
+ */
+void hardclock_idle(void);
+void hardclock_unidle(void);
+
 /*
  * timerclock() is called on one CPU once a second to allow simple
  * timed operations. (This is a fairly simpleminded interface.)
@@ -76,8 +84,49 @@ void timespec_sub(const struct timespec *t1,
 /*
  * clocksleep() suspends execution for the requested number of seconds,
  * like userlevel sleep(3). (Don't confuse it with wchan_sleep.)
+ *
+ * clocksleep_ticks() does the same for a number of hardclocks, and
+ * is what nanosleep uses. clocksleep_until() sleeps until the tick
+ * count (see timeout_ticks) reaches TICK, so periodic sleepers don't
+ * drift by however long it took them to compute how long to sleep.
  */
 void clocksleep(int seconds);
+void clocksleep_ticks(unsigned ticks);
+void clocksleep_until(unsigned tick);
+
+/*
+ * One-shot timeouts, with hardclock (1/HZ second) resolution.
+ *
+ * timeout_init sets up a timeout to call FUNC(DATA); timeout_add
+ * arms it to fire TICKS hardclocks from now (at least 1), moving it
+ * if it was already armed; timeout_del disarms it and returns true
+ * if it hadn't fired yet. If the function is running when timeout_del
+ * is called, timeout_del waits for it to finish, so once timeout_del
+ * returns the timeout can be freed. That means timeout_del must not
+ * be called with a spinlock held that FUNC acquires. (FUNC itself
+ * may call timeout_del on its own timeout; that doesn't wait.)
+ *
+ * Timeouts are run from hardclock() on cpu 0, in interrupt context,
+ * so FUNC must not sleep.
+ *
+ * timeout_ticks returns the current tick count, from the real-time
+ * clock (it wraps);
+ * timespec_to_ticks rounds a duration up to whole hardclocks.
+ */
+struct timeout {
+	struct timeout *to_next;	/* Link in wheel bucket */
+	struct timeout **to_prevp;	/* Pointer to us in wheel bucket */
+	unsigned to_expire;		/* Tick to fire at */
+	bool to_pending;		/* True while armed */
+	void (*to_func)(void *);	/* Function to call */
+	void *to_data;			/* Argument for to_func */
+};
+
+void timeout_init(struct timeout *to, void (*func)(void *), void *data);
+void timeout_add(struct timeout *to, unsigned ticks);
+bool timeout_del(struct timeout *to);
+unsigned timeout_ticks(void);
+unsigned timespec_to_ticks(const struct timespec *ts);
 
 
 #endif /* _CLOCK_H_ */
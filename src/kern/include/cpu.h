@@ -36,6 +36,12 @@
 #include <machine/vm.h>  /* for TLBSHOOTDOWN_MAX */
 
 
+/* Sizes of the scheduler statistics arrays in struct cpu. */
+#define CPU_RQHIST		8	/* Queue lengths 0-6, and 7 or more */
+#define CPU_NIPICODES		5	/* IPI codes, defined below */
+
+struct ipi_call;			/* Defined below */
+
 /*
  * Per-cpu structure
  *
@@ -53,13 +59,18 @@ struct cpu {
 	struct cpu *c_self;		/* Canonical address of this struct */
 	unsigned c_number;		/* This cpu's cpu number */
 	unsigned c_hardware_number;	/* Hardware-defined cpu number */
+	struct thread *c_idlethread;	/* Runs when nothing else can */
 
 	/*
 	 * Accessed only by this cpu.
 	 */
 	struct thread *c_curthread;	/* Current thread on cpu */
 	struct threadlist c_zombies;	/* List of exited threads */
+	struct threadlist c_threadcache; /* Recycled threads (with stacks) */
 	unsigned c_hardclocks;		/* Counter of hardclock() calls */
+	unsigned c_rcu_qs;		/* RCU quiescent states (read unlocked) */
+	bool c_tickless;		/* Hardclock stopped while idle */
+	unsigned c_idletick;		/* Tick when c_tickless was set */
 	unsigned c_spinlocks;		/* Counter of spinlocks held */
 
 	/*
@@ -68,6 +79,7 @@ struct cpu {
 	 */
 	bool c_isidle;			/* True if this cpu is idle */
 	struct threadlist c_runqueue;	/* Run queue for this cpu */
+	struct thread *c_handoff;	/* Switched out, must move elsewhere */
 	struct spinlock c_runqueue_lock;
 
 	/*
@@ -82,12 +94,38 @@ struct cpu {
 	 * The contents of struct tlbshootdown are also machine-
 	 * dependent and might reasonably be either an address space
 	 * and vaddr pair, or a paddr, or something else.
+	 *
+	 * Cross-cpu function calls wait in c_calls, in FIFO order.
+	 *
+	 * c_ipi_pending is nonzero exactly when an interrupt has been
+	 * sent that this cpu hasn't handled yet, so senders that find
+	 * it nonzero just set their bit and don't send another.
 	 */
 	uint32_t c_ipi_pending;		/* One bit for each IPI number */
 	struct tlbshootdown c_shootdown[TLBSHOOTDOWN_MAX];
 	unsigned c_numshootdown;
+	struct ipi_call *c_calls;	/* Queued function calls */
+	struct ipi_call **c_callstail;	/* Where to link the next one */
 	struct spinlock c_ipi_lock;
 
+	/*
+	 * Scheduler statistics (see schedstat.c). Written by this cpu,
+	 * except that the migration counts are protected by the
+	 * runqueue lock; read unlocked for reports. Switches away from
+	 * the idle thread aren't counted.
+	 */
+	unsigned c_sw_voluntary;	/* Switches that slept, yielded, exited */
+	unsigned c_sw_preempt;		/* Switches forced by an interrupt */
+	unsigned c_rqhist[CPU_RQHIST];	/* Run queue length, each hardclock */
+	unsigned c_migrate_in;		/* Threads moved here */
+	unsigned c_migrate_out;		/* Threads moved elsewhere */
+	unsigned c_ipi_sent[CPU_NIPICODES];
+	unsigned c_ipi_recv[CPU_NIPICODES];
+	unsigned c_ipi_coalesced;	/* Sends that rode a pending IPI */
+	unsigned c_wakeups;		/* Woken threads run here */
+	uint64_t c_wakelat;		/* Total wakeup-to-run latency (ns) */
+	uint64_t c_wakelat_max;		/* Worst wakeup-to-run latency (ns) */
+
 	/*
 	 * Accessed by other cpus. Protected inside hangman.c.
 	 */
@@ -112,6 +150,13 @@ void cpu_machdep_init(struct cpu *);
 /*ASMLINKAGE*/ void cpu_start_secondary(void);
 void cpu_hatch(unsigned software_number);
 
+/*
+ * Enumerate cpus: cpu_count returns the number of cpus created so
+ * far and cpu_bynumber returns the one with a given software number.
+ */
+unsigned cpu_count(void);
+struct cpu *cpu_bynumber(unsigned software_number);
+
 /*
  * Produce a string describing the CPU type.
  */
@@ -156,6 +201,10 @@ void cpu_halt(void);
  * ipi_broadcast sends an IPI to all CPUs except the current one.
  * ipi_tlbshootdown is like ipi_send but carries TLB shootdown data.
  *
+ * An IPI sent to a cpu that hasn't yet handled an earlier one is
+ * folded into it instead of interrupting the cpu again, so bursts
+ * of wakeups to an idle cpu cost one interrupt.
+ *
  * interprocessor_interrupt is called on the target CPU when an IPI is
  * received.
  */
@@ -165,11 +214,44 @@ void cpu_halt(void);
 #define IPI_OFFLINE		1	/* CPU is requested to go offline */
 #define IPI_UNIDLE		2	/* Runnable threads are available */
 #define IPI_TLBSHOOTDOWN	3	/* MMU mapping(s) need invalidation */
+#define IPI_CALL		4	/* Function calls are queued */
 
 void ipi_send(struct cpu *target, int code);
 void ipi_broadcast(int code);
 void ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping);
 
+/*
+ * Cross-cpu function calls.
+ *
+ * ipi_call queues CALL to run ic_func(ic_arg) on cpu TARGET, which
+ * must not be the current cpu, from its interrupt handler, and
+ * returns without waiting. The caller
+ * fills in ic_func and ic_arg, and must keep CALL around until
+ * ipi_call_wait returns. Calls queued to a cpu before it takes the
+ * interrupt all run off the same one, so queue a batch before
+ * waiting for any of it.
+ *
+ * ipi_call_wait spins until CALL has run. It must not be called
+ * with spinlocks held or interrupts off, or two cpus calling each
+ * other would wait forever.
+ *
+ * ipi_broadcast_call runs FUNC(ARG) on every cpu but the current one
+ * and waits for them all. It returns ENOMEM if it can't allocate
+ * the call records.
+ *
+ * The functions run with interrupts off and may not sleep.
+ */
+struct ipi_call {
+	void (*ic_func)(void *);
+	void *ic_arg;
+	struct ipi_call *ic_next;
+	volatile bool ic_done;
+};
+
+void ipi_call(struct cpu *target, struct ipi_call *call);
+void ipi_call_wait(struct ipi_call *call);
+int ipi_broadcast_call(void (*func)(void *), void *arg);
+
 void interprocessor_interrupt(void);
 
 
@@ -12,17 +12,15 @@ struct openfile {
     int flags;          // O_RDONLY, O_WRONLY, O_RDWR
     off_t offset;       // CURRENT OFFSET IN FILE
     struct lock *lock;  // LOCK FOR SYNCHRONIZATION
-    
-    // THE refcount FIELD HAS FIRST BEEN ADDED TO THE openfile STRUCTURE AND THEN REMOVED.
-    // ITS UTILITY WOULD BE TO KEEP TRACK OF THE NUMBER OF TIMES A FILE IS OPENED, THAT IS, 
-    // THE NUMBER OF openfile STRUCTURES THAT POINT TO THE SAME vnode, BUT THIS WOULD 
-    // CAUSE THIS FIELD TO BE UPDATED OVER THE WHOLE FILETABLE EACH TIME A NEW open() IS CALLED,
-    // IN ORDER TO TRACK SUCH OPERATIONS, AND WOULD NOT BE USEFUL FOR ANYTHING ELSE, GIVEN THAT:
-    //  - ONCE A FILETABLE ENTRY LOCATED AT fd IS REMOVED, THE openfile STRUCTURE IS LOST
-    //  - THE REFERENCE COUNT RELATED TO THE TIMES A vnode STRUCTURE IS OPENED IS ALREADY TRACKED
-    //    BY THE VNODE ITSELF, THROUGH ITS vn_refcount FIELD  
-    // int refcount;       // REFERENCE COUNT
 
+    // AN openfile IS ONE open() CALL. fork(), dup2() AND posix_spawn() DON'T OPEN
+    // THE FILE AGAIN, THEY PUT THE SAME openfile IN ANOTHER FILETABLE SLOT, SO THE
+    // DESCRIPTORS SHARE ONE OFFSET (UPDATED UNDER lock). refcount IS THE NUMBER OF
+    // FILETABLE SLOTS POINTING HERE; THE LAST openfile_decref() CLOSES THE VNODE.
+    // IT'S CHANGED UNDER refcount_lock, WHICH IS NEVER HELD FOR LONGER THAN THE
+    // INCREMENT OR DECREMENT, THE SAME WAY vnode KEEPS vn_refcount.
+    unsigned refcount;
+    struct spinlock refcount_lock;
 };
 
 struct filetable {
@@ -35,12 +33,12 @@ int openfile_init(struct vnode *vn, int flags, struct openfile **ret);
 // DESTROY THE OPENFILE
 int openfile_destroy(struct openfile *of);
 // INCREASE THE REFERENCE COUNT OF THE OPENFILE
-// int openfile_addref(struct openfile *of, bool no_lock);
-// DECREASE THE REFERENCE COUNT OF THE OPENFILE
-// int openfile_decref(struct openfile *of);
+void openfile_incref(struct openfile *of);
+// DECREASE THE REFERENCE COUNT OF THE OPENFILE, CLOSING IT IF IT WAS THE LAST
+void openfile_decref(struct openfile *of);
 // INITIALIZE THE FILETABLE
 struct filetable *filetable_init(void);
-// DESTROY THE FILETABLE
+// DESTROY THE FILETABLE, DROPPING ITS REFERENCES TO ITS OPENFILES
 void filetable_destroy(struct filetable *ft);
 // INITIALIZE THE STD DEVICES
 int init_stdio(struct filetable *ft);
@@ -56,7 +54,7 @@ int filetable_remove(struct filetable *ft, int fd, bool no_lock);
 int is_valid(int fd);
 // CHECK IF THE FILETABLE ENTRY IS AVAILABLE
 int is_available(struct filetable *ft, int fd);
-// COPY THE FILETABLE
+// COPY THE FILETABLE. THE COPY SHARES THE OPENFILES WITH THE ORIGINAL
 int copy_filetable(struct filetable *old_ft, struct filetable **new_ft);
 
 
@@ -33,37 +33,102 @@
 /*
  * Simple deadlock detector. Enable with "options hangman" in the
  * kernel config.
+ *
+ * The same hooks also drive the lock contention profiler ("options
+ * lockstat"; see lockstat.h), so the actor and lockable structures
+ * exist if either option is on, and each carries the fields for
+ * whichever of the two are configured.
  */
 
 #include "opt-hangman.h"
+#include "opt-lockstat.h"
 
-#if OPT_HANGMAN
+#if OPT_HANGMAN || OPT_LOCKSTAT
+
+struct lockstat_class;		/* Opaque. */
 
 struct hangman_actor {
 	const char *a_name;
+#if OPT_HANGMAN
 	const struct hangman_lockable *a_waiting;
+#endif
+#if OPT_LOCKSTAT
+	uint64_t a_waitstart;			/* ns; 0 if not contended */
+#endif
 };
 
 struct hangman_lockable {
 	const char *l_name;
+#if OPT_HANGMAN
 	const struct hangman_actor *l_holding;
+#endif
+#if OPT_LOCKSTAT
+	struct lockstat_class *l_class;		/* Cached lookup of l_name */
+	uint64_t l_acquired;			/* ns; 0 if not timed */
+#endif
 };
 
+#define HANGMAN_ACTOR(sym)	struct hangman_actor sym
+#define HANGMAN_LOCKABLE(sym)	struct hangman_lockable sym
+
+#endif /* OPT_HANGMAN || OPT_LOCKSTAT */
+
+#if OPT_HANGMAN
 void hangman_wait(struct hangman_actor *a, struct hangman_lockable *l);
 void hangman_acquire(struct hangman_actor *a, struct hangman_lockable *l);
 void hangman_release(struct hangman_actor *a, struct hangman_lockable *l);
+void hangman_cancel(struct hangman_actor *a, struct hangman_lockable *l);
+#define HANGMAN_HOOK(a, l, op)	hangman_##op(a, l)
+#define HANGMAN_ACTORINIT_H(a)	((a)->a_waiting = NULL)
+#define HANGMAN_LOCKABLEINIT_H(l) ((l)->l_holding = NULL)
+#define HANGMAN_LOCKABLE_INIT_H	, NULL
+#else
+#define HANGMAN_HOOK(a, l, op)	((void)0)
+#define HANGMAN_ACTORINIT_H(a)	((void)0)
+#define HANGMAN_LOCKABLEINIT_H(l) ((void)0)
+#define HANGMAN_LOCKABLE_INIT_H
+#endif
 
-#define HANGMAN_ACTOR(sym)	struct hangman_actor sym
-#define HANGMAN_LOCKABLE(sym)	struct hangman_lockable sym
+#if OPT_LOCKSTAT
+void lockstat_wait(struct hangman_actor *a, struct hangman_lockable *l);
+void lockstat_acquire(struct hangman_actor *a, struct hangman_lockable *l);
+void lockstat_release(struct hangman_actor *a, struct hangman_lockable *l);
+void lockstat_cancel(struct hangman_actor *a, struct hangman_lockable *l);
+#define LOCKSTAT_HOOK(a, l, op)	lockstat_##op(a, l)
+#define HANGMAN_ACTORINIT_L(a)	((a)->a_waitstart = 0)
+#define HANGMAN_LOCKABLEINIT_L(l) ((l)->l_class = NULL, (l)->l_acquired = 0)
+#define HANGMAN_LOCKABLE_INIT_L	, NULL, 0
+#else
+#define LOCKSTAT_HOOK(a, l, op)	((void)0)
+#define HANGMAN_ACTORINIT_L(a)	((void)0)
+#define HANGMAN_LOCKABLEINIT_L(l) ((void)0)
+#define HANGMAN_LOCKABLE_INIT_L
+#endif
+
+#if OPT_HANGMAN || OPT_LOCKSTAT
 
-#define HANGMAN_ACTORINIT(a, n)	    ((a)->a_name = (n), (a)->a_waiting = NULL)
-#define HANGMAN_LOCKABLEINIT(l, n)  ((l)->l_name = (n), (l)->l_holding = NULL)
+#define HANGMAN_ACTORINIT(a, n) \
+	((a)->a_name = (n), HANGMAN_ACTORINIT_H(a), HANGMAN_ACTORINIT_L(a))
+#define HANGMAN_LOCKABLEINIT(l, n) \
+	((l)->l_name = (n), HANGMAN_LOCKABLEINIT_H(l), HANGMAN_LOCKABLEINIT_L(l))
 
-#define HANGMAN_LOCKABLE_INITIALIZER	{ "spinlock", NULL }
+#define HANGMAN_LOCKABLE_INITIALIZER(n) \
+	{ n HANGMAN_LOCKABLE_INIT_H HANGMAN_LOCKABLE_INIT_L }
+
+/*
+ * The profiler wants the wait timestamp taken before the deadlock
+ * check, and the hold time to stop before the detector's bookkeeping.
+ */
+#define HANGMAN_WAIT(a, l) \
+	(LOCKSTAT_HOOK(a, l, wait), HANGMAN_HOOK(a, l, wait))
+#define HANGMAN_ACQUIRE(a, l) \
+	(HANGMAN_HOOK(a, l, acquire), LOCKSTAT_HOOK(a, l, acquire))
+#define HANGMAN_RELEASE(a, l) \
+	(LOCKSTAT_HOOK(a, l, release), HANGMAN_HOOK(a, l, release))
 
-#define HANGMAN_WAIT(a, l)	hangman_wait(a, l)
-#define HANGMAN_ACQUIRE(a, l)	hangman_acquire(a, l)
-#define HANGMAN_RELEASE(a, l)	hangman_release(a, l)
+/* For giving up waiting (timed acquires) instead of acquiring. */
+#define HANGMAN_CANCEL(a, l) \
+	(HANGMAN_HOOK(a, l, cancel), LOCKSTAT_HOOK(a, l, cancel))
 
 #else
 
@@ -73,11 +138,12 @@ void hangman_release(struct hangman_actor *a, struct hangman_lockable *l);
 #define HANGMAN_ACTORINIT(a, name)
 #define HANGMAN_LOCKABLEINIT(a, name)
 
-#define HANGMAN_LOCKABLE_INITIALIZER
+#define HANGMAN_LOCKABLE_INITIALIZER(n)
 
 #define HANGMAN_WAIT(a, l)
 #define HANGMAN_ACQUIRE(a, l)
 #define HANGMAN_RELEASE(a, l)
+#define HANGMAN_CANCEL(a, l)
 
 #endif
 
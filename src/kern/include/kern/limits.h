@@ -82,6 +82,9 @@
 /* Max open files per process */
 #define __OPEN_MAX      128
 
+/* Max threads per process, including the initial one */
+#define __THREAD_MAX    8
+
 /* Max bytes for atomic pipe I/O -- see description in the pipe() man page */
 #define __PIPE_BUF      512
 
@@ -67,6 +67,8 @@ struct rusage {
 	__counter_t ru_nsignals;	/* signals delivered (count) */
 	__counter_t ru_nvcsw;		/* voluntary context switches (count)*/
 	__counter_t ru_nivcsw;		/* involuntary ditto (count) */
+	__counter_t ru_inbytes;		/* bytes read (count; OS/161) */
+	__counter_t ru_oubytes;		/* bytes written (count; OS/161) */
 };
 
 /* limit codes for getrusage/setrusage */
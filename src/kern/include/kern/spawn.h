@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2003, 2008
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _KERN_SPAWN_H_
+#define _KERN_SPAWN_H_
+
+/*
+ * Definitions for __spawn().
+ *
+ * The child starts with a copy of the caller's file table; then the
+ * actions are applied to it in order, as if the child had done them
+ * between fork and execv. A failing action fails the whole spawn.
+ */
+
+/* Action types. */
+#define SPAWN_OPEN      1	/* sa_fd = open(sa_path, sa_flags) */
+#define SPAWN_CLOSE     2	/* close(sa_fd) */
+#define SPAWN_DUP2      3	/* dup2(sa_fd, sa_newfd) */
+
+/* Most actions one spawn can take. */
+#define SPAWN_ACTIONS_MAX  16
+
+struct spawn_action {
+	int sa_type;		/* SPAWN_* */
+	int sa_fd;		/* File descriptor acted on */
+	int sa_newfd;		/* SPAWN_DUP2: target descriptor */
+	int sa_flags;		/* SPAWN_OPEN: open flags */
+	const char *sa_path;	/* SPAWN_OPEN: path, in user space */
+};
+
+#endif /* _KERN_SPAWN_H_ */
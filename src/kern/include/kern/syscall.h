@@ -86,7 +86,7 @@
 //#define SYS_sigaltstack 33
 //                              (resource tracking and usage)
 //#define SYS_wait4      34
-//#define SYS_getrusage  35
+#define SYS_getrusage    35
 //                              (resource limits)
 //#define SYS_getrlimit  36
 //#define SYS_setrlimit  37
@@ -196,6 +196,18 @@
 #define SYS_sync         118
 #define SYS_reboot       119
 //#define SYS___sysctl   120
+//                              (cpu affinity)
+#define SYS_sched_setaffinity 121
+#define SYS_sched_getaffinity 122
+//                              (user threads)
+#define SYS___thread_create 123
+#define SYS_thread_join  124
+#define SYS_thread_exit  125
+//                              (futexes)
+#define SYS_futex_wait   126
+#define SYS_futex_wake   127
+//                              (process spawn)
+#define SYS___spawn      128
 
 /*CALLEND*/
 
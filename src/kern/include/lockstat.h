@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+/*
+ * Lock contention profiler. Enable with "options lockstat" in the
+ * kernel config.
+ *
+ * Statistics are kept per lock class, where a class is all the locks
+ * (spinlocks and sleep locks alike) that share a name. For each class
+ * we count acquisitions and contended acquisitions and accumulate
+ * the time spent waiting for and holding the lock.
+ *
+ * The hooks themselves are called through the HANGMAN_* macros in
+ * hangman.h. Collection starts off, because timestamps come from the
+ * clock device, which doesn't exist early in boot; turn it on from
+ * the menu.
+ */
+
+#include "opt-lockstat.h"
+
+#if OPT_LOCKSTAT
+
+void lockstat_enable(bool on);
+void lockstat_clear(void);
+void lockstat_dump(unsigned maxclasses);
+
+#endif
+
+#endif /* LOCKSTAT_H */
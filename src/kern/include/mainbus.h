@@ -52,6 +52,13 @@ void mainbus_interrupt(struct trapframe *);
 /* XXX this interface is not adequately MI */
 size_t mainbus_ramsize(void);
 
+/*
+ * Make the current cpu's next hardclock come after TICKS periods
+ * instead of one (for tickless idle). Periodic ticks resume after
+ * that, or when called again with 1.
+ */
+void mainbus_settimer(unsigned ticks);
+
 /* Switch on an inter-processor interrupt. (Low-level.) */
 void mainbus_send_ipi(struct cpu *target);
 
@@ -36,31 +36,55 @@
  * Note: curproc is defined by <current.h>.
  */
 
+#include <limits.h>
 #include <spinlock.h>
+#include <rcu.h>
+#include <thread.h>	/* for struct usage */
 #include <filetable.h>
 
 struct addrspace;
 struct thread;
 struct vnode;
+struct lock;
+struct cv;
+
+/*
+ * User threads of a multithreaded process. Thread id N runs on user
+ * stack slot N of the address space (see as_define_thread_stack);
+ * the initial thread is 0. An entry stays in use after its thread
+ * exits, until someone collects it with thread_join.
+ */
+struct uthread {
+	bool ut_used;			/* Running, or exited and unjoined */
+	bool ut_exited;			/* Has called thread_exit */
+	bool ut_joining;		/* Someone is in thread_join on it */
+	int ut_status;			/* Exit status, once exited */
+};
+
+struct uthreads {
+	struct lock *ut_lock;		/* Protects ut_threads */
+	struct cv *ut_cv;		/* Signalled when a thread exits */
+	struct uthread ut_threads[THREAD_MAX];
+};
 
 /*
  * Process structure.
  *
  * Note that we only count the number of threads in each process.
- * (And, unless you implement multithreaded user processes, this
- * number will not exceed 1 except in kproc.) If you want to know
- * exactly which threads are in the process, e.g. for debugging, add
- * an array and a sleeplock to protect it. (You can't use a spinlock
- * to protect an array because arrays need to be able to call
- * kmalloc.)
+ * User processes can have more than one thread; p_uthreads keeps
+ * track of the extra ones for thread_join.
  *
  * You will most likely be adding stuff to this structure, so you may
  * find you need a sleeplock in here for other reasons as well.
  * However, note that p_addrspace must be protected by a spinlock:
  * thread_switch needs to be able to fetch the current address space
  * without sleeping.
+ *
+ * The process table is read without locks (see proc_table_get), so
+ * proc_destroy frees the structure itself through call_rcu.
  */
 struct proc {
+	struct rcu_head p_rcu;		/* For freeing; must come first */
 	char *p_name;			/* Name of this process */
 	struct spinlock p_lock;		/* Lock for this structure */
 	unsigned p_numthreads;		/* Number of threads in this process */
@@ -80,6 +104,41 @@ struct proc {
 
 	// FILETABLE
 	struct filetable *p_filetable; /* File table for this process */
+
+	// USER THREADS (NULL UNTIL THE PROCESS STARTS ITS SECOND THREAD)
+	struct uthreads *p_uthreads;
+
+	// RESOURCE USAGE (UNDER p_lock). p_usage IS OUR THREADS' USAGE AS FAR AS
+	// IT HAS BEEN TAKEN FROM THEM (SEE proc_chargeusage), p_cusage IS THE TOTAL
+	// USAGE OF THE CHILDREN WE HAVE WAITED FOR, AND OF THEIR CHILDREN, ETC.
+	// p_waited IS SET ONCE OUR PARENT HAS WAITED FOR US (AND ADDED US INTO ITS
+	// p_cusage).
+	struct usage p_usage;
+	struct usage p_cusage;
+	bool p_waited;
+
+	// REAPING (UNDER p_lock). AN EXITED PROCESS IS DESTROYED BY THE REAPER
+	// THREAD ONCE ITS LAST THREAD HAS LEFT AND ITS PARENT HAS WAITED FOR IT OR
+	// EXITED (SEE proc_reapable). p_reapnext LINKS THE REAPER'S QUEUE.
+	bool p_reaping;
+	struct proc *p_reapnext;
+
+	// CHILDREN (UNDER p_lock). THE CHILDREN WE HAVEN'T WAITED FOR ARE ON
+	// p_children, LINKED THROUGH THEIR p_sibnext/p_sibprev, AND p_nchildren
+	// COUNTS THEM. EXITED ONES ARE ALSO QUEUED ON p_exithead..p_exittail IN THE
+	// ORDER THEY EXITED, LINKED THROUGH THEIR p_exitnext/p_exitprev. A CHILD'S
+	// LINKS (AND p_onexitq) ARE UNDER THE PARENT'S LOCK, AND waitpid SLEEPS ON
+	// p_waitchan. LOCK ORDER: A PARENT'S p_lock BEFORE ITS CHILD'S.
+	unsigned p_nchildren;
+	struct proc *p_children;
+	struct proc *p_sibnext;
+	struct proc *p_sibprev;
+	struct proc *p_exithead;
+	struct proc *p_exittail;
+	struct proc *p_exitnext;
+	struct proc *p_exitprev;
+	bool p_onexitq;
+	struct wchan *p_waitchan;
 };
 
 /* This is the process structure for the kernel and for kernel-only threads. */
@@ -88,9 +147,15 @@ extern struct proc *kproc;
 /* Call once during system startup to allocate data structures. */
 void proc_bootstrap(void);
 
+/* Call once during startup, after the thread system is up, to start the reaper. */
+void proc_reaper_bootstrap(void);
+
 /* Create a fresh process for use by runprogram(). */
 struct proc *proc_create_runprogram(const char *name);
 
+/* Create a child of the current process, with an empty file table. */
+int proc_create_child(const char *name, struct proc **ret);
+
 /* Destroy a process. */
 void proc_destroy(struct proc *proc);
 
@@ -106,6 +171,9 @@ struct addrspace *proc_getas(void);
 /* Change the address space of the current process, and return the old one. */
 struct addrspace *proc_setas(struct addrspace *);
 
+/* Fetch the user thread table of PROC, creating it if needed. */
+struct uthreads *proc_uthreads(struct proc *proc);
+
 void proc_table_create(void);
 
 int assign_pid(struct proc *proc);
@@ -113,7 +181,21 @@ int assign_pid(struct proc *proc);
 int free_pid(struct proc *proc);
 
 int validity_check_pid(pid_t pid);
-void wait_func(pid_t pid);
+int wait_func(pid_t pid, int options, pid_t *retpid, int *exitcode);
+
+/* Tell the current process's parent it has exited. */
+void proc_exitnotify(void);
+
+/* Move the current thread's usage into its process's totals. */
+void proc_chargeusage(void);
+
+/* Get PROC's own usage, or with CHILDREN its waited-for children's. */
+void proc_getusage(struct proc *proc, bool children, struct usage *u);
+
+/* Reaping: see proc.c. */
+bool proc_reapable(struct proc *proc);
+void proc_reap(struct proc *proc);
+void proc_reparent_children(struct proc *parent);
 void copy_status(const struct __userptr * status);
 
 #endif /* _PROC_H_ */
@@ -3,11 +3,19 @@
 
 #include <types.h>
 
+struct trapframe;
+
 int sys_getpid(pid_t *retval);
 int sys_fork(struct trapframe *tf, int32_t *retval);
 void sys_exit (int status);
 // int sys_waitpid(pid_t pid, int32_t *retval, int32_t options);
 int sys_waitpid(pid_t pid,const struct __userptr * status,int32_t *retval, int32_t options);
 int sys_execv(const char *program, char **args, int *retval);
+int sys_spawn(const_userptr_t upath, userptr_t uargv, const_userptr_t uactions,
+              int nactions, int32_t *retval);
+int sys_thread_create(struct trapframe *tf, int32_t *retval);
+int sys_thread_join(int tid, userptr_t status);
+void sys_thread_exit(int status);
+int sys_getrusage(int who, userptr_t uusage);
 
 #endif /* _PROC_SYSCALLS_H_ */
\ No newline at end of file
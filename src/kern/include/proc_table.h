@@ -2,20 +2,50 @@
 #define _PROC_TABLE_H_
 
 #include <types.h>
+#include <limits.h>
 #include <proc.h>
 #include <kern/errno.h>
 #include <lib.h>
 #include <current.h>
 
-#define MAX_PROC_NUM 200
+// THE TABLE IS INDEXED BY PID IN TWO LEVELS: A FIXED ARRAY OF CHUNK POINTERS,
+// AND CHUNKS OF PT_CHUNK SLOTS THAT ARE ALLOCATED THE FIRST TIME ONE OF THEIR
+// PIDS IS HANDED OUT. CHUNKS ARE NEVER FREED.
+//
+// UPDATES ARE SERIALIZED BY pt_lock. LOOKUPS TAKE NO LOCK: CHUNKS AND SLOT
+// POINTERS ARE PUBLISHED WITH rcu_assign_pointer, AND A PROCESS IS ONLY FREED
+// A GRACE PERIOD AFTER ITS SLOT IS CLEARED (SEE proc_destroy).
+#define PT_CHUNK 256
+#define PT_NCHUNKS ((PID_MAX + PT_CHUNK) / PT_CHUNK)
+
+// PID 1 IS THE KERNEL PROCESS; USER PROCESSES GET PID_MIN..PID_MAX
+#define KPROC_PID 1
+
 extern struct proc_table *ptable;
 
+struct lock;
 
+struct pt_slot {
+    struct proc *ps_proc;   // process with this pid, or NULL
+    pid_t ps_next;          // next free pid after this one, or 0
+};
+
+// FREE PIDS ARE KEPT ON A FIFO LIST THREADED THROUGH THE SLOTS, SO A FREED PID
+// IS REUSED AS LATE AS POSSIBLE. PIDS THAT HAVE NEVER BEEN USED ARE ABOVE
+// next_pid AND DON'T NEED TO BE ON THE LIST. BOTH ENDS ARE O(1).
 struct proc_table {
-    struct proc *process[MAX_PROC_NUM];    // array of pointers to processes
-    pid_t next_pid;
-    int num_processes;  // number of active processes
+    struct lock *pt_lock;                   // serializes updates to the rest
+    struct pt_slot *pt_chunks[PT_NCHUNKS];  // NULL until first used
+    pid_t freehead;         // oldest freed pid, or 0
+    pid_t freetail;         // newest freed pid, or 0
+    pid_t next_pid;         // lowest never-used pid
+    int num_processes;      // number of active processes
 };
 
+// LOOK UP A PROCESS BY PID. RETURNS NULL IF THERE ISN'T ONE. THE RESULT IS
+// ONLY GOOD UNTIL rcu_read_unlock, SO CALL THIS IN A READ SECTION UNLESS YOU
+// KNOW THE PROCESS CAN'T BE DESTROYED (E.G. IT'S curproc).
+struct proc *proc_table_get(pid_t pid);
+
 
-#endif /* _PROC_TABLE_H_ */
\ No newline at end of file
+#endif /* _PROC_TABLE_H_ */
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _RCU_H_
+#define _RCU_H_
+
+/*
+ * Read-copy-update: deferred reclamation for lockless readers.
+ *
+ * Readers bracket their accesses with rcu_read_lock/rcu_read_unlock
+ * and fetch shared pointers with rcu_dereference. They take no locks
+ * and may not sleep; the thread is not preempted in between, either.
+ * Read sections nest. They may not be used in interrupt handlers: an
+ * idle cpu counts as quiescent even while it's taking an interrupt.
+ *
+ * Writers still serialize among themselves with an ordinary lock.
+ * They publish new objects with rcu_assign_pointer, and retire old
+ * ones with call_rcu, which calls FUNC(HEAD) once every reader that
+ * might still see the object is done. synchronize_rcu waits for that
+ * directly; it sleeps, so it may not be called from a read section.
+ *
+ * This is quiescent-state based: a cpu passing through thread_switch
+ * can't be inside a read section, so once every cpu has switched (or
+ * gone idle) since an object was retired, nobody can hold a reference
+ * to it. Callbacks run in the "rcu" kernel thread, so they may call
+ * kfree and the like but should not block for long.
+ */
+
+#include <membar.h>
+
+struct rcu_head {
+	struct rcu_head *rh_next;
+	void (*rh_func)(struct rcu_head *);
+};
+
+void rcu_read_lock(void);
+void rcu_read_unlock(void);
+
+#define rcu_dereference(p)	(*(volatile __typeof__(p) *)&(p))
+#define rcu_assign_pointer(p, v) \
+	do { membar_store_store(); (p) = (v); } while (0)
+
+void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *));
+void synchronize_rcu(void);
+
+/* Call once during startup, after the secondary cpus are up. */
+void rcu_bootstrap(void);
+
+
+#endif /* _RCU_H_ */
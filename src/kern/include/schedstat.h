@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _SCHEDSTAT_H_
+#define _SCHEDSTAT_H_
+
+/*
+ * Scheduler statistics.
+ *
+ * Per cpu (in struct cpu): context switches, split into voluntary
+ * ones and ones forced from an interrupt; a histogram of run queue
+ * length, sampled each hardclock; migrations in and out; IPIs sent
+ * and received by type; and wakeup-to-run latency. Idle time is the
+ * run time of the cpu's idle thread.
+ *
+ * Per thread (in struct thread): time spent running and time spent
+ * runnable but waiting in a run queue.
+ *
+ * Counters are always kept. Times come from the clock device, which
+ * doesn't exist early in boot, so they start at schedstat_bootstrap.
+ * Reports are printed by the "sstat" menu command and can be read
+ * from the "schedstat:" device; writing to the device (or "sstat
+ * clear") zeroes the per-cpu counters.
+ */
+
+struct cpu;
+
+/* Hooks for the thread system. */
+uint64_t schedstat_now(void);		/* ns, or 0 if not timing yet */
+void schedstat_hardclock(void);
+void schedstat_clearcpu(struct cpu *c);
+
+/* Call once during startup, after the clock and vfs are up. */
+void schedstat_bootstrap(void);
+
+void schedstat_clear(void);
+void schedstat_dump(void);
+
+#endif /* _SCHEDSTAT_H_ */
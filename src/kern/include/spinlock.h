@@ -37,6 +37,7 @@
 
 #include <cdefs.h>
 #include <hangman.h>
+#include "opt-ticketlock.h"
 
 /* Inlining support - for making sure an out-of-line copy gets built */
 #ifndef SPINLOCK_INLINE
@@ -51,30 +52,55 @@
  *
  * Note that spinlocks are held by CPUs, not by threads.
  *
+ * With "options ticketlock" these are ticket locks: each acquirer
+ * takes the next number from splk_next and spins until splk_owner
+ * reaches it, so the lock is handed off in FIFO order and waiters
+ * only read the lock while spinning. Otherwise they are plain
+ * test-and-test-and-set locks on splk_lock.
+ *
  * This structure is made public so spinlocks do not have to be
  * malloc'd; however, code that uses spinlocks should not look inside
  * the structure directly but always use the spinlock API functions.
  */
 struct spinlock {
+#if OPT_TICKETLOCK
+	volatile spinlock_data_t splk_next;  /* Next ticket to hand out. */
+	volatile spinlock_data_t splk_owner; /* Ticket now holding the lock. */
+#else
 	volatile spinlock_data_t splk_lock; /* Memory word where we spin. */
+#endif
 	struct cpu *splk_holder;	    /* CPU holding this lock. */
 	HANGMAN_LOCKABLE(splk_hangman);     /* Deadlock detector hook. */
 };
 
 /*
  * Initializer for cases where a spinlock needs to be static or global.
+ * The named form sets the name the deadlock detector and the lock
+ * profiler report the lock under.
  */
-#ifdef OPT_HANGMAN
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL, \
-				  HANGMAN_LOCKABLE_INITIALIZER }
+#if OPT_TICKETLOCK
+#define SPINLOCK_DATA_INITIALIZERS \
+	SPINLOCK_DATA_INITIALIZER, SPINLOCK_DATA_INITIALIZER
+#else
+#define SPINLOCK_DATA_INITIALIZERS	SPINLOCK_DATA_INITIALIZER
+#endif
+
+#if OPT_HANGMAN || OPT_LOCKSTAT
+#define SPINLOCK_NAMED_INITIALIZER(n) \
+	{ SPINLOCK_DATA_INITIALIZERS, NULL, HANGMAN_LOCKABLE_INITIALIZER(n) }
 #else
-#define SPINLOCK_INITIALIZER	{ SPINLOCK_DATA_INITIALIZER, NULL }
+#define SPINLOCK_NAMED_INITIALIZER(n) \
+	{ SPINLOCK_DATA_INITIALIZERS, NULL }
 #endif
+#define SPINLOCK_INITIALIZER	SPINLOCK_NAMED_INITIALIZER("spinlock")
 
 /*
  * Spinlock functions.
  *
  * init		Initialize the contents of a spinlock.
+ * setname	Set the name used by the deadlock detector and lock
+ *		profiler. The string is not copied. Default "spinlock".
+ *		Does nothing if neither is configured.
  * cleanup	Opposite of init. Lock must be unlocked.
  *
  * acquire	Get the lock, spinning as necessary. Also disables interrupts.
@@ -84,6 +110,11 @@ struct spinlock {
  */
 
 void spinlock_init(struct spinlock *lk);
+#if OPT_HANGMAN || OPT_LOCKSTAT
+void spinlock_setname(struct spinlock *lk, const char *name);
+#else
+#define spinlock_setname(lk, name) ((void)(lk), (void)(name))
+#endif
 void spinlock_cleanup(struct spinlock *lk);
 
 void spinlock_acquire(struct spinlock *lk);
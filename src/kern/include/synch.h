@@ -48,6 +48,7 @@ struct semaphore {
 	struct wchan *sem_wchan;
 	struct spinlock sem_lock;
         volatile unsigned sem_count;
+	bool sem_handoff;		/* V passes the count to a waiter */
 };
 
 struct semaphore *sem_create(const char *name, unsigned initial_count);
@@ -58,9 +59,23 @@ void sem_destroy(struct semaphore *);
  *     P (proberen): decrement count. If the count is 0, block until
  *                   the count is 1 again before decrementing.
  *     V (verhogen): increment count.
+ *
+ * P_timeout is P that gives up after the given number of hardclocks,
+ * returning ETIMEDOUT; it returns 0 if it decremented the count.
  */
 void P(struct semaphore *);
 void V(struct semaphore *);
+int P_timeout(struct semaphore *, unsigned ticks);
+
+/*
+ * Normally a thread woken by V has to compete for the count with any
+ * thread that calls P before it runs, and can lose to it
+ * indefinitely. In handoff mode V gives the count directly to the
+ * longest waiter instead, so waiters are served strictly FIFO.
+ * Handoff costs a context switch whenever someone is waiting, so it's
+ * off by default. Set it before the semaphore is in use.
+ */
+void sem_set_handoff(struct semaphore *, bool on);
 
 
 /*
@@ -75,8 +90,15 @@ void V(struct semaphore *);
 struct lock {
         char *lk_name;
         HANGMAN_LOCKABLE(lk_hangman);   /* Deadlock detector hook. */
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
+	struct wchan *lk_wchan;
+	struct spinlock lk_lock;	/* Protects lk_holder and lk_wchan. */
+	struct thread *volatile lk_holder;
+	bool lk_handoff;		/* Release passes the lock to a waiter */
+
+	/* Priority inheritance; protected by a global spinlock. */
+	unsigned lk_waitpri;		/* Highest priority of any waiter */
+	struct thread *lk_piowner;	/* Holder, while on its t_pilocks */
+	struct lock *lk_pinext;		/* Next on lk_piowner's t_pilocks */
 };
 
 struct lock *lock_create(const char *name);
@@ -90,12 +112,28 @@ void lock_destroy(struct lock *);
  *                   this.
  *    lock_do_i_hold - Return true if the current thread holds the lock;
  *                   false otherwise.
+ *    lock_acquire_timeout - Like lock_acquire, but give up after the
+ *                   given number of hardclocks and return ETIMEDOUT.
+ *                   Returns 0 if the lock was acquired.
+ *    lock_set_handoff - Turn handoff mode on or off, as for semaphores:
+ *                   lock_release makes the longest waiter the holder
+ *                   rather than letting waiters race for the lock.
+ *                   Set it before the lock is in use.
+ *
+ * Locks do priority inheritance: while a thread is waiting for a
+ * lock, the holder runs at (at least) the waiter's priority, and so
+ * on down the chain if the holder is waiting for another lock.
  *
  * These operations must be atomic. You get to write them.
  */
 void lock_acquire(struct lock *);
+int lock_acquire_timeout(struct lock *, unsigned ticks);
 void lock_release(struct lock *);
 bool lock_do_i_hold(struct lock *);
+void lock_set_handoff(struct lock *, bool on);
+
+/* For thread_setpriority: set T's base priority. */
+void lock_pi_setbasepri(struct thread *t, unsigned pri);
 
 
 /*
@@ -114,8 +152,8 @@ bool lock_do_i_hold(struct lock *);
 
 struct cv {
         char *cv_name;
-        // add what you need here
-        // (don't forget to mark things volatile as needed)
+	struct wchan *cv_wchan;
+	struct spinlock cv_lock;	/* Protects cv_wchan. */
 };
 
 struct cv *cv_create(const char *name);
@@ -127,6 +165,9 @@ void cv_destroy(struct cv *);
  *                   waking up again, re-acquire the lock.
  *    cv_signal    - Wake up one thread that's sleeping on this CV.
  *    cv_broadcast - Wake up all threads sleeping on this CV.
+ *    cv_wait_timeout - Like cv_wait, but stop waiting after the given
+ *                   number of hardclocks and return ETIMEDOUT. The
+ *                   lock is reacquired either way.
  *
  * For all three operations, the current thread must hold the lock passed
  * in. Note that under normal circumstances the same lock should be used
@@ -135,6 +176,7 @@ void cv_destroy(struct cv *);
  * These operations must be atomic. You get to write them.
  */
 void cv_wait(struct cv *cv, struct lock *lock);
+int cv_wait_timeout(struct cv *cv, struct lock *lock, unsigned ticks);
 void cv_signal(struct cv *cv, struct lock *lock);
 void cv_broadcast(struct cv *cv, struct lock *lock);
 
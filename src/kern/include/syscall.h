@@ -48,6 +48,9 @@ void syscall(struct trapframe *tf);
 /* void enter_forked_process(struct trapframe *tf, unsigned long data2); */
 /* void enter_forked_process(struct trapframe *tf); */
 
+/* Set up the futex wait table (futex_syscalls.c). */
+void futex_bootstrap(void);
+
 /* Enter user mode. Does not return. */
 __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 		       vaddr_t stackptr, vaddr_t entrypoint);
@@ -59,5 +62,10 @@ __DEAD void enter_new_process(int argc, userptr_t argv, userptr_t env,
 
 int sys_reboot(int code);
 int sys___time(userptr_t user_seconds, userptr_t user_nanoseconds);
+int sys_nanosleep(userptr_t user_req, userptr_t user_rem);
+int sys_sched_setaffinity(pid_t pid, uint32_t mask);
+int sys_sched_getaffinity(pid_t pid, userptr_t user_mask);
+int sys_futex_wait(userptr_t user_addr, int expected, userptr_t user_timeout);
+int sys_futex_wake(userptr_t user_addr, int count, int32_t *retval);
 
 #endif /* _SYSCALL_H_ */
@@ -54,6 +54,8 @@ int semtest(int, char **);
 int locktest(int, char **);
 int cvtest(int, char **);
 int cvtest2(int, char **);
+int pitest(int, char **);
+int lockhandofftest(int, char **);
 
 /* semaphore unit tests */
 int semu1(int, char **);
@@ -78,6 +80,24 @@ int semu19(int, char **);
 int semu20(int, char **);
 int semu21(int, char **);
 int semu22(int, char **);
+int semu23(int, char **);
+
+/* timer tests */
+int timertest(int, char **);
+
+/* rcu tests */
+int rcutest(int, char **);
+
+/* ipi tests */
+int ipitest(int, char **);
+
+/* periodic thread tests */
+int edftest(int, char **);
+
+/* process tests */
+int pidtest(int, char **);
+int procbench1(int, char **);
+int procbench2(int, char **);
 
 /* filesystem tests */
 int fstest(int, char **);
@@ -41,6 +41,7 @@
 #include <threadlist.h>
 
 struct cpu;
+struct lock;
 
 /* get machine-dependent defs */
 #include <machine/thread.h>
@@ -58,6 +59,25 @@ struct cpu;
 #define SAME_STACK(p1, p2)     (((p1) & STACK_MASK) == ((p2) & STACK_MASK))
 
 
+/*
+ * CPU affinity masks: bit N set means the thread may run on cpu N
+ * (by software number). This limits us to 32 cpus, which is also
+ * System/161's limit.
+ */
+#define THREAD_AFFINITY_ALL	0xffffffffU
+#define THREAD_ALLOWED(t, c)	(((t)->t_affinity & (1U << (c)->c_number)) != 0)
+
+
+/*
+ * Scheduling priorities. Higher numbers run first; threads of equal
+ * priority take turns. Everything runs at THREAD_PRI_DEFAULT unless
+ * told otherwise, and new threads inherit their creator's priority.
+ */
+#define THREAD_PRI_MIN		0
+#define THREAD_PRI_DEFAULT	0
+#define THREAD_PRI_MAX		31
+
+
 /* States a thread can be in. */
 typedef enum {
 	S_RUN,		/* running */
@@ -66,6 +86,22 @@ typedef enum {
 	S_ZOMBIE,	/* zombie; exited but not yet deleted */
 } threadstate_t;
 
+/*
+ * Resource usage, for getrusage. Each thread counts its own (except
+ * run time, which is t_runtime), and the counts are moved into its
+ * process's totals when it leaves the process or the process asks
+ * for them; see thread_takeusage.
+ */
+struct usage {
+	uint64_t u_runtime;		/* ns running */
+	uint64_t u_systime;		/* ns of that spent in system calls */
+	uint64_t u_minflt;		/* TLB faults handled */
+	uint64_t u_nvcsw;		/* Switches that slept or yielded */
+	uint64_t u_nivcsw;		/* Switches forced by an interrupt */
+	uint64_t u_inbytes;		/* Bytes read by read() */
+	uint64_t u_outbytes;		/* Bytes written by write() */
+};
+
 /* Thread structure. */
 struct thread {
 	/*
@@ -85,6 +121,24 @@ struct thread {
 	struct switchframe *t_context;	/* Saved register context (on stack) */
 	struct cpu *t_cpu;		/* CPU thread runs on */
 	struct proc *t_proc;		/* Process thread belongs to */
+	unsigned t_lastrun;		/* t_cpu's c_hardclocks when last run */
+	uint32_t t_affinity;		/* CPUs thread may run on */
+	unsigned t_basepri;		/* Priority from thread_setpriority */
+	unsigned t_priority;		/* Effective (maybe inherited) priority */
+	struct lock *t_blockedon;	/* Lock being waited for (see synch.c) */
+	struct lock *t_pilocks;		/* Held locks with waiters */
+	unsigned t_period;		/* Period in ticks, or 0 if not periodic */
+	unsigned t_reldeadline;		/* Deadline, in ticks after release */
+	unsigned t_release;		/* Tick the current period began */
+	unsigned t_deadline;		/* Tick the current period is due */
+	struct wchan *t_wchan;		/* Wait channel, if sleeping */
+	unsigned t_rcu_nest;		/* Depth of RCU read sections */
+	uint64_t t_runtime;		/* ns spent running (see schedstat.c) */
+	uint64_t t_runcharged;		/* Part of t_runtime in t_proc's usage */
+	struct usage t_usage;		/* Counts not yet in t_proc's usage */
+	uint64_t t_waittime;		/* ns spent runnable but queued */
+	uint64_t t_stamp;		/* Time of last switch or wakeup, or 0 */
+	bool t_woken;			/* Made runnable from S_SLEEP */
 	HANGMAN_ACTOR(t_hangman);	/* Deadlock detector hook */
 
 	/*
@@ -108,6 +162,8 @@ struct thread {
 	 * Public fields
 	 */
 
+	unsigned t_tid;			/* User thread id within t_proc */
+
 	/* add more here as needed */
 };
 
@@ -166,10 +222,65 @@ void thread_yield(void);
 void schedule(void);
 
 /*
- * Potentially migrate ready threads to other CPUs. Called from the
- * timer interrupt.
+ * Potentially pull ready threads over from busier CPUs. Called from
+ * the timer interrupt. (Idle CPUs also steal work on their own from
+ * the idle loop in thread_switch.)
  */
 void thread_consider_migration(void);
 
+/*
+ * CPU affinity. thread_setaffinity restricts thread T to the cpus in
+ * MASK (see THREAD_AFFINITY_ALL above); it fails with EINVAL if that
+ * leaves no cpu that exists. If T is running somewhere it isn't
+ * allowed, it moves the next time it's switched out (immediately,
+ * if it's the current thread). New threads inherit the mask of the
+ * thread that forks them.
+ *
+ * thread_pin binds the current thread to the single cpu CPUNUM; it
+ * is intended for kernel worker threads that want to keep their
+ * cache footprint in one place.
+ */
+int thread_setaffinity(struct thread *t, uint32_t mask);
+uint32_t thread_getaffinity(struct thread *t);
+int thread_pin(unsigned cpunum);
+
+/*
+ * Priorities. thread_setpriority sets thread T's base priority (see
+ * THREAD_PRI_* above). A thread holding a lock that higher-priority
+ * threads are waiting for runs at the highest of their priorities
+ * until it releases it; thread_getpriority returns the priority the
+ * thread is running at, inherited or not.
+ */
+void thread_setpriority(struct thread *t, unsigned pri);
+unsigned thread_getpriority(struct thread *t);
+
+/*
+ * Periodic threads. thread_setperiodic makes the current thread
+ * periodic: it is released every PERIOD hardclocks, starting now,
+ * and each release should be done within DEADLINE hardclocks (which
+ * can't exceed PERIOD). A PERIOD of 0 makes it an ordinary thread
+ * again. Returns EINVAL for a bad DEADLINE.
+ *
+ * Runnable periodic threads run ahead of all other threads, earliest
+ * deadline first; priorities only order the rest.
+ *
+ * thread_waitperiod sleeps until the next release, and returns how
+ * many releases were missed because the thread was still working
+ * when they came (0 if it kept up). New threads are never periodic.
+ */
+int thread_setperiodic(unsigned period, unsigned deadline);
+unsigned thread_waitperiod(void);
+
+/*
+ * Resource usage. thread_runtime returns the current thread's run
+ * time so far, including the current time slice, or 0 before timing
+ * starts (see schedstat.h). thread_takeusage moves the current
+ * thread's usage since it was last taken into U, leaving the
+ * thread's counts at zero. usage_add adds FROM into TO.
+ */
+uint64_t thread_runtime(void);
+void thread_takeusage(struct usage *u);
+void usage_add(struct usage *to, const struct usage *from);
+
 
 #endif /* _THREAD_H_ */
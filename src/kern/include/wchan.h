@@ -36,6 +36,7 @@
 
 
 struct spinlock; /* in spinlock.h */
+struct thread; /* in thread.h */
 struct wchan; /* Opaque */
 
 /*
@@ -66,15 +67,31 @@ bool wchan_isempty(struct wchan *wc, struct spinlock *lk);
  */
 void wchan_sleep(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Same, but also wake up on our own after TICKS hardclocks. Returns
+ * true if that's what happened, false if someone else woke us.
+ */
+bool wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk,
+			 unsigned ticks);
+
 /*
  * Wake up one thread, or all threads, sleeping on a wait channel.
  * The associated spinlock should be locked.
  *
- * The current implementation is FIFO but this is not promised by the
- * interface.
+ * Wait channels are FIFO: wchan_wakeone wakes the thread that has
+ * been waiting longest, and returns it (or NULL if nobody was
+ * waiting) so the caller can hand something to it directly. The
+ * thread can't run until the caller releases the spinlock.
  */
-void wchan_wakeone(struct wchan *wc, struct spinlock *lk);
+struct thread *wchan_wakeone(struct wchan *wc, struct spinlock *lk);
 void wchan_wakeall(struct wchan *wc, struct spinlock *lk);
 
+/*
+ * Return the highest scheduling priority among the threads sleeping
+ * on a wait channel (THREAD_PRI_MIN if none). The associated spinlock
+ * should be locked. Used for priority inheritance.
+ */
+unsigned wchan_maxpriority(struct wchan *wc, struct spinlock *lk);
+
 
 #endif /* _WCHAN_H_ */
@@ -47,6 +47,8 @@
 #include <vfs.h>
 #include <device.h>
 #include <syscall.h>
+#include <rcu.h>
+#include <schedstat.h>
 #include <test.h>
 #include <version.h>
 #include "autoconf.h"  // for pseudoconfig
@@ -126,7 +128,11 @@ boot(void)
 	/* Late phase of initialization. */
 	vm_bootstrap();
 	kprintf_bootstrap();
+	futex_bootstrap();
 	thread_start_cpus();
+	rcu_bootstrap();
+	proc_reaper_bootstrap();
+	schedstat_bootstrap();
 
 	/* Default bootfs - but ignore failure, in case emu0 doesn't exist */
 	vfs_setbootfs("emu0");
@@ -43,6 +43,8 @@
 #include <sfs.h>
 #include <syscall.h>
 #include <test.h>
+#include <lockstat.h>
+#include <schedstat.h>
 #include "opt-sfs.h"
 #include "opt-net.h"
 
@@ -494,6 +496,57 @@ cmd_kheapdump(int nargs, char **args)
 	return 0;
 }
 
+#if OPT_LOCKSTAT
+/*
+ * Command for lock contention stats.
+ */
+static
+int
+cmd_lockstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		lockstat_dump(10);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "on")) {
+		lockstat_enable(true);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "off")) {
+		lockstat_enable(false);
+	}
+	else if (nargs == 2 && !strcmp(args[1], "clear")) {
+		lockstat_clear();
+	}
+	else if (nargs == 2 && atoi(args[1]) > 0) {
+		lockstat_dump(atoi(args[1]));
+	}
+	else {
+		kprintf("Usage: lkstat [on | off | clear | count]\n");
+	}
+
+	return 0;
+}
+#endif
+
+/*
+ * Command for scheduler stats.
+ */
+static
+int
+cmd_schedstat(int nargs, char **args)
+{
+	if (nargs == 1) {
+		schedstat_dump();
+	}
+	else if (nargs == 2 && !strcmp(args[1], "clear")) {
+		schedstat_clear();
+	}
+	else {
+		kprintf("Usage: sstat [clear]\n");
+	}
+
+	return 0;
+}
+
 ////////////////////////////////////////
 //
 // Menus.
@@ -570,7 +623,16 @@ static const char *testmenu[] = {
 	"[sy2] Lock test             (1)     ",
 	"[sy3] CV test               (1)     ",
 	"[sy4] CV test #2            (1)     ",
-	"[semu1-22] Semaphore unit tests     ",
+	"[sy5] Priority inheritance test     ",
+	"[sy6] Lock handoff test             ",
+	"[semu1-23] Semaphore unit tests     ",
+	"[tmt] Timer and timeout test        ",
+	"[rcu] RCU test                      ",
+	"[ipi] Cross-cpu call test           ",
+	"[edf] Periodic thread test          ",
+	"[pid] PID allocator test            ",
+	"[pb1] Process create/exit benchmark ",
+	"[pb2] Process exec benchmark        ",
 	"[fs1] Filesystem test               ",
 	"[fs2] FS read stress                ",
 	"[fs3] FS write stress               ",
@@ -601,6 +663,10 @@ static const char *mainmenu[] = {
 	"[kh] Kernel heap stats              ",
 	"[khgen] Next kernel heap generation ",
 	"[khdump] Dump kernel heap           ",
+#if OPT_LOCKSTAT
+	"[lkstat] Lock contention stats      ",
+#endif
+	"[sstat] Scheduler stats             ",
 	"[q] Quit and shut down              ",
 	NULL
 };
@@ -652,6 +718,10 @@ static struct {
 	{ "kh",         cmd_kheapstats },
 	{ "khgen",      cmd_kheapgeneration },
 	{ "khdump",     cmd_kheapdump },
+#if OPT_LOCKSTAT
+	{ "lkstat",	cmd_lockstat },
+#endif
+	{ "sstat",	cmd_schedstat },
 
 	/* base system tests */
 	{ "at",		arraytest },
@@ -674,6 +744,8 @@ static struct {
 	{ "sy2",	locktest },
 	{ "sy3",	cvtest },
 	{ "sy4",	cvtest2 },
+	{ "sy5",	pitest },
+	{ "sy6",	lockhandofftest },
 
 	/* semaphore unit tests */
 	{ "semu1",	semu1 },
@@ -698,6 +770,24 @@ static struct {
 	{ "semu20",	semu20 },
 	{ "semu21",	semu21 },
 	{ "semu22",	semu22 },
+	{ "semu23",	semu23 },
+
+	/* timer tests */
+	{ "tmt",	timertest },
+
+	/* rcu tests */
+	{ "rcu",	rcutest },
+
+	/* ipi tests */
+	{ "ipi",	ipitest },
+
+	/* periodic thread tests */
+	{ "edf",	edftest },
+
+	/* process tests */
+	{ "pid",	pidtest },
+	{ "pb1",	procbench1 },
+	{ "pb2",	procbench2 },
 
 	/* file system assignment tests */
 	{ "fs1",	fstest },
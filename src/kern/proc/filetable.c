@@ -28,6 +28,7 @@ int openfile_init(struct vnode *vn, int flags, struct openfile **ret) {
     of->vn          = vn;
     of->flags       = flags;
     of->offset      = 0;
+    of->refcount    = 1;
 
     of->lock        = lock_create("openfile_lock");
 
@@ -38,6 +39,8 @@ int openfile_init(struct vnode *vn, int flags, struct openfile **ret) {
         return -1;
     }
 
+    spinlock_init(&of->refcount_lock);
+
     // SET THE RETURN VALUE
     *ret = of;
 
@@ -49,7 +52,11 @@ int openfile_destroy(struct openfile *of) {
     // BE SURE THE OPENFILE ISN'T NULL
     KASSERT(of != NULL);
 
-    // DESTROY THE LOCK
+    // BE SURE NOBODY STILL USES IT
+    KASSERT(of->refcount == 0);
+
+    // DESTROY THE LOCKS
+    spinlock_cleanup(&of->refcount_lock);
     lock_destroy(of->lock);
 
     // FREE THE SPCE OF THE OPENFILE
@@ -59,42 +66,36 @@ int openfile_destroy(struct openfile *of) {
 }
 
 // INCREMENT THE REFERENCE COUNT OF AN OPENFILE STRUCT
-// int openfile_addref(struct openfile *of, bool no_lock) {
-//     // BE SURE THE OPENFILE ISN'T NULL
-//     KASSERT(of != NULL);
-
-//     // ACQUIRE THE LOCK IF no_lock IS FALSE
-//     if (!no_lock) {
-//         lock_acquire(of->lock);
-//     }
-
-//     // INCREMENT THE REFERENCE COUNT
-//     of->refcount++;
-
-//     // RELEASE THE LOCK IF no_lock IS FALSE
-//     if (!no_lock) {
-//         lock_release(of->lock);
-//     }
-    
-//     return 0;
-// }
+void openfile_incref(struct openfile *of) {
+    // BE SURE THE OPENFILE ISN'T NULL
+    KASSERT(of != NULL);
 
-// DECREMENT THE REFERENCE COUNT OF AN OPENFILE STRUCT
-// int openfile_decref(struct openfile *of) {
-//     // BE SURE THE OPENFILE ISN'T NULL
-//     KASSERT(of != NULL);
+    spinlock_acquire(&of->refcount_lock);
+    KASSERT(of->refcount > 0);
+    of->refcount++;
+    spinlock_release(&of->refcount_lock);
+}
 
-//     // ACQUIRE THE LOCK
-//     lock_acquire(of->lock);
+// DECREMENT THE REFERENCE COUNT OF AN OPENFILE STRUCT. WHOEVER DROPS THE LAST
+// REFERENCE IS THE ONLY ONE LEFT WHO CAN SEE IT, SO CLOSING THE VNODE AND
+// FREEING IT NEEDS NO LOCK.
+void openfile_decref(struct openfile *of) {
+    bool last;
 
-//     // DECREMENT THE REFERENCE COUNT
-//     of->refcount--;
+    // BE SURE THE OPENFILE ISN'T NULL
+    KASSERT(of != NULL);
 
-//     // RELEASE THE LOCK
-//     lock_release(of->lock);
+    spinlock_acquire(&of->refcount_lock);
+    KASSERT(of->refcount > 0);
+    of->refcount--;
+    last = (of->refcount == 0);
+    spinlock_release(&of->refcount_lock);
 
-//     return 0;
-// }
+    if (last) {
+        vfs_close(of->vn);
+        openfile_destroy(of);
+    }
+}
 
 // INITIALIZE THE FILETABLE
 struct filetable *filetable_init() {
@@ -188,6 +189,15 @@ void filetable_destroy(struct filetable *ft) {
     // BE SURE THE FILETABLE ISN'T NULL
     KASSERT(ft != NULL);
 
+    // DROP THE REFERENCES TO THE OPEN FILES. NOBODY ELSE CAN BE USING THE
+    // FILETABLE, SO ITS LOCK ISN'T NEEDED
+    for (int i = 0; i < OPEN_MAX; i++) {
+        if (ft->entries[i] != NULL) {
+            openfile_decref(ft->entries[i]);
+            ft->entries[i] = NULL;
+        }
+    }
+
     // DELETE THE FILETABLE AND ITS LOCK
     lock_destroy(ft->lock);
     kfree(ft);
@@ -247,6 +257,9 @@ int filetable_add(struct filetable *ft, struct openfile *of, int fd, bool no_loc
     // BE SURE THE FILE DESCRIPTOR IS VALID AND THAT THE POSITION IS AVAILABLE
     int result = is_available(ft, fd);
     if (result) {
+        if (!no_lock) {
+            lock_release(ft->lock);
+        }
         return result;
     }
 
@@ -288,8 +301,10 @@ int filetable_add_generic(struct filetable *ft, struct openfile *of, int *fd, bo
             // SET THE FILE DESCRIPTOR
             *fd = i;
 
-            // RELEASE THE LOCK OF THE FILETABLE
-            lock_release(ft->lock);
+            // RELEASE THE LOCK OF THE FILETABLE IF no_lock IS FALSE
+            if (!no_lock) {
+                lock_release(ft->lock);
+            }
 
             return 0;
         }
@@ -392,13 +407,6 @@ int copy_filetable(struct filetable *old_ft, struct filetable **new_ft) {
     // BE SURE THE FILETABLE ISN'T NULL
     KASSERT(old_ft != NULL);
 
-    // ALLOCATE MEMORY FOR THE NEW FILETABLE
-    ft = kmalloc(sizeof(struct filetable));
-    if (ft == NULL) {
-        kprintf("copy_filetable: %s\n", strerror(ENOMEM));
-        return ENOMEM;
-    }
-
     // INITIALIZE THE NEW FILETABLE
     ft = filetable_init();
     if (ft == NULL) {
@@ -406,10 +414,13 @@ int copy_filetable(struct filetable *old_ft, struct filetable **new_ft) {
         return ENOMEM;
     }
 
-    // COPY THE FILETABLE
+    // COPY THE FILETABLE. EACH OPENFILE GETS ONE MORE REFERENCE, FROM THE NEW TABLE
     lock_acquire(old_ft->lock);
     for (int i = 0; i < OPEN_MAX; i++) {
         ft->entries[i] = old_ft->entries[i];
+        if (ft->entries[i] != NULL) {
+            openfile_incref(ft->entries[i]);
+        }
     }
     lock_release(old_ft->lock);
 
@@ -38,19 +38,24 @@
  * things they point to. Rearrange this (and/or change it to be a
  * regular lock) as needed.
  *
- * Unless you're implementing multithreaded user processes, the only
- * process that will have more than one thread is the kernel process.
+ * User processes can be multithreaded (see thread_create in
+ * proc_syscalls.c). The threads share the process's address space,
+ * which is refcounted: the process holds one reference and each
+ * additional thread holds another.
  */
 
 #include <types.h>
 #include <spl.h>
+#include <synch.h>
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
 #include <vnode.h>
 #include <filetable.h>
 #include <proc_table.h>
+#include <wchan.h>
 #include <copyinout.h>
+#include <kern/wait.h>
 
 /*
  * The process for the kernel; this holds all the kernel-only threads.
@@ -61,26 +66,42 @@ struct proc_table *ptable;
 //int counter = 0;
 
 /*
- * Create a proc structure.
+ * Free a proc structure, once nobody can have found it in the
+ * process table.
  */
 static
-struct proc *
-proc_create(const char *name)
+void
+proc_free(struct rcu_head *head)
+{
+	struct proc *proc = (struct proc *)head;
+
+	kfree(proc->p_name);
+	kfree(proc);
+}
+
+/*
+ * Create a proc structure. Fails with ENOMEM, or ENPROC if there
+ * are no pids left.
+ */
+static
+int
+proc_create(const char *name, struct proc **ret)
 {
 	struct proc *proc;
 
 	proc = kmalloc(sizeof(*proc));
 	if (proc == NULL) {
-		return NULL;
+		return ENOMEM;
 	}
 	proc->p_name = kstrdup(name);
 	if (proc->p_name == NULL) {
 		kfree(proc);
-		return NULL;
+		return ENOMEM;
 	}
 
 	proc->p_numthreads = 0;
 	spinlock_init(&proc->p_lock);
+	spinlock_setname(&proc->p_lock, "p_lock");
 
 	/* VM fields */
 	proc->p_addrspace = NULL;
@@ -88,19 +109,53 @@ proc_create(const char *name)
 	/* VFS fields */
 	proc->p_cwd = NULL;
 
+	/* User threads */
+	proc->p_uthreads = NULL;
+
+	/* Resource usage */
+	bzero(&proc->p_usage, sizeof(proc->p_usage));
+	bzero(&proc->p_cusage, sizeof(proc->p_cusage));
+	proc->p_waited = false;
+
+	/* Reaping */
+	proc->p_reaping = false;
+	proc->p_reapnext = NULL;
+
+	/* Children */
+	proc->p_nchildren = 0;
+	proc->p_children = NULL;
+	proc->p_sibnext = NULL;
+	proc->p_sibprev = NULL;
+	proc->p_exithead = NULL;
+	proc->p_exittail = NULL;
+	proc->p_exitnext = NULL;
+	proc->p_exitprev = NULL;
+	proc->p_onexitq = false;
+	proc->p_waitchan = wchan_create("waitpid");
+	if (proc->p_waitchan == NULL) {
+		kfree(proc->p_name);
+		kfree(proc);
+		return ENOMEM;
+	}
+
+	/* Not exited; set before the pid makes it visible */
+	proc->exit = 0;
+	proc->exit_status = false;
 
 	// CREATE FILETABLE
 	proc->p_filetable = filetable_init();
 	if (proc->p_filetable == NULL) {
+		wchan_destroy(proc->p_waitchan);
 		kfree(proc->p_name);
 		kfree(proc);
-		return NULL;
+		return ENOMEM;
 	}
 
-	ptable->process[ptable->next_pid] = proc;
 	if (strcmp(name,"[kernel]") == 0){
-		proc->p_pid = 1;
-		ptable->next_pid = 2;
+		// BOOTSTRAP: NO OTHER THREADS, AND TOO EARLY TO TAKE pt_lock
+		proc->p_pid = KPROC_PID;
+		proc->p_ppid = 0;
+		ptable->pt_chunks[0][KPROC_PID].ps_proc = proc;
 	}
 	else {
 	//proc->exit = 0;
@@ -109,24 +164,97 @@ proc_create(const char *name)
 	//  counter++;
 		int err = assign_pid(proc);
 		if (err!=0){
-			panic("shouldnt be here");
+			filetable_destroy(proc->p_filetable);
+			wchan_destroy(proc->p_waitchan);
+			kfree(proc->p_name);
+			kfree(proc);
+			return err;
 		}
-		
-		ptable->num_processes ++;
 	}
 	
-	proc->exit_status = false;
 	// //assign_pid(proc);
 	
 	
-	return proc;
+	*ret = proc;
+	return 0;
+}
+
+/*
+ * Add CHILD to, or take it off, PARENT's list of children not yet
+ * waited for. PARENT's p_lock must be held.
+ *
+ * Once PARENT has started to exit, its children have been (or are
+ * being) handed to the kernel process, and a new one would be left
+ * behind on the list; so linking fails with ESRCH, which is what
+ * fork and spawn in its other threads then get.
+ */
+static
+int
+proc_linkchild(struct proc *parent, struct proc *child)
+{
+	KASSERT(spinlock_do_i_hold(&parent->p_lock));
+
+	if (parent->exit_status) {
+		return ESRCH;
+	}
+
+	child->p_sibprev = NULL;
+	child->p_sibnext = parent->p_children;
+	if (parent->p_children != NULL) {
+		parent->p_children->p_sibprev = child;
+	}
+	parent->p_children = child;
+	parent->p_nchildren++;
+	return 0;
+}
+
+static
+void
+proc_unlinkchild(struct proc *parent, struct proc *child)
+{
+	KASSERT(spinlock_do_i_hold(&parent->p_lock));
+	KASSERT(parent->p_nchildren > 0);
+
+	if (child->p_sibprev != NULL) {
+		child->p_sibprev->p_sibnext = child->p_sibnext;
+	}
+	else {
+		KASSERT(parent->p_children == child);
+		parent->p_children = child->p_sibnext;
+	}
+	if (child->p_sibnext != NULL) {
+		child->p_sibnext->p_sibprev = child->p_sibprev;
+	}
+	child->p_sibnext = NULL;
+	child->p_sibprev = NULL;
+	parent->p_nchildren--;
+}
+
+/*
+ * Take a child that never ran (failed fork or spawn) back off our
+ * list. If an _exit in another of our threads has already given it
+ * to the kernel process, it isn't on the list any more; p_ppid says
+ * which, and is stable under our p_lock.
+ */
+static
+void
+proc_unlinknew(struct proc *child)
+{
+	if (curproc == kproc) {
+		return;
+	}
+	spinlock_acquire(&curproc->p_lock);
+	if (child->p_ppid == curproc->p_pid) {
+		proc_unlinkchild(curproc, child);
+	}
+	spinlock_release(&curproc->p_lock);
 }
 
 /*
  * Destroy a proc structure.
  *
- * Note: nothing currently calls this. Your wait/exit code will
- * probably want to do so.
+ * Processes that exit are destroyed by the reaper (see below); this
+ * is also used directly to clean up after a failed fork or spawn.
  */
 void
 proc_destroy(struct proc *proc)
@@ -154,6 +282,12 @@ proc_destroy(struct proc *proc)
 		proc->p_cwd = NULL;
 	}
 
+	/* Open files (dropping our references; see filetable.h) */
+	if (proc->p_filetable) {
+		filetable_destroy(proc->p_filetable);
+		proc->p_filetable = NULL;
+	}
+
 	/* VM fields */
 	if (proc->p_addrspace) {
 		/*
@@ -199,10 +333,26 @@ proc_destroy(struct proc *proc)
 			as = proc->p_addrspace;
 			proc->p_addrspace = NULL;
 		}
-		as_destroy(as);
+		as_decref(as);
+	}
+
+	/* User threads */
+	if (proc->p_uthreads) {
+		lock_destroy(proc->p_uthreads->ut_lock);
+		cv_destroy(proc->p_uthreads->ut_cv);
+		kfree(proc->p_uthreads);
+		proc->p_uthreads = NULL;
+	}
+
+	/* A child that never ran (failed fork or spawn) is one less. */
+	if (!proc->p_waited) {
+		proc_unlinknew(proc);
 	}
 
 	KASSERT(proc->p_numthreads == 0);
+	KASSERT(!proc->p_onexitq);
+	KASSERT(proc->p_children == NULL);
+	wchan_destroy(proc->p_waitchan);
 	spinlock_cleanup(&proc->p_lock);
 	int err = free_pid(proc);
 	if(err!=0){
@@ -210,9 +360,7 @@ proc_destroy(struct proc *proc)
 	}
 	proc->exit_status=true;
 	//proc->exit=1;
-	ptable->num_processes --;
-	kfree(proc->p_name);
-	kfree(proc);
+	call_rcu(&proc->p_rcu, proc_free);
 	//kfree(ptable->process[proc->p_pid]);
 }
 
@@ -232,8 +380,7 @@ proc_bootstrap(void)
 	kproc->exit_status = false; */
 	//-----------------------------------------
 	//kprintf("proc_bootstrap2\n");
-	kproc = proc_create("[kernel]");
-	if (kproc == NULL) {
+	if (proc_create("[kernel]", &kproc)) {
 		panic("proc_create for kproc failed\n");
 	}
 	//kprintf("proc_bootstrap3\n");
@@ -254,8 +401,7 @@ proc_create_runprogram(const char *name)
 	//kprintf("proc_create_runprogram\n");
 	struct proc *newproc;
 
-	newproc = proc_create(name);
-	if (newproc == NULL) {
+	if (proc_create_child(name, &newproc)) {
 		return NULL;
 	}
 
@@ -266,6 +412,26 @@ proc_create_runprogram(const char *name)
 		return NULL;
 	}
 
+	return newproc;
+}
+
+/*
+ * Create a fresh proc for a child of the current process. Like
+ * proc_create_runprogram, but the file table is left empty for the
+ * caller to fill in, and the error (ENOMEM, or ENPROC if the process
+ * table is full) is returned.
+ */
+int
+proc_create_child(const char *name, struct proc **ret)
+{
+	struct proc *newproc;
+	int result;
+
+	result = proc_create(name, &newproc);
+	if (result) {
+		return result;
+	}
+
 	/* VM fields */
 
 	newproc->p_addrspace = NULL;
@@ -296,7 +462,8 @@ proc_create_runprogram(const char *name)
 	//-----------------------------------------
 	//ptable->process[newproc->p_pid] = newproc;
 
-	return newproc;
+	*ret = newproc;
+	return 0;
 }
 
 
@@ -339,29 +506,171 @@ proc_addthread(struct proc *proc, struct thread *t)
 void
 proc_remthread(struct thread *t)
 {
+	struct usage u;
 	struct proc *proc;
+	bool reap;
 	int spl;
 
 	proc = t->t_proc;
 	KASSERT(proc != NULL);
 
+	/* A thread leaving its process leaves its usage behind. */
+	if (t == curthread) {
+		thread_takeusage(&u);
+	}
+	else {
+		bzero(&u, sizeof(u));
+	}
+
 	spinlock_acquire(&proc->p_lock);
+	usage_add(&proc->p_usage, &u);
 	KASSERT(proc->p_numthreads > 0);
 	proc->p_numthreads--;
+	reap = proc_reapable(proc);
 	spinlock_release(&proc->p_lock);
 
+	/* If we were the last thread of a dead process, it can go. */
+	if (reap) {
+		proc_reap(proc);
+	}
+
 	spl = splhigh();
 	t->t_proc = NULL;
 	splx(spl);
 }
 
+/*
+ * Resource usage. Each thread keeps its own counts (see thread.h);
+ * they're moved into the process's totals when the thread leaves,
+ * and whenever the thread wants the totals to be up to date. The
+ * process's other threads aren't interrupted to collect theirs, so
+ * what they've done since they last charged isn't included.
+ */
+void
+proc_chargeusage(void)
+{
+	struct usage u;
+
+	thread_takeusage(&u);
+	spinlock_acquire(&curproc->p_lock);
+	usage_add(&curproc->p_usage, &u);
+	spinlock_release(&curproc->p_lock);
+}
+
+void
+proc_getusage(struct proc *proc, bool children, struct usage *u)
+{
+	spinlock_acquire(&proc->p_lock);
+	*u = children ? proc->p_cusage : proc->p_usage;
+	spinlock_release(&proc->p_lock);
+}
+
+/*
+ * Reaping.
+ *
+ * An exited process stays around as a zombie until its parent has
+ * waited for it, so the exit status can be collected, and until its
+ * last thread has left it. Then it goes to the reaper, a kernel
+ * thread that destroys it (freeing its pid, address space, open
+ * files and memory). Destroying can sleep, so it can't be done in
+ * the exiting thread itself or in waitpid's lookup.
+ *
+ * A process whose parent exits is reparented to the kernel process,
+ * which never waits; such orphans are reaped as soon as they exit.
+ * So are processes started from the kernel menu.
+ */
+static struct spinlock reaper_lock = SPINLOCK_INITIALIZER;
+static struct wchan *reaper_wchan;
+static struct proc *reaper_queue;	/* Zombies to destroy */
+
+/*
+ * Check if PROC is ready to be reaped, and if so mark it so it's
+ * only reaped once. Call with PROC's p_lock held; if it returns
+ * true, call proc_reap after releasing it.
+ */
+bool
+proc_reapable(struct proc *proc)
+{
+	KASSERT(spinlock_do_i_hold(&proc->p_lock));
+
+	if (!proc->exit_status || proc->p_numthreads > 0 || proc->p_reaping) {
+		return false;
+	}
+	if (!proc->p_waited && proc->p_ppid != KPROC_PID) {
+		return false;
+	}
+	proc->p_reaping = true;
+	return true;
+}
+
+/*
+ * Hand PROC to the reaper.
+ */
+void
+proc_reap(struct proc *proc)
+{
+	KASSERT(proc->p_reaping);
+
+	spinlock_acquire(&reaper_lock);
+	proc->p_reapnext = reaper_queue;
+	reaper_queue = proc;
+	/* Before proc_reaper_bootstrap, just queue. */
+	if (reaper_wchan != NULL) {
+		wchan_wakeone(reaper_wchan, &reaper_lock);
+	}
+	spinlock_release(&reaper_lock);
+}
+
+static
+void
+reaper_thread(void *data1, unsigned long data2)
+{
+	struct proc *batch, *proc;
+
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		spinlock_acquire(&reaper_lock);
+		while (reaper_queue == NULL) {
+			wchan_sleep(reaper_wchan, &reaper_lock);
+		}
+		batch = reaper_queue;
+		reaper_queue = NULL;
+		spinlock_release(&reaper_lock);
+
+		while (batch != NULL) {
+			proc = batch;
+			batch = proc->p_reapnext;
+			proc_destroy(proc);
+		}
+	}
+}
+
+void
+proc_reaper_bootstrap(void)
+{
+	int result;
+
+	reaper_wchan = wchan_create("reaper");
+	if (reaper_wchan == NULL) {
+		panic("proc_reaper_bootstrap: Out of memory\n");
+	}
+
+	result = thread_fork("reaper", NULL, reaper_thread, NULL, 0);
+	if (result) {
+		panic("proc_reaper_bootstrap: thread_fork: %s\n",
+		      strerror(result));
+	}
+}
+
 /*
  * Fetch the address space of (the current) process.
  *
- * Caution: address spaces aren't refcounted. If you implement
- * multithreaded processes, make sure to set up a refcount scheme or
- * some other method to make this safe. Otherwise the returned address
- * space might disappear under you.
+ * Address spaces are refcounted. The process's own reference keeps
+ * this one alive as long as the process does, and each additional
+ * user thread holds a reference of its own, so it's safe for a thread
+ * of the process to use the result without taking another.
  */
 struct addrspace *
 proc_getas(void)
@@ -398,63 +707,385 @@ proc_setas(struct addrspace *newas)
 	return oldas;
 }
 
+/*
+ * Fetch the user thread table of PROC, creating it the first time the
+ * process starts a second thread. Until then there is only one thread
+ * in the process, which is the one calling, so creating it can't
+ * race. Returns NULL if out of memory.
+ */
+struct uthreads *
+proc_uthreads(struct proc *proc)
+{
+	struct uthreads *ut;
+	unsigned i;
+
+	if (proc->p_uthreads != NULL) {
+		return proc->p_uthreads;
+	}
+
+	ut = kmalloc(sizeof(*ut));
+	if (ut == NULL) {
+		return NULL;
+	}
+	ut->ut_lock = lock_create("uthreads");
+	if (ut->ut_lock == NULL) {
+		kfree(ut);
+		return NULL;
+	}
+	ut->ut_cv = cv_create("uthreads");
+	if (ut->ut_cv == NULL) {
+		lock_destroy(ut->ut_lock);
+		kfree(ut);
+		return NULL;
+	}
+	for (i=0; i<THREAD_MAX; i++) {
+		ut->ut_threads[i].ut_used = false;
+		ut->ut_threads[i].ut_exited = false;
+		ut->ut_threads[i].ut_joining = false;
+		ut->ut_threads[i].ut_status = 0;
+	}
+	/* the initial thread */
+	ut->ut_threads[0].ut_used = true;
+
+	proc->p_uthreads = ut;
+	return ut;
+}
+
+// MAKE THE EMPTY TABLE, WITH THE FIRST CHUNK SO THE KERNEL PROCESS HAS A SLOT
 void proc_table_create(void){
 
     ptable = kmalloc(sizeof(struct proc_table));
     if (ptable == NULL) {
         panic("Could not create process table\n");
     }
-    for (int i = 1; i <= MAX_PROC_NUM; i++) {
-        ptable->process[i] = NULL;
+    ptable->pt_lock = lock_create("ptable");
+    if (ptable->pt_lock == NULL) {
+        panic("Could not create process table lock\n");
+    }
+    for (int i = 0; i < PT_NCHUNKS; i++) {
+        ptable->pt_chunks[i] = NULL;
+    }
+    ptable->pt_chunks[0] = kmalloc(PT_CHUNK * sizeof(struct pt_slot));
+    if (ptable->pt_chunks[0] == NULL) {
+        panic("Could not create process table\n");
+    }
+    for (int i = 0; i < PT_CHUNK; i++) {
+        ptable->pt_chunks[0][i].ps_proc = NULL;
+        ptable->pt_chunks[0][i].ps_next = 0;
+    }
+    ptable->freehead = 0;
+    ptable->freetail = 0;
+    ptable->next_pid = PID_MIN;
+    ptable->num_processes = 0;
+}
+
+// THE SLOT FOR pid, OR NULL IF ITS CHUNK HASN'T BEEN ALLOCATED
+static
+struct pt_slot *
+pt_slot(pid_t pid)
+{
+    struct pt_slot *chunk;
+
+    chunk = rcu_dereference(ptable->pt_chunks[pid / PT_CHUNK]);
+    if (chunk == NULL) {
+        return NULL;
     }
-    //ptable->next_pid = 1;
-    //ptable->num_processes = 1;
+    return &chunk[pid % PT_CHUNK];
 }
 
+// GIVE proc THE OLDEST FREED PID, OR THE LOWEST NEVER-USED ONE IF NONE HAVE
+// BEEN FREED. ALLOCATES THE NEXT CHUNK WHEN next_pid REACHES IT. O(1).
+//
+// THE NEW PROCESS GOES ON curproc'S LIST OF CHILDREN FIRST, SO IT FAILS
+// BEFORE TAKING A PID IF curproc IS EXITING. p_ppid IS SET BEFORE IT'S LINKED
+// AND NOT TOUCHED AFTER, SINCE AN EXIT IN ANOTHER THREAD CAN REPARENT IT FROM
+// THEN ON.
 int assign_pid(struct proc *proc) {
-    if (ptable->num_processes == MAX_PROC_NUM) {
-		kprintf("Max number of processes reached\n");
-        return EMPROC;
+    struct pt_slot *slot;
+    pid_t pid;
+    int err;
+
+    proc->p_ppid = curproc->p_pid;
+
+    // THE KERNEL PROCESS NEVER WAITS, SO IT DOESN'T KEEP TRACK OF ITS CHILDREN
+    if (curproc != kproc) {
+        spinlock_acquire(&curproc->p_lock);
+        err = proc_linkchild(curproc, proc);
+        spinlock_release(&curproc->p_lock);
+        if (err) {
+            return err;
+        }
     }
-	//kprintf("assigning pid is %d\n",ptable->next_pid);
-	//struct proc *curproc = curproc;
-	//kprintf("current process is %d\n", curproc->p_pid);
-	proc->p_pid = ptable->next_pid;
-    proc ->p_ppid = curproc->p_pid;
-	for (int i=3; i <= MAX_PROC_NUM; i++){
-		//ptable->next_pid++;
-		if (ptable->process[i] == NULL){
-			ptable->next_pid = i;
-			//kprintf("next pid is %d\n", ptable->next_pid);
-			break;
-		}
-	}
-    //kprintf("pid assigned is %d\n", proc->p_pid); 
-    //ptable->num_processes ++;
+
+    lock_acquire(ptable->pt_lock);
+    if (ptable->freehead != 0) {
+        pid = ptable->freehead;
+        slot = pt_slot(pid);
+        ptable->freehead = slot->ps_next;
+        if (ptable->freehead == 0) {
+            ptable->freetail = 0;
+        }
+    }
+    else if (ptable->next_pid <= PID_MAX) {
+        pid = ptable->next_pid;
+        slot = pt_slot(pid);
+        if (slot == NULL) {
+            // FIRST PID OF A NEW CHUNK
+            struct pt_slot *chunk = kmalloc(PT_CHUNK * sizeof(struct pt_slot));
+            if (chunk == NULL) {
+                lock_release(ptable->pt_lock);
+                proc_unlinknew(proc);
+                return ENOMEM;
+            }
+            for (int i = 0; i < PT_CHUNK; i++) {
+                chunk[i].ps_proc = NULL;
+                chunk[i].ps_next = 0;
+            }
+            rcu_assign_pointer(ptable->pt_chunks[pid / PT_CHUNK], chunk);
+            slot = &chunk[pid % PT_CHUNK];
+        }
+        ptable->next_pid++;
+    }
+    else {
+        lock_release(ptable->pt_lock);
+        proc_unlinknew(proc);
+        return ENPROC;
+    }
+
+    // FILL IN THE PID BEFORE LOOKUPS CAN FIND IT
+    proc->p_pid = pid;
+
+    KASSERT(slot->ps_proc == NULL);
+    slot->ps_next = 0;
+    rcu_assign_pointer(slot->ps_proc, proc);
+    ptable->num_processes++;
+    lock_release(ptable->pt_lock);
     return 0; 
 }
 
+// PUT proc'S PID ON THE END OF THE FREE LIST
 int free_pid(struct proc *proc) {
-	validity_check_pid(proc->p_pid);
-    //ptable->num_processes --;
-    ptable->process[proc->p_pid] = NULL;
+    struct pt_slot *slot;
+    pid_t pid = proc->p_pid;
+
+    KASSERT(pid >= PID_MIN && pid <= PID_MAX);
+
+    lock_acquire(ptable->pt_lock);
+    slot = pt_slot(pid);
+    KASSERT(slot != NULL && slot->ps_proc == proc);
+    slot->ps_proc = NULL;
+    slot->ps_next = 0;
+    if (ptable->freetail != 0) {
+        pt_slot(ptable->freetail)->ps_next = pid;
+    }
+    else {
+        ptable->freehead = pid;
+    }
+    ptable->freetail = pid;
+    ptable->num_processes--;
+    lock_release(ptable->pt_lock);
     return 0; 
 }
 
+struct proc *proc_table_get(pid_t pid) {
+    struct pt_slot *slot;
+    struct proc *proc;
+
+    if (pid < 1 || pid > PID_MAX) {
+        return NULL;
+    }
+    slot = pt_slot(pid);
+    proc = (slot == NULL) ? NULL : rcu_dereference(slot->ps_proc);
+    return proc;
+}
+
+
+// THE QUEUE OF EXITED CHILDREN. CALL WITH parent'S p_lock HELD.
+static
+void
+exitq_append(struct proc *parent, struct proc *child)
+{
+    KASSERT(!child->p_onexitq);
+    child->p_exitnext = NULL;
+    child->p_exitprev = parent->p_exittail;
+    if (parent->p_exittail != NULL) {
+        parent->p_exittail->p_exitnext = child;
+    }
+    else {
+        parent->p_exithead = child;
+    }
+    parent->p_exittail = child;
+    child->p_onexitq = true;
+}
+
+static
+void
+exitq_remove(struct proc *parent, struct proc *child)
+{
+    KASSERT(child->p_onexitq);
+    if (child->p_exitprev != NULL) {
+        child->p_exitprev->p_exitnext = child->p_exitnext;
+    }
+    else {
+        parent->p_exithead = child->p_exitnext;
+    }
+    if (child->p_exitnext != NULL) {
+        child->p_exitnext->p_exitprev = child->p_exitprev;
+    }
+    else {
+        parent->p_exittail = child->p_exitprev;
+    }
+    child->p_exitnext = NULL;
+    child->p_exitprev = NULL;
+    child->p_onexitq = false;
+}
+
+// GIVE parent'S CHILDREN TO THE KERNEL PROCESS, WHICH NEVER WAITS, SO THEY'RE
+// REAPED WHEN THEY EXIT (OR NOW, IF THEY ALREADY HAVE). O(CHILDREN): THEY'RE
+// ALL ON OUR LIST, AND OUR p_lock AND EACH CHILD'S ORDER THIS AGAINST ITS
+// EXIT. THE EXITED ONES COME OFF OUR QUEUE.
+void proc_reparent_children(struct proc *parent) {
+    struct proc *child;
+    bool reap;
+
+    spinlock_acquire(&parent->p_lock);
+    while ((child = parent->p_children) != NULL) {
+        proc_unlinkchild(parent, child);
+        spinlock_acquire(&child->p_lock);
+        if (child->p_onexitq) {
+            exitq_remove(parent, child);
+        }
+        child->p_ppid = KPROC_PID;
+        reap = proc_reapable(child);
+        spinlock_release(&child->p_lock);
+        if (reap) {
+            proc_reap(child);
+        }
+    }
+    KASSERT(parent->p_nchildren == 0);
+    KASSERT(parent->p_exithead == NULL);
+    spinlock_release(&parent->p_lock);
+}
 
 int validity_check_pid(pid_t pid) {
-	if (pid < 1 || pid >= MAX_PROC_NUM) {
-		return ESRCH;
-	}
-	if (ptable->process[pid] == NULL) {
+	if (proc_table_get(pid) == NULL) {
 		return ESRCH;
 	}
 	return 0;
 }
 
-void wait_func(pid_t pid) {
-	// Check if the process is already exited
-	while (ptable->process[pid]->exit_status!=true)
-        thread_yield();
+// CALLED BY AN EXITING PROCESS ONCE ITS EXIT STATUS IS SET: QUEUE IT ON ITS
+// PARENT'S EXITED CHILDREN AND WAKE THE PARENT'S waitpid. p_ppid CAN CHANGE
+// UNDER US (OUR PARENT MAY BE EXITING TOO AND GIVING US TO THE KERNEL), SO
+// CHECK IT AGAIN WITH BOTH LOCKS HELD AND START OVER IF IT MOVED.
+void proc_exitnotify(void) {
+    struct proc *child = curproc;
+    struct proc *parent;
+    pid_t ppid;
+    bool done;
+
+    do {
+        rcu_read_lock();
+        ppid = child->p_ppid;
+        if (ppid == KPROC_PID) {
+            // NOBODY WILL WAIT; THE REAPER TAKES US WHEN WE'RE GONE
+            rcu_read_unlock();
+            return;
+        }
+        parent = proc_table_get(ppid);
+        done = false;
+        if (parent != NULL) {
+            spinlock_acquire(&parent->p_lock);
+            spinlock_acquire(&child->p_lock);
+            if (child->p_ppid == parent->p_pid) {
+                exitq_append(parent, child);
+                wchan_wakeall(parent->p_waitchan, &parent->p_lock);
+                done = true;
+            }
+            spinlock_release(&child->p_lock);
+            spinlock_release(&parent->p_lock);
+        }
+        rcu_read_unlock();
+    } while (!done);
+}
+
+// WAIT FOR A CHILD TO EXIT AND GET ITS PID AND EXIT CODE: CHILD pid, OR WITH
+// pid == -1 WHICHEVER EXITED FIRST. ESRCH IF THERE'S NO SUCH PROCESS (OR IT HAS
+// ALREADY BEEN WAITED FOR), ECHILD IF IT ISN'T OURS OR, FOR -1, IF WE HAVE NO
+// CHILDREN LEFT. WITH WNOHANG, *retpid IS 0 IF NOTHING HAS EXITED YET.
+//
+// A CHILD WE HAVEN'T WAITED FOR CAN'T BE REAPED (SEE proc_reapable), SO ONCE
+// IT'S BEEN CHECKED UNDER OUR LOCK IT CAN BE USED OUTSIDE THE READ SECTION.
+// TAKING ONE OFF THE QUEUE IS O(1).
+int wait_func(pid_t pid, int options, pid_t *retpid, int *exitcode) {
+    struct proc *parent = curproc;
+    struct proc *child;
+    struct usage u;
+    bool reap;
+
+    spinlock_acquire(&parent->p_lock);
+    while (1) {
+        if (pid == -1) {
+            child = parent->p_exithead;
+            if (child == NULL && parent->p_nchildren == 0) {
+                spinlock_release(&parent->p_lock);
+                return ECHILD;
+            }
+        }
+        else {
+            rcu_read_lock();
+            child = proc_table_get(pid);
+            if (child == NULL) {
+                rcu_read_unlock();
+                spinlock_release(&parent->p_lock);
+                return ESRCH;
+            }
+            if (child->p_ppid != parent->p_pid) {
+                rcu_read_unlock();
+                spinlock_release(&parent->p_lock);
+                return ECHILD;
+            }
+            if (child->p_waited) {
+                rcu_read_unlock();
+                spinlock_release(&parent->p_lock);
+                return ESRCH;
+            }
+            rcu_read_unlock();
+            if (!child->p_onexitq) {
+                child = NULL;
+            }
+        }
+        if (child != NULL) {
+            break;
+        }
+        if (options & WNOHANG) {
+            spinlock_release(&parent->p_lock);
+            *retpid = 0;
+            return 0;
+        }
+        wchan_sleep(parent->p_waitchan, &parent->p_lock);
+    }
+
+    // COLLECT IT. ITS USAGE (AND ITS CHILDREN'S) GOES INTO OURS, AND NOW THAT
+    // WE HAVE ITS STATUS IT CAN BE REAPED
+    exitq_remove(parent, child);
+    proc_unlinkchild(parent, child);
+
+    spinlock_acquire(&child->p_lock);
+    child->p_waited = true;
+    *retpid = child->p_pid;
+    *exitcode = child->exit;
+    u = child->p_usage;
+    usage_add(&u, &child->p_cusage);
+    reap = proc_reapable(child);
+    spinlock_release(&child->p_lock);
+
+    usage_add(&parent->p_cusage, &u);
+    spinlock_release(&parent->p_lock);
+
+    if (reap) {
+        proc_reap(child);
+    }
+    return 0;
 }
 
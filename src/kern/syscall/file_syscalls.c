@@ -16,6 +16,7 @@
 #include <stat.h>
 #include <vfs.h>
 #include <proc.h>
+#include <addrspace.h>
 
 // OPEN A FILE.
 // const char * LETS THE POINTER TO FILENAME TO BE MODIFIED, BUT NOT THE CONTENT OF THE STRING
@@ -77,6 +78,8 @@ int sys_open(const char *filename, int flags, int *retfd) {
     no_lock = false;
     result = filetable_add_generic(curproc->p_filetable, file, retfd, no_lock);
     if (result) {
+        // NOBODY ELSE HAS SEEN THE FILE, SO THIS CLOSES IT
+        openfile_decref(file);
         kprintf("sys_open: %s\n", strerror(result));
         return result;
     }
@@ -108,15 +111,16 @@ int sys_close(int fd) {
         return result;
     } 
 
-    // CLOSE THE FILE
-    vfs_close(file->vn);
-    
     // REMOVE THE FILE FROM THE FILETABLE
     filetable_remove(curproc->p_filetable, fd, no_lock);
 
     // RELEASE THE LOCK ON THE FILETABLE
     lock_release(curproc->p_filetable->lock);
 
+    // DROP THIS DESCRIPTOR'S REFERENCE. THE FILE IS ONLY REALLY CLOSED IF NO OTHER
+    // DESCRIPTOR (IN THIS PROCESS OR, AFTER fork(), IN ANOTHER ONE) STILL USES IT
+    openfile_decref(file);
+
     return 0;
 
 }
@@ -202,6 +206,9 @@ int sys_read(int fd, void *buf, size_t buflen, int *retval) {
     // IF ALL THE BYTES WERE READ, userio.uio_resid = 0 AND buflen - userio.uio_resid = buflen
     file->offset += (off_t) (buflen - userio.uio_resid);
 
+    // COUNT THE BYTES FOR getrusage()
+    curthread->t_usage.u_inbytes += buflen - userio.uio_resid;
+
     // UNLOCK THE FILE
     lock_release(file->lock);
 
@@ -284,6 +291,11 @@ int sys_write(int fd, const void *buf, size_t nbytes, int *retval) {
     // CALL VOP_WRITE.
     // THE ERROR MESSAGES ARE MANAGED BY VOP_WRITE()
     result = VOP_WRITE(file->vn, &userio);
+
+    // IF THE FILE IS A CACHED EXECUTABLE, THE CACHED COPY IS NOW WRONG. DO THIS
+    // EVEN ON ERROR, SINCE PART OF THE DATA MAY HAVE BEEN WRITTEN.
+    execcache_written(file->vn);
+
     if (result) {
         lock_release(file->lock);
         kprintf("sys_write: %s\n", strerror(result));
@@ -294,6 +306,9 @@ int sys_write(int fd, const void *buf, size_t nbytes, int *retval) {
     // IF ALL THE BYTES WERE WRITTEN, userio.uio_resid = 0 AND nbytes - userio.uio_resid = nbytes
     file->offset += (off_t) (nbytes - userio.uio_resid); 
 
+    // COUNT THE BYTES FOR getrusage()
+    curthread->t_usage.u_outbytes += nbytes - userio.uio_resid;
+
     // UNLOCK THE FILE
     lock_release(file->lock);
 
@@ -433,29 +448,32 @@ int sys_dup2(int oldfd, int newfd, int *retval) {
         return result;
     }
 
-    // CHECK IF newfd IS ALREADY IN USE. IF SO, CLOSE THE FILE AND FREE THE CORRESPONDING FILETABLE ENTRY.
+    // CHECK IF newfd IS ALREADY IN USE. IF SO, FREE THE CORRESPONDING FILETABLE ENTRY; ITS REFERENCE
+    // IS DROPPED (CLOSING THE FILE IF IT WAS THE LAST ONE) ONCE THE FILETABLE IS UNLOCKED.
     // IF result IS NOT 0, IT MEANS THAT newfd IS VALID BUT THE ENTRY IS IN USE.
     // NO FURTHER CHECKS ARE NEEDED ON THE OUTCOME OF filetable_get(), SINCE THE FILETABLE IS LOCKED AND 
     // newfd IS VALID AND FULL
+    temp_file = NULL;
     result = is_available(curproc->p_filetable, newfd);
     if (result) {
         // GET THE FILE FROM THE FILETABLE
         filetable_get(curproc->p_filetable, newfd, no_lock, &temp_file); 
 
-        // CLOSE THE FILE
-        vfs_close(temp_file->vn);
-        
         // REMOVE THE FILE FROM THE FILETABLE
         filetable_remove(curproc->p_filetable, newfd, no_lock);
     } 
 
-    // INCREASE THE REFERENCE COUNT OF THE struct vnode *vn FIELD OF THE OPENFILE STRUCT TO BE COPIED
-    VOP_INCREF(file->vn);
+    // newfd SHARES THE OPENFILE (AND SO THE OFFSET) WITH oldfd, SO IT TAKES A REFERENCE TO IT
+    openfile_incref(file);
 
     // COPY THE FILETABLE ENTRY FROM oldfd TO newfd
     result = filetable_add(curproc->p_filetable, file, newfd, no_lock);
     if (result) {
         lock_release(curproc->p_filetable->lock);
+        openfile_decref(file);
+        if (temp_file != NULL) {
+            openfile_decref(temp_file);
+        }
         kprintf("sys_dup2: %s\n", strerror(result));
         return result;
     }
@@ -463,6 +481,11 @@ int sys_dup2(int oldfd, int newfd, int *retval) {
     // UNLOCK THE FILETABLE
     lock_release(curproc->p_filetable->lock);
 
+    // DROP THE REFERENCE OF THE FILE THAT WAS AT newfd
+    if (temp_file != NULL) {
+        openfile_decref(temp_file);
+    }
+
     // UPDATE THE RETURNED VALUE
     *retval = newfd; 
 
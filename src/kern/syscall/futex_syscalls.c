@@ -0,0 +1,249 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Futexes: sleeping and waking on user memory words.
+ *
+ * User-level locks and condition variables (see <uthread.h> in
+ * userland) manipulate a word in user memory with atomic
+ * instructions, and only call into the kernel when they have to
+ * wait or have someone to wake. futex_wait sleeps if the word still
+ * holds the value the caller expects; futex_wake wakes threads
+ * sleeping on a word.
+ *
+ * Waiters are kept in a hash table keyed by (address space, user
+ * address). Each bucket has a sleep lock, so futex_wait can read the
+ * user word while holding it, and a CV everyone in the bucket sleeps
+ * on. Each waiter has a record on its own stack; futex_wake marks the
+ * ones it picks and broadcasts, and the rest go back to sleep.
+ * Collisions are rare enough that this is cheaper than keeping a wait
+ * channel per futex.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <clock.h>
+#include <synch.h>
+#include <addrspace.h>
+#include <proc.h>
+#include <copyinout.h>
+#include <syscall.h>
+
+/* Number of hash buckets; must be a power of 2. */
+#define FUTEX_NBUCKETS	64
+
+struct futex_waiter {
+	struct futex_waiter *fw_next;	/* Link in bucket */
+	struct addrspace *fw_as;	/* Key: address space... */
+	vaddr_t fw_addr;		/* ...and user address */
+	bool fw_woken;			/* Set by futex_wake */
+};
+
+struct futex_bucket {
+	struct lock *fb_lock;
+	struct cv *fb_cv;
+	struct futex_waiter *fb_waiters;
+};
+
+static struct futex_bucket futex_table[FUTEX_NBUCKETS];
+
+/*
+ * Set up the table. Called once during boot.
+ */
+void
+futex_bootstrap(void)
+{
+	unsigned i;
+
+	for (i=0; i<FUTEX_NBUCKETS; i++) {
+		futex_table[i].fb_lock = lock_create("futex");
+		futex_table[i].fb_cv = cv_create("futex");
+		if (futex_table[i].fb_lock == NULL ||
+		    futex_table[i].fb_cv == NULL) {
+			panic("futex_bootstrap: Out of memory\n");
+		}
+		futex_table[i].fb_waiters = NULL;
+	}
+}
+
+static
+struct futex_bucket *
+futex_bucket(struct addrspace *as, vaddr_t addr)
+{
+	uintptr_t hash;
+
+	hash = (uintptr_t)as / sizeof(void *) + addr / sizeof(int);
+	return &futex_table[hash & (FUTEX_NBUCKETS - 1)];
+}
+
+/*
+ * Remove waiter FW from bucket FB. Call with the bucket locked.
+ */
+static
+void
+futex_unlink(struct futex_bucket *fb, struct futex_waiter *fw)
+{
+	struct futex_waiter **fwp;
+
+	for (fwp = &fb->fb_waiters; *fwp != NULL; fwp = &(*fwp)->fw_next) {
+		if (*fwp == fw) {
+			*fwp = fw->fw_next;
+			return;
+		}
+	}
+	panic("futex_unlink: waiter not found\n");
+}
+
+/*
+ * If the int at USER_ADDR contains EXPECTED, sleep until woken by
+ * futex_wake on the same address. If USER_TIMEOUT is not NULL, give
+ * up after that long and return ETIMEDOUT. Returns EAGAIN without
+ * sleeping if the value has already changed.
+ */
+int
+sys_futex_wait(userptr_t user_addr, int expected, userptr_t user_timeout)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter fw, **fwp;
+	struct timespec ts;
+	unsigned deadline, now;
+	int value, result;
+
+	if ((vaddr_t)user_addr % sizeof(int) != 0) {
+		return EINVAL;
+	}
+
+	deadline = 0;
+	if (user_timeout != NULL) {
+		result = copyin(user_timeout, &ts, sizeof(ts));
+		if (result) {
+			return result;
+		}
+		if (ts.tv_sec < 0 || ts.tv_nsec < 0 ||
+		    ts.tv_nsec >= 1000000000) {
+			return EINVAL;
+		}
+		deadline = timeout_ticks() + timespec_to_ticks(&ts);
+	}
+
+	fw.fw_next = NULL;
+	fw.fw_as = proc_getas();
+	fw.fw_addr = (vaddr_t)user_addr;
+	fw.fw_woken = false;
+	fb = futex_bucket(fw.fw_as, fw.fw_addr);
+
+	/*
+	 * Check the value with the bucket locked; a futex_wake after
+	 * the value changes has to wait for the lock, so it can't be
+	 * missed.
+	 */
+	lock_acquire(fb->fb_lock);
+	result = copyin(user_addr, &value, sizeof(value));
+	if (result) {
+		lock_release(fb->fb_lock);
+		return result;
+	}
+	if (value != expected) {
+		lock_release(fb->fb_lock);
+		return EAGAIN;
+	}
+
+	/* Queue at the tail, so waiters are woken in FIFO order. */
+	for (fwp = &fb->fb_waiters; *fwp != NULL; fwp = &(*fwp)->fw_next) {
+		/* nothing */
+	}
+	*fwp = &fw;
+
+	while (!fw.fw_woken) {
+		if (user_timeout == NULL) {
+			cv_wait(fb->fb_cv, fb->fb_lock);
+			continue;
+		}
+		now = timeout_ticks();
+		if ((int)(deadline - now) <= 0) {
+			result = ETIMEDOUT;
+			break;
+		}
+		(void)cv_wait_timeout(fb->fb_cv, fb->fb_lock, deadline - now);
+	}
+
+	/* futex_wake unlinks the waiters it wakes. */
+	if (!fw.fw_woken) {
+		futex_unlink(fb, &fw);
+	}
+	lock_release(fb->fb_lock);
+
+	return result;
+}
+
+/*
+ * Wake up to COUNT threads sleeping in futex_wait on USER_ADDR.
+ * Returns the number woken.
+ */
+int
+sys_futex_wake(userptr_t user_addr, int count, int32_t *retval)
+{
+	struct futex_bucket *fb;
+	struct futex_waiter **fwp, *fw;
+	struct addrspace *as;
+	vaddr_t addr;
+	int woken;
+
+	addr = (vaddr_t)user_addr;
+	if (addr % sizeof(int) != 0 || count < 0) {
+		return EINVAL;
+	}
+
+	as = proc_getas();
+	fb = futex_bucket(as, addr);
+	woken = 0;
+
+	lock_acquire(fb->fb_lock);
+	fwp = &fb->fb_waiters;
+	while (*fwp != NULL && woken < count) {
+		fw = *fwp;
+		if (fw->fw_as == as && fw->fw_addr == addr) {
+			*fwp = fw->fw_next;
+			fw->fw_woken = true;
+			woken++;
+		}
+		else {
+			fwp = &fw->fw_next;
+		}
+	}
+	if (woken > 0) {
+		cv_broadcast(fb->fb_cv, fb->fb_lock);
+	}
+	lock_release(fb->fb_lock);
+
+	*retval = woken;
+	return 0;
+}
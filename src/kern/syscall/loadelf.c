@@ -57,6 +57,7 @@
 #include <proc.h>
 #include <current.h>
 #include <addrspace.h>
+#include <spinlock.h>
 #include <vnode.h>
 #include <elf.h>
 
@@ -146,21 +147,262 @@ load_segment(struct addrspace *as, struct vnode *v,
 }
 
 /*
- * Load an ELF executable user program into the current address space.
+ * Executable image cache.
  *
- * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ * Parsing an executable means reading and checking its header and
+ * program headers; loading it means reading every segment. Programs
+ * tend to be run over and over (by the shell, by process farms), so
+ * the parsed headers of the last few executables are kept here,
+ * keyed by vnode, along with the file contents of their read-only
+ * (text) segments up to a total of EXECCACHE_TEXTMAX bytes. Writable
+ * segments are always read from the file.
+ *
+ * Each cached image holds a reference to its vnode, so the vnode
+ * pointer stays a valid key. Writing to or truncating a file throws
+ * its image out (execcache_written). An image goes in the cache
+ * before it's filled in, and only becomes ready (usable by others)
+ * afterwards; if it's thrown out in between it never does. Anyone
+ * else wanting the same program meanwhile reads it for themselves.
+ *
+ * Images are refcounted: the cache holds one reference, and each
+ * load_elf in progress another, so an image can be thrown out while
+ * it's being loaded from.
+ */
+
+#define EXECCACHE_SIZE		8		/* Images kept at once */
+#define EXECCACHE_TEXTMAX	(256*1024)	/* Bytes of text kept */
+
+struct execseg {
+	off_t es_offset;		/* Where it is in the file */
+	vaddr_t es_vaddr;		/* Where it goes in memory */
+	size_t es_memsize;
+	size_t es_filesize;
+	uint32_t es_flags;		/* PF_R, PF_W, PF_X */
+	char *es_text;			/* File contents, or NULL */
+};
+
+struct execimage {
+	struct vnode *ei_vn;		/* The executable (referenced) */
+	unsigned ei_refcount;
+	bool ei_cached;			/* Went in the cache */
+	bool ei_ready;			/* Filled in; others may use it */
+	bool ei_stale;			/* Thrown out before it was ready */
+	unsigned ei_lastuse;		/* For LRU replacement */
+	vaddr_t ei_entry;		/* Entry point */
+	unsigned ei_nsegs;
+	struct execseg *ei_segs;	/* The PT_LOAD segments */
+	size_t ei_textbytes;		/* Bytes of text held */
+};
+
+static struct spinlock execcache_lock = SPINLOCK_INITIALIZER;
+static struct execimage *execcache[EXECCACHE_SIZE];
+static size_t execcache_textbytes;
+static unsigned execcache_clock;
+
+static
+void
+execimage_destroy(struct execimage *img)
+{
+	unsigned i;
+
+	KASSERT(img->ei_refcount == 0);
+
+	spinlock_acquire(&execcache_lock);
+	execcache_textbytes -= img->ei_textbytes;
+	spinlock_release(&execcache_lock);
+
+	for (i=0; i<img->ei_nsegs; i++) {
+		if (img->ei_segs[i].es_text != NULL) {
+			kfree(img->ei_segs[i].es_text);
+		}
+	}
+	if (img->ei_segs != NULL) {
+		kfree(img->ei_segs);
+	}
+	VOP_DECREF(img->ei_vn);
+	kfree(img);
+}
+
+static
+void
+execimage_release(struct execimage *img)
+{
+	bool last;
+
+	spinlock_acquire(&execcache_lock);
+	KASSERT(img->ei_refcount > 0);
+	img->ei_refcount--;
+	last = (img->ei_refcount == 0);
+	spinlock_release(&execcache_lock);
+
+	if (last) {
+		execimage_destroy(img);
+	}
+}
+
+/*
+ * Return the index of V's image in the cache, or -1. Call with the
+ * cache locked.
  */
+static
 int
-load_elf(struct vnode *v, vaddr_t *entrypoint)
+execcache_find(struct vnode *v)
+{
+	unsigned i;
+
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		if (execcache[i] != NULL && execcache[i]->ei_vn == v) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Get an image for V. If a ready one is cached, return it with
+ * *ISNEW false. Otherwise return a new empty one with *ISNEW true,
+ * for the caller to fill in; it goes in the cache (replacing the
+ * least recently used ready image if need be) unless the cache is
+ * busy with V or with filling other images. Either way the caller
+ * gets a reference. Returns NULL if out of memory.
+ */
+static
+struct execimage *
+execcache_get(struct vnode *v, bool *isnew)
+{
+	struct execimage *img, *victim;
+	unsigned i;
+	int slot;
+
+	spinlock_acquire(&execcache_lock);
+	slot = execcache_find(v);
+	if (slot >= 0 && execcache[slot]->ei_ready) {
+		img = execcache[slot];
+		img->ei_refcount++;
+		img->ei_lastuse = ++execcache_clock;
+		spinlock_release(&execcache_lock);
+		*isnew = false;
+		return img;
+	}
+	spinlock_release(&execcache_lock);
+
+	img = kmalloc(sizeof(*img));
+	if (img == NULL) {
+		return NULL;
+	}
+	VOP_INCREF(v);
+	img->ei_vn = v;
+	img->ei_refcount = 1;
+	img->ei_cached = false;
+	img->ei_ready = false;
+	img->ei_stale = false;
+	img->ei_lastuse = 0;
+	img->ei_entry = 0;
+	img->ei_nsegs = 0;
+	img->ei_segs = NULL;
+	img->ei_textbytes = 0;
+	*isnew = true;
+
+	/* Look again; someone may have cached it meanwhile. */
+	victim = NULL;
+	spinlock_acquire(&execcache_lock);
+	if (execcache_find(v) < 0) {
+		slot = -1;
+		for (i=0; i<EXECCACHE_SIZE; i++) {
+			if (execcache[i] == NULL) {
+				slot = i;
+				break;
+			}
+			if (execcache[i]->ei_ready &&
+			    (slot < 0 || execcache[i]->ei_lastuse <
+			     execcache[slot]->ei_lastuse)) {
+				slot = i;
+			}
+		}
+		if (slot >= 0) {
+			victim = execcache[slot];
+			execcache[slot] = img;
+			img->ei_refcount++;
+			img->ei_cached = true;
+			img->ei_lastuse = ++execcache_clock;
+		}
+	}
+	spinlock_release(&execcache_lock);
+
+	if (victim != NULL) {
+		execimage_release(victim);
+	}
+	return img;
+}
+
+/*
+ * Throw out the cached image of V, if any, because V was written to
+ * or truncated. Must be called after the change is made, so that an
+ * image filled in from before the change can't outlive this.
+ */
+void
+execcache_written(struct vnode *v)
+{
+	struct execimage *img;
+	int slot;
+
+	img = NULL;
+	spinlock_acquire(&execcache_lock);
+	slot = execcache_find(v);
+	if (slot >= 0) {
+		img = execcache[slot];
+		execcache[slot] = NULL;
+		img->ei_stale = true;
+	}
+	spinlock_release(&execcache_lock);
+
+	if (img != NULL) {
+		execimage_release(img);
+	}
+}
+
+/*
+ * Empty the cache, dropping its vnode references so file systems can
+ * be unmounted.
+ */
+void
+execcache_flush(void)
+{
+	struct execimage *imgs[EXECCACHE_SIZE];
+	unsigned i;
+
+	spinlock_acquire(&execcache_lock);
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		imgs[i] = execcache[i];
+		execcache[i] = NULL;
+		if (imgs[i] != NULL) {
+			imgs[i]->ei_stale = true;
+		}
+	}
+	spinlock_release(&execcache_lock);
+
+	for (i=0; i<EXECCACHE_SIZE; i++) {
+		if (imgs[i] != NULL) {
+			execimage_release(imgs[i]);
+		}
+	}
+}
+
+/*
+ * Read and check the executable header and program headers of IMG's
+ * file, and record its loadable segments.
+ */
+static
+int
+execimage_parse(struct execimage *img)
 {
 	Elf_Ehdr eh;   /* Executable header */
 	Elf_Phdr ph;   /* "Program header" = segment header */
+	struct execseg *es;
 	int result, i;
 	struct iovec iov;
 	struct uio ku;
-	struct addrspace *as;
-
-	as = proc_getas();
+	struct vnode *v = img->ei_vn;
 
 	/*
 	 * Read the executable header from offset 0 in the file.
@@ -203,7 +445,8 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	}
 
 	/*
-	 * Go through the list of segments and set up the address space.
+	 * Go through the list of segments and remember the ones to
+	 * load.
 	 *
 	 * Ordinarily there will be one code segment, one read-only
 	 * data segment, and one data/bss segment, but there might
@@ -217,6 +460,13 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 	 * to find where the phdr starts.
 	 */
 
+	if (eh.e_phnum > 0) {
+		img->ei_segs = kmalloc(eh.e_phnum * sizeof(*img->ei_segs));
+		if (img->ei_segs == NULL) {
+			return ENOMEM;
+		}
+	}
+
 	for (i=0; i<eh.e_phnum; i++) {
 		off_t offset = eh.e_phoff + i*eh.e_phentsize;
 		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
@@ -243,65 +493,209 @@ load_elf(struct vnode *v, vaddr_t *entrypoint)
 			return ENOEXEC;
 		}
 
-		result = as_define_region(as,
-					  ph.p_vaddr, ph.p_memsz,
-					  ph.p_flags & PF_R,
-					  ph.p_flags & PF_W,
-					  ph.p_flags & PF_X);
+		if (ph.p_filesz > ph.p_memsz) {
+			kprintf("ELF: warning: segment filesize > segment "
+				"memsize\n");
+			ph.p_filesz = ph.p_memsz;
+		}
+
+		es = &img->ei_segs[img->ei_nsegs++];
+		es->es_offset = ph.p_offset;
+		es->es_vaddr = ph.p_vaddr;
+		es->es_memsize = ph.p_memsz;
+		es->es_filesize = ph.p_filesz;
+		es->es_flags = ph.p_flags;
+		es->es_text = NULL;
+	}
+
+	img->ei_entry = eh.e_entry;
+	return 0;
+}
+
+/*
+ * Give back LEN bytes of text budget reserved for IMG that went
+ * unused after all.
+ */
+static
+void
+execimage_unreserve(struct execimage *img, size_t len)
+{
+	spinlock_acquire(&execcache_lock);
+	KASSERT(img->ei_textbytes >= len);
+	img->ei_textbytes -= len;
+	execcache_textbytes -= len;
+	spinlock_release(&execcache_lock);
+}
+
+/*
+ * Read the read-only segments of a cached image into memory, as far
+ * as the budget allows. Failing to is not an error; those segments
+ * just get read from the file each time.
+ */
+static
+void
+execimage_readtext(struct execimage *img)
+{
+	struct execseg *es;
+	struct iovec iov;
+	struct uio ku;
+	unsigned i;
+	bool fits;
+	char *text;
+	int result;
+
+	for (i=0; i<img->ei_nsegs; i++) {
+		es = &img->ei_segs[i];
+		if ((es->es_flags & PF_W) || es->es_filesize == 0) {
+			continue;
+		}
+
+		spinlock_acquire(&execcache_lock);
+		fits = execcache_textbytes + es->es_filesize <=
+			EXECCACHE_TEXTMAX;
+		if (fits) {
+			execcache_textbytes += es->es_filesize;
+			img->ei_textbytes += es->es_filesize;
+		}
+		spinlock_release(&execcache_lock);
+		if (!fits) {
+			continue;
+		}
+
+		text = kmalloc(es->es_filesize);
+		if (text == NULL) {
+			execimage_unreserve(img, es->es_filesize);
+			continue;
+		}
+		uio_kinit(&iov, &ku, text, es->es_filesize, es->es_offset,
+			  UIO_READ);
+		result = VOP_READ(img->ei_vn, &ku);
+		if (result || ku.uio_resid != 0) {
+			kfree(text);
+			execimage_unreserve(img, es->es_filesize);
+			continue;
+		}
+		es->es_text = text;
+	}
+}
+
+/*
+ * Copy a segment's file contents from the cache into place.
+ */
+static
+int
+load_cached_segment(struct addrspace *as, const struct execseg *es)
+{
+	struct iovec iov;
+	struct uio u;
+
+	DEBUG(DB_EXEC, "ELF: Copying %lu cached bytes to 0x%lx\n",
+	      (unsigned long) es->es_filesize, (unsigned long) es->es_vaddr);
+
+	iov.iov_ubase = (userptr_t)es->es_vaddr;
+	iov.iov_len = es->es_filesize;
+	u.uio_iov = &iov;
+	u.uio_iovcnt = 1;
+	u.uio_resid = es->es_filesize;
+	u.uio_offset = 0;
+	u.uio_segflg = (es->es_flags & PF_X) ? UIO_USERISPACE : UIO_USERSPACE;
+	u.uio_rw = UIO_READ;
+	u.uio_space = as;
+
+	return uiomove(es->es_text, es->es_filesize, &u);
+}
+
+/*
+ * Load an ELF executable user program into the current address space.
+ *
+ * Returns the entry point (initial PC) for the program in ENTRYPOINT.
+ */
+int
+load_elf(struct vnode *v, vaddr_t *entrypoint)
+{
+	struct execimage *img;
+	struct execseg *es;
+	struct addrspace *as;
+	unsigned i;
+	bool isnew;
+	int result;
+
+	as = proc_getas();
+
+	img = execcache_get(v, &isnew);
+	if (img == NULL) {
+		return ENOMEM;
+	}
+
+	if (isnew) {
+		result = execimage_parse(img);
 		if (result) {
+			/* Don't leave a bad image in the cache. */
+			if (img->ei_cached) {
+				execcache_written(v);
+			}
+			execimage_release(img);
 			return result;
 		}
+		if (img->ei_cached) {
+			execimage_readtext(img);
+			spinlock_acquire(&execcache_lock);
+			if (!img->ei_stale) {
+				img->ei_ready = true;
+			}
+			spinlock_release(&execcache_lock);
+		}
+	}
+
+	/*
+	 * Set up the address space.
+	 */
+
+	for (i=0; i<img->ei_nsegs; i++) {
+		es = &img->ei_segs[i];
+		result = as_define_region(as,
+					  es->es_vaddr, es->es_memsize,
+					  es->es_flags & PF_R,
+					  es->es_flags & PF_W,
+					  es->es_flags & PF_X);
+		if (result) {
+			goto out;
+		}
 	}
 
 	result = as_prepare_load(as);
 	if (result) {
-		return result;
+		goto out;
 	}
 
 	/*
 	 * Now actually load each segment.
 	 */
 
-	for (i=0; i<eh.e_phnum; i++) {
-		off_t offset = eh.e_phoff + i*eh.e_phentsize;
-		uio_kinit(&iov, &ku, &ph, sizeof(ph), offset, UIO_READ);
-
-		result = VOP_READ(v, &ku);
-		if (result) {
-			return result;
-		}
-
-		if (ku.uio_resid != 0) {
-			/* short read; problem with executable? */
-			kprintf("ELF: short read on phdr - file truncated?\n");
-			return ENOEXEC;
+	for (i=0; i<img->ei_nsegs; i++) {
+		es = &img->ei_segs[i];
+		if (es->es_text != NULL) {
+			result = load_cached_segment(as, es);
 		}
-
-		switch (ph.p_type) {
-		    case PT_NULL: /* skip */ continue;
-		    case PT_PHDR: /* skip */ continue;
-		    case PT_MIPS_REGINFO: /* skip */ continue;
-		    case PT_LOAD: break;
-		    default:
-			kprintf("loadelf: unknown segment type %d\n",
-				ph.p_type);
-			return ENOEXEC;
+		else {
+			result = load_segment(as, v, es->es_offset,
+					      es->es_vaddr, es->es_memsize,
+					      es->es_filesize,
+					      es->es_flags & PF_X);
 		}
-
-		result = load_segment(as, v, ph.p_offset, ph.p_vaddr,
-				      ph.p_memsz, ph.p_filesz,
-				      ph.p_flags & PF_X);
 		if (result) {
-			return result;
+			goto out;
 		}
 	}
 
 	result = as_complete_load(as);
 	if (result) {
-		return result;
+		goto out;
 	}
 
-	*entrypoint = eh.e_entry;
+	*entrypoint = img->ei_entry;
 
-	return 0;
+ out:
+	execimage_release(img);
+	return result;
 }
@@ -14,7 +14,13 @@
 #include <synch.h>
 #include <kern/fcntl.h>
 #include <vfs.h>
+#include <vnode.h>
+#include <stat.h>
+#include <limits.h>
+#include <kern/spawn.h>
 #include <copyinout.h>
+#include <kern/time.h>
+#include <kern/resource.h>
 
 //---------------- process system call------------------------
 void
@@ -27,7 +33,7 @@ setup_fork_trapframe(struct trapframe *old_tf, struct trapframe **new_tf);
 
 int sys_getpid(pid_t *retval) {
     //*retval = curproc->p_pid;
-    *retval = ptable->process[curproc->p_pid]->p_pid;
+    *retval = curproc->p_pid;
     return 0;
 }
 
@@ -69,7 +75,6 @@ int sys_fork(struct trapframe *tf, int32_t *retval)
     int err;
     struct proc *child_proc;
 
-    child_proc = kmalloc(sizeof(*child_proc));
     struct trapframe *child_tf;
     //struct addrspace *child_addrs;
     /* child_tf = kmalloc(sizeof(child_tf));
@@ -78,23 +83,30 @@ int sys_fork(struct trapframe *tf, int32_t *retval)
     } */
     
     /* memcpy(child_tf, tf, sizeof(tf)); */
-    child_proc = proc_create_runprogram(curproc->p_name);
-    if (child_proc == NULL) {
-        return ENOMEM;
+    // ENPROC IF THE PROCESS TABLE IS FULL
+    err = proc_create_child(curproc->p_name, &child_proc);
+    if (err) {
+        return err;
     }
     
     //create a new address space for the child process and copy the parent's address space
     err = as_copy(curproc->p_addrspace, &child_proc->p_addrspace); 
     if (err) {
+        proc_destroy(child_proc);
         return err;
     }
     //child_addrs = child_proc->p_addrspace;
 
     
-    struct filetable *child_ft = curproc->p_filetable;
-	lock_acquire(child_ft->lock);
-	copy_filetable(curproc->p_filetable, &(child_proc->p_filetable)); // copy the file table
-	lock_release(child_ft->lock);
+    // THE CHILD SHARES THE PARENT'S OPEN FILES.
+    // copy_filetable takes the parent's filetable lock itself
+    filetable_destroy(child_proc->p_filetable);
+    child_proc->p_filetable = NULL;
+	err = copy_filetable(curproc->p_filetable, &(child_proc->p_filetable)); // copy the file table
+    if (err) {
+        proc_destroy(child_proc);
+        return err;
+    }
 
 
     spinlock_acquire(&curproc->p_lock);  // copy the current working directory
@@ -109,8 +121,8 @@ int sys_fork(struct trapframe *tf, int32_t *retval)
     err = thread_fork("new_thread", child_proc, enter_usermode,child_tf,1);
     // kprintf("err is %d\n", err);
     if (err) {
+        // proc_destroy FREES THE PID TOO
         proc_destroy(child_proc);
-        free_pid(child_proc);
         kfree(child_tf);
         return err;
     }
@@ -125,74 +137,322 @@ int sys_fork(struct trapframe *tf, int32_t *retval)
 
 //------------------------------Exit---------------------------------
 
+// A THREAD MADE BY thread_fork IS LEAVING, BY thread_exit OR _exit: LEAVE ITS
+// STATUS FOR thread_join AND DROP ITS HOLD ON THE ADDRESS SPACE. THE PROCESS
+// STILL HOLDS ITS OWN REFERENCE, SO THIS ISN'T THE LAST ONE
+static
+void
+uthread_finish(int status)
+{
+    struct uthreads *ut = curproc->p_uthreads;
+    unsigned tid = curthread->t_tid;
+
+    KASSERT(ut != NULL && tid != 0);
+
+    lock_acquire(ut->ut_lock);
+    KASSERT(ut->ut_threads[tid].ut_used);
+    ut->ut_threads[tid].ut_status = status;
+    ut->ut_threads[tid].ut_exited = true;
+    cv_broadcast(ut->ut_cv, ut->ut_lock);
+    lock_release(ut->ut_lock);
+
+    as_decref(proc_getas());
+}
 
 void
 sys_exit (int status)
 {
+    struct filetable *ft;
+    bool last, first;
+
     KASSERT (curproc != NULL);
-    ptable->process[curproc->p_pid]->exit = status;
-    ptable->process[curproc->p_pid]->exit_status = true;
+
+    // ONLY THE FIRST THREAD TO CALL _exit SETS THE STATUS AND TELLS OUR PARENT;
+    // ANY LATER ONE JUST GOES. waitpid LOOKS AT exit ONLY ONCE WE'RE ON ITS
+    // QUEUE, SO IT CAN BE SET HERE, UNDER THE LOCK
+    spinlock_acquire(&curproc->p_lock);
+    first = !curproc->exit_status;
+    if (first) {
+        // KEPT IN THE FORM waitpid HANDS BACK, FOR WIFEXITED/WEXITSTATUS
+        curproc->exit = _MKWAIT_EXIT(status);
+        curproc->exit_status = true;
+    }
+    // CLOSE OUR FILES NOW, SO A PARENT SHARING THEM SEES THE LAST CLOSE WHEN IT
+    // CLOSES ITS COPY. IF OTHER THREADS OF THE PROCESS ARE STILL RUNNING THEY MAY
+    // BE USING THE FILETABLE, SO THEN IT'S LEFT FOR proc_destroy
+    last = curproc->p_numthreads == 1;
+    spinlock_release(&curproc->p_lock);
+    if (last && curproc->p_filetable != NULL) {
+        ft = curproc->p_filetable;
+        curproc->p_filetable = NULL;
+        filetable_destroy(ft);
+    }
+
+    if (first) {
+        // OUR USAGE HAS TO BE IN p_usage BEFORE THE PARENT CAN SEE WE EXITED
+        proc_chargeusage();
+
+        // NOBODY WILL WAIT FOR OUR CHILDREN NOW; THE REAPER TAKES THEM
+        proc_reparent_children(curproc);
+
+        // TELL OUR PARENT, IF IT'S WAITING
+        proc_exitnotify();
+    }
+
+    // ANY THREAD BUT THE FIRST IS ALSO DONE AS FAR AS thread_join IS CONCERNED
+    if (curthread->t_tid != 0 && curproc->p_uthreads != NULL) {
+        uthread_finish(status);
+    }
+
+    // THE LAST THREAD TO LEAVE HANDS THE PROCESS TO THE REAPER (SEE proc.c)
     thread_exit();
-    proc_destroy(curproc);
-    
+
 }
 
 //------------------------------waitpid---------------------------------
 int 
 sys_waitpid(pid_t pid,const struct __userptr * status,int32_t *retval, int32_t options) {
-    
 
-    // Check if the provided PID is valid
-    int err = validity_check_pid(pid);
-    if (err != 0) {
-        
+    // WNOHANG IS THE ONLY OPTION WE KNOW
+    if ((options & ~WNOHANG) != 0) {
         *retval = -1;
-        return err;
+        return EINVAL;
     }
-    
-    // Check if the options are valid
-    if (options != 0) {
-                *retval = -1;
+
+    // -1 MEANS ANY CHILD; PROCESS GROUPS (0, < -1) AREN'T SUPPORTED
+    if (pid != -1 && pid <= 0) {
+        *retval = -1;
         return EINVAL;
     }
-    
-    // Check if the status pointer is valid
-    /* if (status == NULL) {
+
+    pid_t child;
+    int exitcode;
+    int err = wait_func(pid, options, &child, &exitcode);
+    if (err != 0) {
         *retval = -1;
-        return EFAULT;
-    } */
-    
+        return err;
+    }
 
-    // Acquire the process lock to access the process table
-    //spinlock_acquire(&proc_table[proc_table[pid]->ppid]->p_lock);
-    
-    wait_func(pid);
-    
-    *retval = ptable->process[pid]->p_pid;
-    //spinlock_release(&proc_table[proc_table[pid]->ppid]->p_lock);
-
-    // Copy the exit status
-    int ret = copyout(&ptable->process[pid]->exit, (userptr_t) status, sizeof(int32_t));
-		if (ret){
-			return ret;
-		}
-    // Return the PID of the terminated child process
+    // WITH WNOHANG AND NOTHING EXITED YET THERE'S NO STATUS TO COPY OUT
+    if (child != 0 && status != NULL) {
+        err = copyout(&exitcode, (userptr_t) status, sizeof(int32_t));
+        if (err) {
+            *retval = -1;
+            return err;
+        }
+    }
+
+    // RETURN THE PID OF THE CHILD WE COLLECTED
+    *retval = child;
     return 0;
 }
 
 
+//------------------------------GETRUSAGE---------------------------------
+
+static
+void
+ns_to_timeval(uint64_t ns, struct timeval *tv)
+{
+    tv->tv_sec = ns / 1000000000;
+    tv->tv_usec = (ns % 1000000000) / 1000;
+}
+
+// getrusage(who, usage): OUR OWN USAGE (RUSAGE_SELF) OR THE TOTAL OF THE
+// CHILDREN WE HAVE WAITED FOR (RUSAGE_CHILDREN). TIMES ARE ONLY COUNTED ONCE
+// THE CLOCK IS UP, AND TIME SPENT IN SYSTEM CALLS IS SYSTEM TIME; ALL THE REST
+// OF THE RUN TIME (FAULTS AND INTERRUPTS TOO) IS USER TIME. WITH NO DISK CACHE
+// EVERY BYTE READ OR WRITTEN IS I/O, SO THE BLOCK COUNTS ARE THE BYTE COUNTS
+// IN 512-BYTE BLOCKS, ROUNDED UP.
+int
+sys_getrusage(int who, userptr_t uusage)
+{
+    struct rusage ru;
+    struct usage u;
+
+    switch (who) {
+        case RUSAGE_SELF:
+            // BRING OUR OWN THREAD'S COUNTS UP TO DATE FIRST
+            proc_chargeusage();
+            proc_getusage(curproc, false, &u);
+            break;
+        case RUSAGE_CHILDREN:
+            proc_getusage(curproc, true, &u);
+            break;
+        default:
+            return EINVAL;
+    }
+
+    // SYSTEM TIME CAN ONLY BE AHEAD IF TIMING STARTED DURING A SYSTEM CALL
+    if (u.u_systime > u.u_runtime) {
+        u.u_systime = u.u_runtime;
+    }
+
+    bzero(&ru, sizeof(ru));
+    ns_to_timeval(u.u_runtime - u.u_systime, &ru.ru_utime);
+    ns_to_timeval(u.u_systime, &ru.ru_stime);
+    ru.ru_minflt = u.u_minflt;
+    ru.ru_inblock = DIVROUNDUP(u.u_inbytes, 512);
+    ru.ru_oublock = DIVROUNDUP(u.u_outbytes, 512);
+    ru.ru_inbytes = u.u_inbytes;
+    ru.ru_oubytes = u.u_outbytes;
+    ru.ru_nvcsw = u.u_nvcsw;
+    ru.ru_nivcsw = u.u_nivcsw;
+
+    return copyout(&ru, uusage, sizeof(ru));
+}
+
+//-----------------------------------ARGUMENTS---------------------------------
+
+// AN argv BEING PASSED TO A NEW PROGRAM. THE STRINGS ARE COPIED IN BACK TO
+// BACK; argbuf_copyout ADDS THE POINTER ARRAY AFTER THEM AND COPIES THE WHOLE
+// THING ONTO THE NEW USER STACK AT ONCE. STRINGS PLUS POINTERS ARE LIMITED TO
+// ARG_MAX BYTES, AND THE EXTRA 8 IS FOR ALIGNING THE POINTERS AND THE STACK.
+#define ARGBUF_SIZE (ARG_MAX + 8)
+
+struct argbuf {
+    char *ab_buf;       // ARGBUF_SIZE BYTES
+    size_t ab_len;      // BYTES OF STRINGS, INCLUDING THEIR NULS
+    int ab_argc;        // NUMBER OF STRINGS
+};
+
+// BUFFERS THIS BIG ARE TOO EXPENSIVE TO kmalloc FOR EVERY EXEC (dumbvm NEVER
+// GETS MULTI-PAGE BLOCKS BACK), SO FREE ONES ARE KEPT HERE, LINKED THROUGH
+// THEIR FIRST WORD. THERE ARE ONLY EVER AS MANY AS THERE WERE CONCURRENT EXECS.
+static struct spinlock argbuf_lock = SPINLOCK_INITIALIZER;
+static char *argbuf_free;
+
+static
+char *
+argbuf_get(void)
+{
+    char *buf;
+
+    spinlock_acquire(&argbuf_lock);
+    buf = argbuf_free;
+    if (buf != NULL) {
+        argbuf_free = *(char **)buf;
+    }
+    spinlock_release(&argbuf_lock);
+
+    if (buf == NULL) {
+        buf = kmalloc(ARGBUF_SIZE);
+    }
+    return buf;
+}
+
+static
+void
+argbuf_cleanup(struct argbuf *ab)
+{
+    spinlock_acquire(&argbuf_lock);
+    *(char **)ab->ab_buf = argbuf_free;
+    argbuf_free = ab->ab_buf;
+    spinlock_release(&argbuf_lock);
+    ab->ab_buf = NULL;
+}
+
+// COPY IN THE NULL-TERMINATED ARRAY OF STRINGS AT uargv. E2BIG IF IT WON'T
+// FIT IN ARG_MAX. ON SUCCESS THE CALLER MUST argbuf_cleanup.
+static
+int
+argbuf_copyin(struct argbuf *ab, userptr_t uargv)
+{
+    userptr_t uarg;
+    size_t used, got;
+    int result;
+
+    ab->ab_buf = argbuf_get();
+    if (ab->ab_buf == NULL) {
+        return ENOMEM;
+    }
+    ab->ab_len = 0;
+    ab->ab_argc = 0;
+
+    while (1) {
+        result = copyin(uargv + ab->ab_argc * sizeof(userptr_t), &uarg,
+                        sizeof(uarg));
+        if (result) {
+            break;
+        }
+        if (uarg == NULL) {
+            return 0;
+        }
+
+        // THE POINTER ARRAY, WITH ITS NULL, COUNTS AGAINST ARG_MAX TOO
+        used = ab->ab_len + (ab->ab_argc + 2) * sizeof(userptr_t);
+        if (used >= ARG_MAX) {
+            result = E2BIG;
+            break;
+        }
+        result = copyinstr(uarg, ab->ab_buf + ab->ab_len, ARG_MAX - used, &got);
+        if (result == ENAMETOOLONG) {
+            result = E2BIG;
+        }
+        if (result) {
+            break;
+        }
+        ab->ab_len += got;
+        ab->ab_argc++;
+    }
+
+    argbuf_cleanup(ab);
+    return result;
+}
+
+// PUT THE ARGUMENTS ON THE USER STACK BELOW *stackptr, IN THE CURRENT ADDRESS
+// SPACE: THE STRINGS, THEN argv POINTING AT THEM. UPDATES *stackptr AND
+// RETURNS THE USER ADDRESS OF argv IN *uargv.
+static
+int
+argbuf_copyout(struct argbuf *ab, vaddr_t *stackptr, userptr_t *uargv)
+{
+    userptr_t *ptrs;
+    vaddr_t base;
+    size_t ptroff, total, off;
+    int i, result;
+
+    ptroff = ROUNDUP(ab->ab_len, sizeof(userptr_t));
+    total = ROUNDUP(ptroff + (ab->ab_argc + 1) * sizeof(userptr_t), 8);
+    KASSERT(total <= ARGBUF_SIZE);
+    base = *stackptr - total;
+
+    // DON'T LEAK KERNEL MEMORY INTO THE PADDING
+    bzero(ab->ab_buf + ab->ab_len, total - ab->ab_len);
+
+    ptrs = (userptr_t *)(ab->ab_buf + ptroff);
+    off = 0;
+    for (i = 0; i < ab->ab_argc; i++) {
+        ptrs[i] = (userptr_t)(base + off);
+        off += strlen(ab->ab_buf + off) + 1;
+    }
+    ptrs[ab->ab_argc] = NULL;
+
+    result = copyout(ab->ab_buf, (userptr_t)base, total);
+    if (result) {
+        return result;
+    }
+    *stackptr = base;
+    *uargv = (userptr_t)(base + ptroff);
+    return 0;
+}
+
 //-----------------------------------SYS_EXECV---------------------------------
 
 
+// REPLACE THE CURRENT PROGRAM. THE ARGUMENTS ARE COPIED IN BEFORE THE OLD
+// ADDRESS SPACE GOES AWAY AND OUT ONTO THE NEW STACK AFTERWARDS (SEE argbuf).
+// ON ERROR THE OLD ADDRESS SPACE IS PUT BACK AND execv RETURNS.
 int
 sys_execv(const char *program, char **args, int *retval){
 
     struct addrspace *as_new,*as_old;
 	struct vnode *v;
 	vaddr_t entrypoint, stackptr;
-    int len;
+    struct argbuf ab;
+    userptr_t uargv;
+    int argc;
 	int result;
-    int argc = 0;
     char *prog;
 
 
@@ -200,112 +460,480 @@ sys_execv(const char *program, char **args, int *retval){
 		return EFAULT;
 	}
 
-	
-	
-    while (args[argc] != NULL) {
-        argc++;
-    }
-	
-    //allocate memory in kernel for the args, we pass args from user space to kernel space
-	char **args_in = kmalloc((argc + 1) *sizeof(char *));
-    if (args_in == NULL) {
-        return ENOMEM;
-    }
-
-    for (int i=0; i < argc; i++) {
-        len = strlen(args[i]) + 1;
-        args_in[i] = kmalloc(len * sizeof(char));
-        if (args_in[i] == NULL) {
-            return ENOMEM;
-        }
-
-        //copy args[i] in kernel space
-        result = copyinstr((const_userptr_t) args[i], args_in[i], len, NULL);
-        if (result!=0) {
-            kfree(args_in);
-            return result;
-        }
-    }
-    len = strlen(program) + 1;
-    prog = kmalloc(len * sizeof(char));
+    prog = kmalloc(PATH_MAX);
     if (prog == NULL) {
         return ENOMEM;
     }
-    result = copyinstr((const_userptr_t) program, prog, len, NULL);
+    result = copyinstr((const_userptr_t) program, prog, PATH_MAX, NULL);
+    if (result!=0) {
+        kfree(prog);
+        return result;
+    }
+
+    // COPY THE WHOLE argv INTO ONE KERNEL BUFFER
+    result = argbuf_copyin(&ab, (userptr_t) args);
     if (result!=0) {
         kfree(prog);
-        kfree(args_in);
         return result;
     }
         
 	/* Open the file. */
 	result = vfs_open(prog, O_RDONLY, 0, &v);
+    kfree(prog);
 	if (result) {
-        vfs_close(v);
-		kfree(prog);
-        kfree(args_in);
+        argbuf_cleanup(&ab);
         return result;
 	}
 
-	/* We should be a new process. */
-	//KASSERT(proc_getas() == NULL);
-    as_old = proc_getas();
-
 	/* Create a new address space. */
 	as_new = as_create();
 	if (as_new == NULL) {
 		vfs_close(v);
-        kfree(prog);
-        kfree(args_in);
+        argbuf_cleanup(&ab);
 		return ENOMEM;
 	}
 
 	/* Switch to it and activate it. */
-    //as_destroy(as_old);
-	
-    //proc_setas(NULL);
     as_deactivate();
-    
-    proc_setas(as_new);
+    as_old = proc_setas(as_new);
 	as_activate();
-    //as_destroy(as_old);
 
 	/* Load the executable. */
 	result = load_elf(v, &entrypoint);
+	vfs_close(v);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-        //proc_setas(NULL);
-        as_deactivate();
-        proc_setas(as_old);
-        as_activate();
-        //as_destroy(as_new);
-		vfs_close(v);
-		return result;
+        goto fail;
 	}
 
-	/* Done with the file now. */
-	
-
 	/* Define the user stack in the address space */
 	result = as_define_stack(as_new, &stackptr);
 	if (result) {
-		/* p_addrspace will go away when curproc is destroyed */
-        //proc_setas(NULL);
-        as_deactivate();
-        proc_setas(as_old);
-        as_activate();
-        //as_destroy(as_new);
-		return result;
+        goto fail;
 	}
 
-    vfs_close(v);
+    // LAY OUT argv ON THE NEW STACK
+    result = argbuf_copyout(&ab, &stackptr, &uargv);
+    if (result) {
+        goto fail;
+    }
+    argc = ab.ab_argc;
+    argbuf_cleanup(&ab);
+
+    // THE OLD PROGRAM IS GONE; DROP THE PROCESS'S REFERENCE TO ITS MEMORY
+    as_decref(as_old);
+
     *retval = 0;
 	/* Warp to user mode. */
-	enter_new_process( argc, (userptr_t)stackptr,NULL,stackptr, entrypoint);
+	enter_new_process(argc, uargv, NULL, stackptr, entrypoint);
 
 	/* enter_new_process does not return. */
 	panic("enter_new_process returned\n");
 	return EINVAL;
 
+fail:
+    as_deactivate();
+    proc_setas(as_old);
+    as_activate();
+    as_decref(as_new);
+    argbuf_cleanup(&ab);
+    return result;
+}
+
 
-}
\ No newline at end of file
+//------------------------------SPAWN---------------------------------
+
+// WHAT THE PARENT HANDS THE CHILD'S FIRST THREAD
+struct spawninfo {
+    struct vnode *si_vn;        // THE PROGRAM, OPENED BY THE PARENT
+    struct argbuf si_args;
+    struct semaphore *si_done;  // V'D WHEN THE CHILD IS DONE WITH THIS
+    int si_result;              // 0 IF THE CHILD IS ABOUT TO RUN THE PROGRAM
+};
+
+// THE CHILD'S FIRST THREAD: BUILD THE NEW ADDRESS SPACE HERE, SINCE load_elf
+// LOADS INTO THE CURRENT ONE, THEN TELL THE PARENT HOW IT WENT. ON FAILURE
+// JUST EXIT; THE PARENT DESTROYS THE PROCESS.
+static
+void
+spawn_enter(void *data1, unsigned long data2)
+{
+    struct spawninfo *si = data1;
+    struct addrspace *as;
+    vaddr_t entrypoint, stackptr;
+    userptr_t uargv;
+    int argc, result;
+
+    (void) data2;
+
+    as = as_create();
+    if (as == NULL) {
+        result = ENOMEM;
+        goto done;
+    }
+    proc_setas(as);
+    as_activate();
+
+    result = load_elf(si->si_vn, &entrypoint);
+    if (result) {
+        goto done;
+    }
+    result = as_define_stack(as, &stackptr);
+    if (result) {
+        goto done;
+    }
+    result = argbuf_copyout(&si->si_args, &stackptr, &uargv);
+    argc = si->si_args.ab_argc;
+
+done:
+    // si BELONGS TO THE PARENT AGAIN AFTER THIS
+    si->si_result = result;
+    V(si->si_done);
+    if (result) {
+        thread_exit();
+    }
+
+    enter_new_process(argc, uargv, NULL, stackptr, entrypoint);
+    panic("enter_new_process returned\n");
+}
+
+// OPEN sa_path INTO THE CHILD'S TABLE AT sa_fd
+static
+int
+spawn_open(struct filetable *ft, const struct spawn_action *sa)
+{
+    struct openfile *file;
+    struct vnode *vn;
+    struct stat st;
+    char *path;
+    int result;
+
+    path = kmalloc(PATH_MAX);
+    if (path == NULL) {
+        return ENOMEM;
+    }
+    result = copyinstr((const_userptr_t)sa->sa_path, path, PATH_MAX, NULL);
+    if (result) {
+        kfree(path);
+        return result;
+    }
+    result = vfs_open(path, sa->sa_flags, 0664, &vn);
+    kfree(path);
+    if (result) {
+        return result;
+    }
+    result = openfile_init(vn, sa->sa_flags, &file);
+    if (result) {
+        vfs_close(vn);
+        return result;
+    }
+    if (sa->sa_flags & O_APPEND) {
+        VOP_STAT(vn, &st);
+        file->offset = st.st_size;
+    }
+    if (ft->entries[sa->sa_fd] != NULL) {
+        openfile_decref(ft->entries[sa->sa_fd]);
+    }
+    ft->entries[sa->sa_fd] = file;
+    return 0;
+}
+
+// APPLY THE FILE ACTIONS TO THE CHILD'S TABLE. THE CHILD ISN'T RUNNING YET, SO
+// NOTHING ELSE CAN BE USING ft. ENTRIES IT GOT FROM THE PARENT ARE SHARED WITH
+// THE PARENT, SO CLOSING ONE HERE ONLY DROPS THE CHILD'S REFERENCE.
+static
+int
+spawn_fileactions(struct filetable *ft, const struct spawn_action *actions,
+                  int nactions)
+{
+    const struct spawn_action *sa;
+    int i, result;
+
+    for (i = 0; i < nactions; i++) {
+        sa = &actions[i];
+        if (is_valid(sa->sa_fd)) {
+            return EBADF;
+        }
+        switch (sa->sa_type) {
+            case SPAWN_OPEN:
+                result = spawn_open(ft, sa);
+                if (result) {
+                    return result;
+                }
+                break;
+            case SPAWN_CLOSE:
+                if (ft->entries[sa->sa_fd] != NULL) {
+                    openfile_decref(ft->entries[sa->sa_fd]);
+                    ft->entries[sa->sa_fd] = NULL;
+                }
+                break;
+            case SPAWN_DUP2:
+                if (is_valid(sa->sa_newfd) || ft->entries[sa->sa_fd] == NULL) {
+                    return EBADF;
+                }
+                openfile_incref(ft->entries[sa->sa_fd]);
+                if (ft->entries[sa->sa_newfd] != NULL) {
+                    openfile_decref(ft->entries[sa->sa_newfd]);
+                }
+                ft->entries[sa->sa_newfd] = ft->entries[sa->sa_fd];
+                break;
+            default:
+                return EINVAL;
+        }
+    }
+    return 0;
+}
+
+// __spawn(path, argv, actions, nactions): START path IN A NEW CHILD PROCESS,
+// AS fork AND execv WOULD, BUT WITHOUT COPYING OUR ADDRESS SPACE FIRST.
+// RETURNS THE CHILD'S PID. IF THE PROGRAM CAN'T BE LOADED THE CHILD NEVER
+// RUNS AND THE ERROR IS RETURNED HERE INSTEAD.
+int
+sys_spawn(const_userptr_t upath, userptr_t uargv, const_userptr_t uactions,
+          int nactions, int32_t *retval)
+{
+    struct spawn_action actions[SPAWN_ACTIONS_MAX];
+    struct spawninfo si;
+    struct proc *child;
+    char *path;
+    pid_t pid;
+    bool running;
+    int result;
+
+    if (nactions < 0 || nactions > SPAWN_ACTIONS_MAX) {
+        return EINVAL;
+    }
+    if (nactions > 0) {
+        result = copyin(uactions, actions, nactions * sizeof(actions[0]));
+        if (result) {
+            return result;
+        }
+    }
+
+    path = kmalloc(PATH_MAX);
+    if (path == NULL) {
+        return ENOMEM;
+    }
+    result = copyinstr(upath, path, PATH_MAX, NULL);
+    if (result) {
+        kfree(path);
+        return result;
+    }
+
+    result = argbuf_copyin(&si.si_args, uargv);
+    if (result) {
+        kfree(path);
+        return result;
+    }
+
+    // OPEN THE PROGRAM FIRST, SO A BAD PATH FAILS BEFORE ANY PROCESS EXISTS
+    result = vfs_open(path, O_RDONLY, 0, &si.si_vn);
+    kfree(path);
+    if (result) {
+        argbuf_cleanup(&si.si_args);
+        return result;
+    }
+
+    si.si_done = sem_create("spawn", 0);
+    if (si.si_done == NULL) {
+        result = ENOMEM;
+        goto fail;
+    }
+
+    result = proc_create_child(curproc->p_name, &child);
+    if (result) {
+        goto fail;
+    }
+    filetable_destroy(child->p_filetable);
+    child->p_filetable = NULL;
+    result = copy_filetable(curproc->p_filetable, &child->p_filetable);
+    if (result) {
+        proc_destroy(child);
+        goto fail;
+    }
+    result = spawn_fileactions(child->p_filetable, actions, nactions);
+    if (result) {
+        goto failchild;
+    }
+
+    pid = child->p_pid;
+    result = thread_fork(curproc->p_name, child, spawn_enter, &si, 0);
+    if (result) {
+        goto failchild;
+    }
+
+    P(si.si_done);
+    result = si.si_result;
+    if (result) {
+        // WAIT FOR THE CHILD'S THREAD TO LEAVE IT, THEN CLEAN UP
+        do {
+            thread_yield();
+            spinlock_acquire(&child->p_lock);
+            running = child->p_numthreads > 0;
+            spinlock_release(&child->p_lock);
+        } while (running);
+        goto failchild;
+    }
+
+    sem_destroy(si.si_done);
+    vfs_close(si.si_vn);
+    argbuf_cleanup(&si.si_args);
+    *retval = pid;
+    return 0;
+
+failchild:
+    // THIS DROPS THE CHILD'S REFERENCES TO THE FILES IT SHARES WITH US
+    proc_destroy(child);
+fail:
+    if (si.si_done != NULL) {
+        sem_destroy(si.si_done);
+    }
+    vfs_close(si.si_vn);
+    argbuf_cleanup(&si.si_args);
+    return result;
+}
+
+//------------------------------THREAD_CREATE---------------------------------
+
+// NEW USER THREADS START HERE. THE TRAPFRAME HAS TO BE ON OUR OWN STACK
+// FOR mips_usermode, SO COPY IT OUT OF THE HEAP FIRST.
+static
+void
+enter_userthread(void *data1, unsigned long data2)
+{
+    struct trapframe tf;
+
+    curthread->t_tid = data2;
+
+    memcpy(&tf, data1, sizeof(tf));
+    kfree(data1);
+
+    as_activate();
+    mips_usermode(&tf);
+}
+
+// __thread_create(start, func, arg): START A NEW THREAD IN THIS PROCESS AT
+// start(func, arg), ON A STACK OF ITS OWN. THE ARGUMENTS ARE TAKEN STRAIGHT
+// FROM THE TRAPFRAME. RETURNS THE NEW THREAD'S ID.
+int
+sys_thread_create(struct trapframe *tf, int32_t *retval)
+{
+    struct uthreads *ut;
+    struct addrspace *as;
+    struct trapframe *child_tf;
+    vaddr_t stackptr;
+    unsigned tid;
+    int err;
+
+    ut = proc_uthreads(curproc);
+    if (ut == NULL) {
+        return ENOMEM;
+    }
+
+    // THE THREAD ID IS THE USER STACK SLOT
+    as = proc_getas();
+    err = as_define_thread_stack(as, &tid, &stackptr);
+    if (err) {
+        return err;
+    }
+
+    child_tf = kmalloc(sizeof(*child_tf));
+    if (child_tf == NULL) {
+        as_release_thread_stack(as, tid);
+        return ENOMEM;
+    }
+    memcpy(child_tf, tf, sizeof(*child_tf));
+    child_tf->tf_epc = tf->tf_a0;
+    child_tf->tf_a0 = tf->tf_a1;
+    child_tf->tf_a1 = tf->tf_a2;
+    child_tf->tf_sp = stackptr;
+    child_tf->tf_ra = 0;
+    child_tf->tf_v0 = 0;
+    child_tf->tf_a3 = 0;
+
+    lock_acquire(ut->ut_lock);
+    KASSERT(!ut->ut_threads[tid].ut_used);
+    ut->ut_threads[tid].ut_used = true;
+    ut->ut_threads[tid].ut_exited = false;
+    ut->ut_threads[tid].ut_joining = false;
+    lock_release(ut->ut_lock);
+
+    // THE NEW THREAD HOLDS A REFERENCE TO THE ADDRESS SPACE UNTIL IT EXITS
+    as_incref(as);
+
+    err = thread_fork(curthread->t_name, curproc, enter_userthread,
+                      child_tf, tid);
+    if (err) {
+        as_decref(as);
+        lock_acquire(ut->ut_lock);
+        ut->ut_threads[tid].ut_used = false;
+        lock_release(ut->ut_lock);
+        as_release_thread_stack(as, tid);
+        kfree(child_tf);
+        return err;
+    }
+
+    *retval = tid;
+    return 0;
+}
+
+//------------------------------THREAD_EXIT---------------------------------
+
+// THE INITIAL THREAD EXITING IS THE SAME AS _exit: THE PROCESS IS DONE AS
+// FAR AS waitpid IS CONCERNED, BUT ANY OTHER THREADS KEEP RUNNING.
+void
+sys_thread_exit(int status)
+{
+    if (curproc->p_uthreads == NULL || curthread->t_tid == 0) {
+        sys_exit(status);
+        panic("sys_exit returned\n");
+    }
+
+    uthread_finish(status);
+    thread_exit();
+}
+
+//------------------------------THREAD_JOIN---------------------------------
+
+// WAIT FOR THREAD tid TO EXIT, COLLECT ITS STATUS, AND FREE ITS ID AND STACK.
+// ONLY ONE THREAD CAN JOIN A GIVEN THREAD.
+int
+sys_thread_join(int tid, userptr_t status)
+{
+    struct uthreads *ut;
+    struct uthread *t;
+    int exitstatus;
+
+    ut = curproc->p_uthreads;
+    if (ut == NULL || tid <= 0 || tid >= THREAD_MAX) {
+        return ESRCH;
+    }
+    if ((unsigned)tid == curthread->t_tid) {
+        return EINVAL;
+    }
+    t = &ut->ut_threads[tid];
+
+    lock_acquire(ut->ut_lock);
+    if (!t->ut_used) {
+        lock_release(ut->ut_lock);
+        return ESRCH;
+    }
+    if (t->ut_joining) {
+        lock_release(ut->ut_lock);
+        return EINVAL;
+    }
+    t->ut_joining = true;
+    while (!t->ut_exited) {
+        cv_wait(ut->ut_cv, ut->ut_lock);
+    }
+    exitstatus = t->ut_status;
+    t->ut_used = false;
+    t->ut_joining = false;
+    lock_release(ut->ut_lock);
+
+    as_release_thread_stack(proc_getas(), tid);
+
+    if (status != NULL) {
+        return copyout(&exitstatus, status, sizeof(exitstatus));
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Periodic thread test: a few periodic threads have to make every
+ * release while a crowd of busy threads soaks up all the cpus.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <clock.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <test.h>
+
+#define EDFT_PERIODIC	3
+#define EDFT_PERIOD	5	/* hardclocks */
+#define EDFT_ROUNDS	40
+#define EDFT_HOGSPERCPU	3
+
+static volatile bool edft_stop;
+static volatile unsigned edft_late[EDFT_PERIODIC];
+
+static
+void
+edft_hog(void *vsem, unsigned long num)
+{
+	struct semaphore *sem = vsem;
+	volatile unsigned spin = 0;
+
+	(void)num;
+
+	while (!edft_stop) {
+		spin++;
+	}
+	V(sem);
+}
+
+static
+void
+edft_periodic(void *vsem, unsigned long num)
+{
+	struct semaphore *sem = vsem;
+	unsigned i, missed, late;
+	int result;
+
+	result = thread_setperiodic(EDFT_PERIOD, EDFT_PERIOD);
+	KASSERT(result == 0);
+
+	for (i=0; i<EDFT_ROUNDS; i++) {
+		missed = thread_waitperiod();
+		if (missed > 0) {
+			panic("edftest: thread %lu missed %u releases "
+			      "in round %u\n", num, missed, i);
+		}
+		late = timeout_ticks() - curthread->t_release;
+		if (late > edft_late[num]) {
+			edft_late[num] = late;
+		}
+	}
+
+	thread_setperiodic(0, 0);
+	V(sem);
+}
+
+int
+edftest(int nargs, char **args)
+{
+	struct semaphore *psem, *hsem;
+	unsigned i, nhogs;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	psem = sem_create("edftest", 0);
+	hsem = sem_create("edfhogs", 0);
+	if (psem == NULL || hsem == NULL) {
+		panic("edftest: out of memory\n");
+	}
+
+	kprintf("Starting periodic thread test...\n");
+
+	edft_stop = false;
+	nhogs = cpu_count() * EDFT_HOGSPERCPU;
+	for (i=0; i<nhogs; i++) {
+		result = thread_fork("edfhog", NULL, edft_hog, hsem, i);
+		if (result) {
+			panic("edftest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<EDFT_PERIODIC; i++) {
+		edft_late[i] = 0;
+		result = thread_fork("edftest", NULL, edft_periodic, psem, i);
+		if (result) {
+			panic("edftest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	for (i=0; i<EDFT_PERIODIC; i++) {
+		P(psem);
+	}
+	edft_stop = true;
+	for (i=0; i<nhogs; i++) {
+		P(hsem);
+	}
+
+	for (i=0; i<EDFT_PERIODIC; i++) {
+		kprintf("edftest: thread %u: worst start %u ticks after "
+			"release (deadline %u)\n", i, edft_late[i],
+			EDFT_PERIOD);
+	}
+
+	sem_destroy(psem);
+	sem_destroy(hsem);
+
+	kprintf("Periodic thread test done.\n");
+	return 0;
+}
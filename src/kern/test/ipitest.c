@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Cross-cpu function call test.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <current.h>
+#include <test.h>
+
+#define IPIT_ROUNDS	100
+#define IPIT_BATCH	8
+
+/* Calls seen on each cpu; each cpu only updates its own slot. */
+static volatile unsigned ipit_count[32];
+
+static
+void
+ipit_func(void *arg)
+{
+	(void)arg;
+
+	KASSERT(curcpu->c_number < 32);
+	ipit_count[curcpu->c_number]++;
+}
+
+int
+ipitest(int nargs, char **args)
+{
+	struct ipi_call calls[IPIT_BATCH];
+	struct cpu *target;
+	unsigned i, num, before, expected;
+	uint32_t affinity;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	/* Stay on cpu 0, so we know which cpu is us. */
+	affinity = thread_getaffinity(curthread);
+	result = thread_pin(0);
+	KASSERT(result == 0);
+
+	num = cpu_count();
+	if (num > 32) {
+		num = 32;
+	}
+	for (i=0; i<num; i++) {
+		ipit_count[i] = 0;
+	}
+
+	kprintf("Starting ipi call test...\n");
+
+	for (i=0; i<IPIT_ROUNDS; i++) {
+		result = ipi_broadcast_call(ipit_func, NULL);
+		if (result) {
+			panic("ipitest: ipi_broadcast_call: %s\n",
+			      strerror(result));
+		}
+	}
+	for (i=0; i<num; i++) {
+		expected = (i == curcpu->c_number) ? 0 : IPIT_ROUNDS;
+		if (ipit_count[i] != expected) {
+			panic("ipitest: cpu%u ran %u calls, expected %u\n",
+			      i, ipit_count[i], expected);
+		}
+	}
+
+	if (num < 2) {
+		kprintf("Only one cpu; skipping the batch test.\n");
+		thread_setaffinity(curthread, affinity);
+		kprintf("IPI call test done.\n");
+		return 0;
+	}
+
+	/* A batch to one cpu, waited for together. */
+	target = cpu_bynumber(1);
+	before = ipit_count[target->c_number];
+	for (i=0; i<IPIT_BATCH; i++) {
+		calls[i].ic_func = ipit_func;
+		calls[i].ic_arg = NULL;
+		ipi_call(target, &calls[i]);
+	}
+	for (i=0; i<IPIT_BATCH; i++) {
+		ipi_call_wait(&calls[i]);
+	}
+	if (ipit_count[target->c_number] != before + IPIT_BATCH) {
+		panic("ipitest: batch ran %u calls, expected %u\n",
+		      ipit_count[target->c_number] - before, IPIT_BATCH);
+	}
+
+	thread_setaffinity(curthread, affinity);
+
+	kprintf("IPI call test done; see sstat for coalescing.\n");
+	return 0;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * PID allocator test: hand out a lot of pids to dummy processes, free
+ * some, and check they come back in the order they were freed. Then
+ * churn pids while other threads look them up without locks.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <rcu.h>
+#include <proc.h>
+#include <proc_table.h>
+#include <test.h>
+
+#define PIDT_NPROCS	1000	/* More than one chunk's worth */
+#define PIDT_NREADERS	4
+#define PIDT_CHURN	5000
+
+/* Kept in the dummy processes' exit field. */
+#define PIDT_LIVE	0x0b1ec7ed
+#define PIDT_DEAD	0xdeadbeef
+
+static volatile bool pidt_stop;
+
+static
+void
+pidt_free(struct rcu_head *head)
+{
+	struct proc *proc = (struct proc *)head;
+
+	proc->exit = PIDT_DEAD;
+	kfree(proc);
+}
+
+static
+void
+pidt_reader(void *vsem, unsigned long num)
+{
+	struct semaphore *sem = vsem;
+	struct proc *proc;
+	unsigned n;
+	pid_t pid;
+
+	n = 0;
+	while (!pidt_stop) {
+		pid = PID_MIN + (num * 37 + n) % PIDT_NPROCS;
+		rcu_read_lock();
+		proc = proc_table_get(pid);
+		if (proc != NULL &&
+		    (proc->exit != PIDT_LIVE || proc->p_pid != pid)) {
+			panic("pidtest: lookup of pid %d found pid %d "
+			      "(exit 0x%x)\n", pid, proc->p_pid, proc->exit);
+		}
+		rcu_read_unlock();
+		if (++n % 64 == 0) {
+			thread_yield();
+		}
+	}
+	V(sem);
+}
+
+/*
+ * Make and free dummy processes in a loop while the readers look
+ * them up.
+ */
+static
+void
+pidt_churn(void)
+{
+	struct semaphore *sem;
+	struct proc *proc;
+	unsigned i;
+	int result;
+
+	sem = sem_create("pidtest", 0);
+	if (sem == NULL) {
+		panic("pidtest: out of memory\n");
+	}
+
+	pidt_stop = false;
+	for (i=0; i<PIDT_NREADERS; i++) {
+		result = thread_fork("pidtest", NULL, pidt_reader, sem, i);
+		if (result) {
+			panic("pidtest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	for (i=0; i<PIDT_CHURN; i++) {
+		proc = kmalloc(sizeof(struct proc));
+		if (proc == NULL) {
+			panic("pidtest: out of memory\n");
+		}
+		proc->exit = PIDT_LIVE;
+		result = assign_pid(proc);
+		if (result) {
+			panic("pidtest: assign_pid: %s\n", strerror(result));
+		}
+		free_pid(proc);
+		call_rcu(&proc->p_rcu, pidt_free);
+		if (i % 16 == 0) {
+			thread_yield();
+		}
+	}
+
+	pidt_stop = true;
+	for (i=0; i<PIDT_NREADERS; i++) {
+		P(sem);
+	}
+	synchronize_rcu();
+	sem_destroy(sem);
+}
+
+int
+pidtest(int nargs, char **args)
+{
+	struct proc **procs;
+	pid_t firstfreed;
+	unsigned i;
+	int before;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	procs = kmalloc(PIDT_NPROCS * sizeof(*procs));
+	if (procs == NULL) {
+		panic("pidtest: out of memory\n");
+	}
+	for (i=0; i<PIDT_NPROCS; i++) {
+		/* Only the pid fields get used. */
+		procs[i] = kmalloc(sizeof(struct proc));
+		if (procs[i] == NULL) {
+			panic("pidtest: out of memory\n");
+		}
+	}
+
+	kprintf("Starting pid allocator test...\n");
+	before = ptable->num_processes;
+
+	for (i=0; i<PIDT_NPROCS; i++) {
+		result = assign_pid(procs[i]);
+		if (result) {
+			panic("pidtest: assign_pid: %s\n", strerror(result));
+		}
+		if (i > 0 && procs[i]->p_pid == procs[i-1]->p_pid) {
+			panic("pidtest: pid %d handed out twice\n",
+			      procs[i]->p_pid);
+		}
+	}
+	for (i=0; i<PIDT_NPROCS; i++) {
+		if (proc_table_get(procs[i]->p_pid) != procs[i]) {
+			panic("pidtest: pid %d maps to the wrong process\n",
+			      procs[i]->p_pid);
+		}
+	}
+
+	/* Free every other one, then take as many back. */
+	firstfreed = procs[0]->p_pid;
+	for (i=0; i<PIDT_NPROCS; i+=2) {
+		free_pid(procs[i]);
+		if (proc_table_get(procs[i]->p_pid) != NULL) {
+			panic("pidtest: freed pid %d still maps to a process\n",
+			      procs[i]->p_pid);
+		}
+	}
+	result = assign_pid(procs[0]);
+	if (result) {
+		panic("pidtest: assign_pid: %s\n", strerror(result));
+	}
+	if (procs[0]->p_pid != firstfreed) {
+		panic("pidtest: got pid %d back first, expected %d\n",
+		      procs[0]->p_pid, firstfreed);
+	}
+	for (i=2; i<PIDT_NPROCS; i+=2) {
+		result = assign_pid(procs[i]);
+		if (result) {
+			panic("pidtest: assign_pid: %s\n", strerror(result));
+		}
+	}
+
+	for (i=0; i<PIDT_NPROCS; i++) {
+		free_pid(procs[i]);
+		kfree(procs[i]);
+	}
+	kfree(procs);
+
+	pidt_churn();
+
+	if (ptable->num_processes != before) {
+		panic("pidtest: %d processes left, expected %d\n",
+		      ptable->num_processes, before);
+	}
+
+	kprintf("PID allocator test done.\n");
+	return 0;
+}
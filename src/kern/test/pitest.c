@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Priority inheritance test.
+ *
+ * We hold lock A. A medium thread takes lock B and then waits for A;
+ * a high-priority thread waits for B. Both the medium thread and we
+ * should inherit the high priority, through the chain, and give it
+ * back as the locks are released.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <current.h>
+#include <clock.h>
+#include <test.h>
+
+#define PIT_HIGH	10
+
+static struct lock *pit_a, *pit_b;
+static struct semaphore *pit_done;
+static struct thread *volatile pit_medium;
+
+static
+void
+pit_mediumthread(void *junk1, unsigned long junk2)
+{
+	(void)junk1;
+	(void)junk2;
+
+	pit_medium = curthread;
+	lock_acquire(pit_b);
+	lock_acquire(pit_a);
+
+	/* Still inherited through B, which the high thread wants. */
+	if (thread_getpriority(curthread) != PIT_HIGH) {
+		panic("pitest: medium thread at %u holding B\n",
+		      thread_getpriority(curthread));
+	}
+
+	lock_release(pit_a);
+	lock_release(pit_b);
+	if (thread_getpriority(curthread) != THREAD_PRI_DEFAULT) {
+		panic("pitest: medium thread kept priority %u\n",
+		      thread_getpriority(curthread));
+	}
+	V(pit_done);
+}
+
+static
+void
+pit_highthread(void *junk1, unsigned long junk2)
+{
+	(void)junk1;
+	(void)junk2;
+
+	thread_setpriority(curthread, PIT_HIGH);
+	lock_acquire(pit_b);
+	lock_release(pit_b);
+	V(pit_done);
+}
+
+int
+pitest(int nargs, char **args)
+{
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	pit_a = lock_create("pitest-a");
+	pit_b = lock_create("pitest-b");
+	pit_done = sem_create("pitest", 0);
+	if (pit_a == NULL || pit_b == NULL || pit_done == NULL) {
+		panic("pitest: out of memory\n");
+	}
+	pit_medium = NULL;
+
+	kprintf("Starting priority inheritance test...\n");
+
+	lock_acquire(pit_a);
+
+	result = thread_fork("pitest-medium", NULL, pit_mediumthread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+	clocksleep(1);
+	if (thread_getpriority(curthread) != THREAD_PRI_DEFAULT) {
+		panic("pitest: boosted with no high-priority waiter\n");
+	}
+
+	result = thread_fork("pitest-high", NULL, pit_highthread, NULL, 0);
+	if (result) {
+		panic("pitest: thread_fork failed: %s\n", strerror(result));
+	}
+	clocksleep(1);
+
+	/* The high thread waits for B, held by medium, waiting for A. */
+	KASSERT(pit_medium != NULL);
+	if (thread_getpriority(pit_medium) != PIT_HIGH ||
+	    thread_getpriority(curthread) != PIT_HIGH) {
+		panic("pitest: chain not boosted (medium %u, us %u)\n",
+		      thread_getpriority(pit_medium),
+		      thread_getpriority(curthread));
+	}
+
+	lock_release(pit_a);
+	if (thread_getpriority(curthread) != THREAD_PRI_DEFAULT) {
+		panic("pitest: kept priority %u after release\n",
+		      thread_getpriority(curthread));
+	}
+
+	P(pit_done);
+	P(pit_done);
+
+	sem_destroy(pit_done);
+	lock_destroy(pit_b);
+	lock_destroy(pit_a);
+
+	kprintf("Priority inheritance test done.\n");
+	return 0;
+}
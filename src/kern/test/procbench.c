@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Process benchmarks: time the life cycle of processes from the
+ * menu, for before/after numbers on process and VM changes.
+ *
+ *    pb1 [n]            create a process with one thread that just
+ *                       exits, and wait until it has been reaped
+ *    pb2 [n] [program]  the same, but the thread runs PROGRAM
+ *                       (default /bin/true) like the "p" command
+ *
+ * The menu's processes belong to the kernel process, which has no
+ * waitpid, so the wait is done by yielding until the pid's slot in
+ * the process table is empty, which is the last thing the reaper
+ * does before freeing the process. Results are printed on one line
+ * in the same key=value form as testbin/procbench.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <clock.h>
+#include <thread.h>
+#include <rcu.h>
+#include <proc.h>
+#include <proc_table.h>
+#include <proc_syscalls.h>
+#include <test.h>
+
+#define PB_DEFAULT	100	/* iterations */
+#define PB_MAX		1000
+#define PB_PROGRAM	"/bin/true"
+
+/*
+ * Thread for pb1: exit the way a user process would.
+ */
+static
+void
+pb_exitthread(void *unused1, unsigned long unused2)
+{
+	(void)unused1;
+	(void)unused2;
+
+	sys_exit(0);
+}
+
+/*
+ * Thread for pb2. As in cmd_progthread, runprogram gets a copy of
+ * the name because it hands it to vfs_open.
+ */
+static
+void
+pb_progthread(void *vprog, unsigned long unused)
+{
+	char progname[128];
+	int result;
+
+	(void)unused;
+
+	strcpy(progname, vprog);
+	result = runprogram(progname);
+	kprintf("procbench: %s: %s\n", (char *)vprog, strerror(result));
+	sys_exit(1);
+}
+
+/*
+ * Wait until process PID is gone.
+ */
+static
+void
+pb_waitgone(pid_t pid)
+{
+	struct proc *proc;
+
+	while (1) {
+		rcu_read_lock();
+		proc = proc_table_get(pid);
+		rcu_read_unlock();
+		if (proc == NULL) {
+			return;
+		}
+		thread_yield();
+	}
+}
+
+/*
+ * Run one process to completion, returning the time it took in
+ * nanoseconds in *NS.
+ */
+static
+int
+pb_runone(bool prog, const char *progname, uint64_t *ns)
+{
+	struct timespec before, after, diff;
+	struct proc *proc;
+	pid_t pid;
+	int result;
+
+	gettime(&before);
+	if (prog) {
+		proc = proc_create_runprogram(progname);
+		if (proc == NULL) {
+			return ENOMEM;
+		}
+	}
+	else {
+		result = proc_create_child("procbench", &proc);
+		if (result) {
+			return result;
+		}
+	}
+	pid = proc->p_pid;
+	result = thread_fork("procbench", proc,
+			     prog ? pb_progthread : pb_exitthread,
+			     (void *)progname, 0);
+	if (result) {
+		proc_destroy(proc);
+		return result;
+	}
+	pb_waitgone(pid);
+	gettime(&after);
+
+	timespec_sub(&after, &before, &diff);
+	*ns = (uint64_t)diff.tv_sec * 1000000000 + diff.tv_nsec;
+	return 0;
+}
+
+/*
+ * Sort the samples and print count, mean, median, 99th percentile,
+ * minimum and maximum, in microseconds.
+ */
+static
+void
+pb_report(const char *name, uint64_t *ns, unsigned n)
+{
+	unsigned i, j;
+	uint64_t tmp, total;
+
+	KASSERT(n > 0);
+
+	total = 0;
+	for (i=0; i<n; i++) {
+		total += ns[i];
+		tmp = ns[i];
+		for (j=i; j>0 && ns[j-1] > tmp; j--) {
+			ns[j] = ns[j-1];
+		}
+		ns[j] = tmp;
+	}
+
+	kprintf("bench=%s n=%u mean_us=%llu median_us=%llu p99_us=%llu "
+		"min_us=%llu max_us=%llu\n", name, n,
+		(unsigned long long)(total / n / 1000),
+		(unsigned long long)(ns[n / 2] / 1000),
+		(unsigned long long)(ns[(n * 99 + 99) / 100 - 1] / 1000),
+		(unsigned long long)(ns[0] / 1000),
+		(unsigned long long)(ns[n - 1] / 1000));
+}
+
+static
+int
+pb_run(const char *name, bool prog, const char *progname, unsigned n)
+{
+	uint64_t *ns;
+	unsigned i;
+	int result;
+
+	if (n == 0 || n > PB_MAX) {
+		kprintf("procbench: iterations must be 1-%u\n", PB_MAX);
+		return EINVAL;
+	}
+
+	ns = kmalloc(n * sizeof(*ns));
+	if (ns == NULL) {
+		return ENOMEM;
+	}
+
+	for (i=0; i<n; i++) {
+		result = pb_runone(prog, progname, &ns[i]);
+		if (result) {
+			kprintf("procbench: %s: iteration %u: %s\n",
+				name, i, strerror(result));
+			kfree(ns);
+			return result;
+		}
+	}
+
+	pb_report(name, ns, n);
+	kfree(ns);
+	return 0;
+}
+
+int
+procbench1(int nargs, char **args)
+{
+	if (nargs > 2) {
+		kprintf("Usage: pb1 [iterations]\n");
+		return EINVAL;
+	}
+	return pb_run("kproc", false, NULL,
+		      nargs > 1 ? (unsigned)atoi(args[1]) : PB_DEFAULT);
+}
+
+int
+procbench2(int nargs, char **args)
+{
+	if (nargs > 3) {
+		kprintf("Usage: pb2 [iterations] [program]\n");
+		return EINVAL;
+	}
+	return pb_run("kexec", true, nargs > 2 ? args[2] : PB_PROGRAM,
+		      nargs > 1 ? (unsigned)atoi(args[1]) : PB_DEFAULT);
+}
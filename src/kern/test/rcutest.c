@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * RCU test: readers chase a pointer a writer keeps replacing, and
+ * check they never see an object that has been reclaimed.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <rcu.h>
+#include <test.h>
+
+#define NREADERS	4
+#define NREADS		2000
+#define NUPDATES	200
+
+#define RCT_LIVE	0x0b1ec7ed
+#define RCT_DEAD	0xdeadbeef
+
+struct rct_obj {
+	struct rcu_head ro_head;	/* must come first */
+	volatile unsigned ro_magic;
+	unsigned ro_gen;
+};
+
+static struct rct_obj *rct_shared;
+static volatile unsigned rct_freed;
+
+static
+struct rct_obj *
+rct_obj_create(unsigned gen)
+{
+	struct rct_obj *obj;
+
+	obj = kmalloc(sizeof(*obj));
+	if (obj == NULL) {
+		panic("rcutest: out of memory\n");
+	}
+	obj->ro_magic = RCT_LIVE;
+	obj->ro_gen = gen;
+	return obj;
+}
+
+static
+void
+rct_obj_free(struct rcu_head *head)
+{
+	struct rct_obj *obj = (struct rct_obj *)head;
+
+	obj->ro_magic = RCT_DEAD;
+	rct_freed++;
+	kfree(obj);
+}
+
+static
+void
+rct_reader(void *vsem, unsigned long num)
+{
+	struct semaphore *sem = vsem;
+	struct rct_obj *obj;
+	unsigned i, j, gen;
+
+	for (i=0; i<NREADS; i++) {
+		rcu_read_lock();
+		obj = rcu_dereference(rct_shared);
+		gen = obj->ro_gen;
+		for (j=0; j<100; j++) {
+			if (obj->ro_magic != RCT_LIVE || obj->ro_gen != gen) {
+				panic("rcutest: reader %lu saw a freed object "
+				      "(magic 0x%x)\n", num, obj->ro_magic);
+			}
+		}
+		rcu_read_unlock();
+		if (i % 100 == 0) {
+			thread_yield();
+		}
+	}
+	V(sem);
+}
+
+int
+rcutest(int nargs, char **args)
+{
+	struct semaphore *sem;
+	struct rct_obj *old;
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	sem = sem_create("rcutest", 0);
+	if (sem == NULL) {
+		panic("rcutest: out of memory\n");
+	}
+
+	kprintf("Starting rcu test...\n");
+
+	rct_freed = 0;
+	rct_shared = rct_obj_create(0);
+
+	for (i=0; i<NREADERS; i++) {
+		result = thread_fork("rcutest", NULL, rct_reader, sem, i);
+		if (result) {
+			panic("rcutest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+	}
+
+	for (i=1; i<=NUPDATES; i++) {
+		old = rct_shared;
+		rcu_assign_pointer(rct_shared, rct_obj_create(i));
+		call_rcu(&old->ro_head, rct_obj_free);
+		if (i % 10 == 0) {
+			thread_yield();
+		}
+	}
+
+	for (i=0; i<NREADERS; i++) {
+		P(sem);
+	}
+
+	/* Everything retired before synchronize_rcu is gone after it. */
+	synchronize_rcu();
+	if (rct_freed != NUPDATES) {
+		panic("rcutest: %u of %u objects freed after "
+		      "synchronize_rcu\n", rct_freed, NUPDATES);
+	}
+
+	kfree(rct_shared);
+	rct_shared = NULL;
+	sem_destroy(sem);
+
+	kprintf("RCU test done.\n");
+	return 0;
+}
@@ -28,6 +28,7 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <synch.h>
@@ -39,7 +40,7 @@
 /*
  * Unit tests for semaphores.
  *
- * We test 21 correctness criteria, each stated in a comment at the
+ * We test 23 correctness criteria, each stated in a comment at the
  * top of each test.
  *
  * Note that these tests go inside the semaphore abstraction to
@@ -818,3 +819,35 @@ semu22(int nargs, char **args)
 	panic("semu22: P tolerated null semaphore\n");
 	return 0;
 }
+
+/*
+ * 23. In handoff mode, V with a thread waiting gives the count
+ * straight to that thread: sem_count stays 0, so a P that comes
+ * along before the waiter gets to run can't take it.
+ */
+int
+semu23(int nargs, char **args)
+{
+	struct semaphore *sem;
+	int result;
+
+	(void)nargs; (void)args;
+
+	sem = makesem(0);
+	sem_set_handoff(sem, true);
+	makewaiter(sem);
+
+	V(sem);
+	KASSERT(sem->sem_count == 0);
+	result = P_timeout(sem, 1);
+	KASSERT(result == ETIMEDOUT);
+
+	kprintf("Sleeping for waiter to finish\n");
+	clocksleep(1);
+	KASSERT(waiters_running == 0);
+	KASSERT(sem->sem_count == 0);
+
+	ok();
+	sem_destroy(sem);
+	return 0;
+}
@@ -399,3 +399,93 @@ cvtest2(int nargs, char **args)
 	kprintf("cvtest2 done\n");
 	return 0;
 }
+
+////////////////////////////////////////////////////////////
+// lock handoff test
+
+/*
+ * In handoff mode a lock goes to its waiters in the order they
+ * arrived. We hold the lock while a line of threads queues up on
+ * it, one at a time, then release it and at once ask for it again:
+ * we must get it last, after everyone has had it in turn.
+ */
+#define NHANDOFF 8
+
+static struct lock *hotlock;
+static struct semaphore *hostarted;
+static struct semaphore *hodone;
+static unsigned hoorder[NHANDOFF];
+static volatile unsigned hocount;
+
+static
+void
+handoffthread(void *junk, unsigned long num)
+{
+	(void)junk;
+
+	V(hostarted);
+	lock_acquire(hotlock);
+	hoorder[hocount++] = num;
+	lock_release(hotlock);
+	V(hodone);
+}
+
+int
+lockhandofftest(int nargs, char **args)
+{
+	unsigned i;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	hotlock = lock_create("handoff");
+	hostarted = sem_create("handoff started", 0);
+	hodone = sem_create("handoff done", 0);
+	if (hotlock == NULL || hostarted == NULL || hodone == NULL) {
+		panic("lockhandofftest: out of memory\n");
+	}
+	lock_set_handoff(hotlock, true);
+	hocount = 0;
+
+	kprintf("Starting lock handoff test...\n");
+
+	lock_acquire(hotlock);
+	for (i=0; i<NHANDOFF; i++) {
+		result = thread_fork("handoff", NULL, handoffthread, NULL, i);
+		if (result) {
+			panic("lockhandofftest: thread_fork failed: %s\n",
+			      strerror(result));
+		}
+		/* Let it get to sleep on the lock before the next one. */
+		P(hostarted);
+		clocksleep_ticks(2);
+	}
+	lock_release(hotlock);
+
+	lock_acquire(hotlock);
+	if (hocount != NHANDOFF) {
+		panic("lockhandofftest: got the lock back after %u of %u "
+		      "waiters\n", hocount, NHANDOFF);
+	}
+	for (i=0; i<NHANDOFF; i++) {
+		if (hoorder[i] != i) {
+			panic("lockhandofftest: waiter %u got the lock in "
+			      "place %u\n", hoorder[i], i);
+		}
+	}
+	lock_release(hotlock);
+
+	for (i=0; i<NHANDOFF; i++) {
+		P(hodone);
+	}
+
+	lock_destroy(hotlock);
+	sem_destroy(hostarted);
+	sem_destroy(hodone);
+	hotlock = NULL;
+	hostarted = hodone = NULL;
+
+	kprintf("Lock handoff test done.\n");
+	return 0;
+}
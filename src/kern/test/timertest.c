@@ -0,0 +1,214 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Timer wheel and timed wait tests.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <lib.h>
+#include <synch.h>
+#include <thread.h>
+#include <clock.h>
+#include <test.h>
+
+#define TESTTICKS	10
+
+static volatile unsigned fired;
+
+static
+void
+tmt_fire(void *vsem)
+{
+	struct semaphore *sem = vsem;
+
+	fired++;
+	V(sem);
+}
+
+/*
+ * Re-arm, then cancel ourselves from inside the function; timeout_del
+ * mustn't wait for the call it's made from.
+ */
+static struct timeout tmt_selfto;
+
+static
+void
+tmt_selfcancel(void *vsem)
+{
+	struct semaphore *sem = vsem;
+
+	timeout_add(&tmt_selfto, TESTTICKS);
+	if (!timeout_del(&tmt_selfto)) {
+		panic("timertest: self-cancel found timeout not armed\n");
+	}
+	fired++;
+	V(sem);
+}
+
+/*
+ * Check that a wait lasted at least TICKS hardclocks and not absurdly
+ * longer.
+ */
+static
+void
+tmt_checkelapsed(const char *what, unsigned start, unsigned ticks)
+{
+	unsigned elapsed;
+
+	elapsed = timeout_ticks() - start;
+	kprintf("%s: %u ticks (wanted %u)\n", what, elapsed, ticks);
+	if (elapsed < ticks || elapsed > ticks + HZ) {
+		panic("timertest: %s took %u ticks, expected %u\n",
+		      what, elapsed, ticks);
+	}
+}
+
+static
+void
+tmt_lockthread(void *vlock, unsigned long vsem)
+{
+	struct lock *lock = vlock;
+	struct semaphore *sem = (struct semaphore *)vsem;
+	unsigned start;
+	int result;
+
+	start = timeout_ticks();
+	result = lock_acquire_timeout(lock, TESTTICKS);
+	if (result != ETIMEDOUT) {
+		panic("timertest: lock_acquire_timeout got %d\n", result);
+	}
+	tmt_checkelapsed("lock_acquire_timeout", start, TESTTICKS);
+	V(sem);
+}
+
+int
+timertest(int nargs, char **args)
+{
+	struct timeout to;
+	struct semaphore *sem;
+	struct lock *lock;
+	struct cv *cv;
+	unsigned start;
+	int result;
+
+	(void)nargs;
+	(void)args;
+
+	sem = sem_create("timertest", 0);
+	lock = lock_create("timertest");
+	cv = cv_create("timertest");
+	if (sem == NULL || lock == NULL || cv == NULL) {
+		panic("timertest: out of memory\n");
+	}
+
+	kprintf("Starting timer test...\n");
+
+	/* A timeout fires once, on time. */
+	fired = 0;
+	timeout_init(&to, tmt_fire, sem);
+	start = timeout_ticks();
+	timeout_add(&to, TESTTICKS);
+	P(sem);
+	tmt_checkelapsed("timeout", start, TESTTICKS);
+	if (timeout_del(&to) || fired != 1) {
+		panic("timertest: timeout still armed or fired %u times\n",
+		      fired);
+	}
+
+	/* A cancelled timeout doesn't fire. */
+	timeout_add(&to, TESTTICKS);
+	if (!timeout_del(&to)) {
+		panic("timertest: timeout_del of armed timeout failed\n");
+	}
+	clocksleep_ticks(2 * TESTTICKS);
+	if (fired != 1) {
+		panic("timertest: cancelled timeout fired\n");
+	}
+
+	/* A timeout can cancel itself. */
+	timeout_init(&tmt_selfto, tmt_selfcancel, sem);
+	timeout_add(&tmt_selfto, 1);
+	P(sem);
+	clocksleep_ticks(2 * TESTTICKS);
+	if (fired != 2) {
+		panic("timertest: self-cancelled timeout fired again\n");
+	}
+
+	/* Timeouts more than once around the wheel. */
+	start = timeout_ticks();
+	timeout_add(&to, 3 * HZ);
+	P(sem);
+	tmt_checkelapsed("long timeout", start, 3 * HZ);
+
+	/* clocksleep_ticks */
+	start = timeout_ticks();
+	clocksleep_ticks(TESTTICKS);
+	tmt_checkelapsed("clocksleep_ticks", start, TESTTICKS);
+
+	/* P_timeout: times out when empty, succeeds when not. */
+	start = timeout_ticks();
+	result = P_timeout(sem, TESTTICKS);
+	if (result != ETIMEDOUT) {
+		panic("timertest: P_timeout on empty sem got %d\n", result);
+	}
+	tmt_checkelapsed("P_timeout", start, TESTTICKS);
+	V(sem);
+	result = P_timeout(sem, TESTTICKS);
+	if (result != 0) {
+		panic("timertest: P_timeout on full sem got %d\n", result);
+	}
+
+	/* cv_wait_timeout times out with the lock held again. */
+	lock_acquire(lock);
+	start = timeout_ticks();
+	result = cv_wait_timeout(cv, lock, TESTTICKS);
+	if (result != ETIMEDOUT || !lock_do_i_hold(lock)) {
+		panic("timertest: cv_wait_timeout got %d\n", result);
+	}
+	tmt_checkelapsed("cv_wait_timeout", start, TESTTICKS);
+
+	/* lock_acquire_timeout times out while we hold the lock. */
+	result = thread_fork("timertest", NULL, tmt_lockthread, lock,
+			     (unsigned long)sem);
+	if (result) {
+		panic("timertest: thread_fork failed: %s\n",
+		      strerror(result));
+	}
+	P(sem);
+	lock_release(lock);
+
+	cv_destroy(cv);
+	lock_destroy(lock);
+	sem_destroy(sem);
+
+	kprintf("Timer test done.\n");
+	return 0;
+}
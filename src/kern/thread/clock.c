@@ -34,13 +34,22 @@
 #include <clock.h>
 #include <thread.h>
 #include <current.h>
+#include <mainbus.h>
+#include <schedstat.h>
 
 /*
  * Time handling.
  *
- * This is pretty primitive. A real kernel will typically have some
- * kind of support for scheduling callbacks to happen at specific
- * points in the future, usually with more resolution than one second.
+ * Callbacks can be scheduled for specific points in the future with
+ * struct timeout; these are kept in a hashed timer wheel that's
+ * advanced by hardclock() on cpu 0, so the resolution is 1/HZ.
+ *
+ * Idle cpus don't take periodic hardclocks ("tickless idle"): the
+ * idle loop calls hardclock_idle(), which reprograms the cpu's timer
+ * for the next time it has something to do, and hardclock_unidle()
+ * when it wakes up. For cpu 0 that's the next timeout due; the
+ * others have nothing periodic to do while idle and sleep until
+ * woken by an IPI.
  *
  * A real kernel also has to maintain the time of day; in OS/161 we
  * skimp on that because we have a known-good hardware clock.
@@ -52,6 +61,7 @@
  */
 #define SCHEDULE_HARDCLOCKS	4	/* Reschedule every 4 hardclocks. */
 #define MIGRATE_HARDCLOCKS	16	/* Migrate every 16 hardclocks. */
+#define IDLE_MAXHARDCLOCKS	(10*HZ)	/* Longest tickless idle. */
 
 /*
  * Once a second, everything waiting on lbolt is awakened by CPU 0.
@@ -59,6 +69,47 @@
 static struct wchan *lbolt;
 static struct spinlock lbolt_lock;
 
+/*
+ * The timer wheel. Timeouts are hashed into buckets by expiry tick;
+ * each tick we look at one bucket and fire whatever in it is due.
+ * Timeouts further out than one trip around the wheel just stay put
+ * until their turn comes around again.
+ *
+ * Ticks are counted from the real-time clock rather than by counting
+ * hardclocks, so that when cpu 0 comes back from tickless idle it
+ * knows how far to catch up, and so that other cpus get the right
+ * time while it's asleep. timeout_done is the last tick whose bucket
+ * has been processed.
+ *
+ * timeout_running is the timeout whose function is being called
+ * right now (with timeout_lock dropped), so timeout_del can wait
+ * for it, and timeout_runcpu is the cpu calling it, so a function
+ * that cancels itself doesn't wait for itself.
+ *
+ * While cpu 0 is in tickless idle, timeout_keeperidle is set and
+ * timeout_keeperwake is the tick it'll wake up at; anyone adding an
+ * earlier timeout has to wake it up.
+ */
+#define TIMEOUT_WHEELSIZE	256	/* Must be a power of 2. */
+#define TIMEOUT_BUCKET(tick)	((tick) & (TIMEOUT_WHEELSIZE - 1))
+
+static struct timeout *timeout_wheel[TIMEOUT_WHEELSIZE];
+static unsigned timeout_npending;
+static unsigned timeout_done;
+static struct timeout *volatile timeout_running;
+static struct cpu *timeout_runcpu;
+static struct cpu *timeout_keeper;
+static bool timeout_keeperidle;
+static unsigned timeout_keeperwake;
+static struct spinlock timeout_lock;
+
+/*
+ * Sleep channel for clocksleep_ticks. Nobody ever wakes it; the
+ * sleepers' timeouts do.
+ */
+static struct wchan *tsleep_wchan;
+static struct spinlock tsleep_lock;
+
 /*
  * Setup.
  */
@@ -66,10 +117,283 @@ void
 hardclock_bootstrap(void)
 {
 	spinlock_init(&lbolt_lock);
+	spinlock_setname(&lbolt_lock, "lbolt");
 	lbolt = wchan_create("lbolt");
 	if (lbolt == NULL) {
 		panic("Couldn't create lbolt\n");
 	}
+
+	spinlock_init(&timeout_lock);
+	spinlock_setname(&timeout_lock, "timeout");
+
+	spinlock_init(&tsleep_lock);
+	spinlock_setname(&tsleep_lock, "tsleep");
+	tsleep_wchan = wchan_create("tsleep");
+	if (tsleep_wchan == NULL) {
+		panic("Couldn't create tsleep wchan\n");
+	}
+}
+
+/*
+ * Timeouts.
+ */
+
+void
+timeout_init(struct timeout *to, void (*func)(void *), void *data)
+{
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+	to->to_expire = 0;
+	to->to_pending = false;
+	to->to_func = func;
+	to->to_data = data;
+}
+
+/*
+ * Take TO off its bucket. Call with timeout_lock held.
+ */
+static
+void
+timeout_unlink(struct timeout *to)
+{
+	KASSERT(to->to_pending);
+
+	*to->to_prevp = to->to_next;
+	if (to->to_next != NULL) {
+		to->to_next->to_prevp = to->to_prevp;
+	}
+	to->to_next = NULL;
+	to->to_prevp = NULL;
+	to->to_pending = false;
+	timeout_npending--;
+}
+
+void
+timeout_add(struct timeout *to, unsigned ticks)
+{
+	struct timeout **bucket;
+
+	if (ticks == 0) {
+		ticks = 1;
+	}
+
+	spinlock_acquire(&timeout_lock);
+	if (to->to_pending) {
+		timeout_unlink(to);
+	}
+	to->to_expire = timeout_ticks() + ticks;
+	bucket = &timeout_wheel[TIMEOUT_BUCKET(to->to_expire)];
+	to->to_next = *bucket;
+	to->to_prevp = bucket;
+	if (*bucket != NULL) {
+		(*bucket)->to_prevp = &to->to_next;
+	}
+	*bucket = to;
+	to->to_pending = true;
+	timeout_npending++;
+
+	if (timeout_keeperidle &&
+	    (int)(to->to_expire - timeout_keeperwake) < 0) {
+		/* cpu 0 is asleep and would miss this; wake it up. */
+		timeout_keeperidle = false;
+		ipi_send(timeout_keeper, IPI_UNIDLE);
+	}
+	spinlock_release(&timeout_lock);
+}
+
+bool
+timeout_del(struct timeout *to)
+{
+	bool wasarmed;
+
+	spinlock_acquire(&timeout_lock);
+	while (timeout_running == to && timeout_runcpu != curcpu->c_self) {
+		/* It's firing on cpu 0 right now; wait for it. */
+		spinlock_release(&timeout_lock);
+		spinlock_acquire(&timeout_lock);
+	}
+	wasarmed = to->to_pending;
+	if (wasarmed) {
+		timeout_unlink(to);
+	}
+	spinlock_release(&timeout_lock);
+	return wasarmed;
+}
+
+/*
+ * The current tick, from the real-time clock. (This wraps, which is
+ * fine as long as ticks are only ever compared by subtracting.)
+ */
+unsigned
+timeout_ticks(void)
+{
+	struct timespec ts;
+
+	gettime(&ts);
+	return (unsigned)ts.tv_sec * HZ + ts.tv_nsec / (1000000000 / HZ);
+}
+
+/*
+ * Convert a duration to hardclocks, rounding up. Durations too long
+ * to represent (more than about eight months) are clamped, because
+ * the wheel compares ticks with wraparound.
+ */
+unsigned
+timespec_to_ticks(const struct timespec *ts)
+{
+	const uint64_t maxticks = 0x7fffffff;
+	const unsigned nsecs_per_tick = 1000000000 / HZ;
+	uint64_t ticks;
+
+	if (ts->tv_sec < 0) {
+		return 0;
+	}
+	if ((uint64_t)ts->tv_sec >= maxticks / HZ) {
+		return maxticks;
+	}
+	ticks = (uint64_t)ts->tv_sec * HZ;
+	ticks += DIVROUNDUP((unsigned)ts->tv_nsec, nsecs_per_tick);
+	return ticks > maxticks ? maxticks : ticks;
+}
+
+/*
+ * Bring the wheel up to the current tick and run whatever is due.
+ * Normally that's one bucket, but coming back from tickless idle it
+ * can be many; if it's more than the whole wheel, every bucket gets
+ * looked at once. Anything due by now is in a bucket between
+ * timeout_done and now, because expiry ticks are always in the
+ * future when timeouts are added.
+ *
+ * Each function is called with timeout_lock dropped, so it may arm
+ * or cancel timeouts (including itself); that also means the bucket
+ * can change under us, so start it over each time.
+ */
+static
+void
+timeout_run(void)
+{
+	struct timeout *to;
+	unsigned now, nbuckets, bucket;
+
+	now = timeout_ticks();
+
+	spinlock_acquire(&timeout_lock);
+	nbuckets = now - timeout_done;
+	if (nbuckets > TIMEOUT_WHEELSIZE) {
+		nbuckets = TIMEOUT_WHEELSIZE;
+	}
+	timeout_done = now;
+
+	for (bucket = now - nbuckets + 1; nbuckets > 0; bucket++, nbuckets--) {
+ again:
+		for (to = timeout_wheel[TIMEOUT_BUCKET(bucket)]; to != NULL;
+		     to = to->to_next) {
+			if ((int)(to->to_expire - now) > 0) {
+				/* Not this trip around. */
+				continue;
+			}
+			timeout_unlink(to);
+			timeout_running = to;
+			timeout_runcpu = curcpu->c_self;
+			spinlock_release(&timeout_lock);
+
+			to->to_func(to->to_data);
+
+			spinlock_acquire(&timeout_lock);
+			timeout_running = NULL;
+			timeout_runcpu = NULL;
+			goto again;
+		}
+	}
+	spinlock_release(&timeout_lock);
+}
+
+/*
+ * How long cpu 0 can sleep without missing a timeout, as of tick
+ * NOW. If it's going to, mark it idle so timeout_add knows to wake
+ * it for anything sooner.
+ */
+static
+unsigned
+timeout_idleticks(unsigned now)
+{
+	struct timeout *to;
+	unsigned ticks, i;
+	int left;
+
+	spinlock_acquire(&timeout_lock);
+	ticks = IDLE_MAXHARDCLOCKS;
+	if (timeout_npending > 0) {
+		for (i=0; i<TIMEOUT_WHEELSIZE; i++) {
+			for (to = timeout_wheel[i]; to != NULL;
+			     to = to->to_next) {
+				left = to->to_expire - now;
+				if (left < (int)ticks) {
+					ticks = left < 1 ? 1 : left;
+				}
+			}
+		}
+	}
+	if (ticks > 1) {
+		timeout_keeper = curcpu->c_self;
+		timeout_keeperidle = true;
+		timeout_keeperwake = now + ticks;
+	}
+	spinlock_release(&timeout_lock);
+	return ticks;
+}
+
+/*
+ * Tickless idle. Called from the idle loop with interrupts off,
+ * right before cpu_idle().
+ */
+void
+hardclock_idle(void)
+{
+	unsigned now, ticks;
+
+	KASSERT(curcpu->c_isidle);
+	KASSERT(!curcpu->c_tickless);
+
+	now = timeout_ticks();
+	if (curcpu->c_number == 0) {
+		ticks = timeout_idleticks(now);
+	}
+	else {
+		ticks = IDLE_MAXHARDCLOCKS;
+	}
+	if (ticks <= 1) {
+		/* Not worth it. */
+		return;
+	}
+
+	curcpu->c_tickless = true;
+	curcpu->c_idletick = now;
+	mainbus_settimer(ticks);
+}
+
+/*
+ * Come back from tickless idle: restart periodic hardclocks and
+ * catch up on the ones we skipped. Called from the idle loop when
+ * cpu_idle() returns, and from hardclock() if the timer went off
+ * first. Does nothing if we weren't tickless.
+ */
+void
+hardclock_unidle(void)
+{
+	if (!curcpu->c_tickless) {
+		return;
+	}
+	curcpu->c_tickless = false;
+	mainbus_settimer(1);
+
+	curcpu->c_hardclocks += timeout_ticks() - curcpu->c_idletick;
+	if (curcpu->c_number == 0) {
+		spinlock_acquire(&timeout_lock);
+		timeout_keeperidle = false;
+		spinlock_release(&timeout_lock);
+		timeout_run();
+	}
 }
 
 /*
@@ -92,11 +416,13 @@ timerclock(void)
 void
 hardclock(void)
 {
-	/*
-	 * Collect statistics here as desired.
-	 */
+	hardclock_unidle();
+	schedstat_hardclock();
 
 	curcpu->c_hardclocks++;
+	if (curcpu->c_number == 0) {
+		timeout_run();
+	}
 	if ((curcpu->c_hardclocks % MIGRATE_HARDCLOCKS) == 0) {
 		thread_consider_migration();
 	}
@@ -119,3 +445,27 @@ clocksleep(int num_secs)
 	}
 	spinlock_release(&lbolt_lock);
 }
+
+/*
+ * Suspend execution for the given number of hardclocks.
+ */
+void
+clocksleep_ticks(unsigned ticks)
+{
+	clocksleep_until(timeout_ticks() + ticks);
+}
+
+/*
+ * Suspend execution until the tick count reaches DEADLINE.
+ */
+void
+clocksleep_until(unsigned deadline)
+{
+	int remaining;
+
+	spinlock_acquire(&tsleep_lock);
+	while ((remaining = (int)(deadline - timeout_ticks())) > 0) {
+		wchan_sleep_timeout(tsleep_wchan, &tsleep_lock, remaining);
+	}
+	spinlock_release(&tsleep_lock);
+}
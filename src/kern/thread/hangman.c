@@ -37,7 +37,7 @@
 #include <spinlock.h>
 #include <hangman.h>
 
-static struct spinlock hangman_lock = SPINLOCK_INITIALIZER;
+static struct spinlock hangman_lock = SPINLOCK_NAMED_INITIALIZER("hangman");
 
 /*
  * Look for a path through the waits-for graph that goes from START to
@@ -180,3 +180,27 @@ hangman_release(struct hangman_actor *a,
 
 	spinlock_release(&hangman_lock);
 }
+
+/*
+ * Note that a has given up waiting for l without getting it.
+ */
+void
+hangman_cancel(struct hangman_actor *a,
+	       struct hangman_lockable *l)
+{
+	if (l == &hangman_lock.splk_hangman) {
+		/* don't recurse */
+		return;
+	}
+
+	spinlock_acquire(&hangman_lock);
+
+	if (a->a_waiting != l) {
+		spinlock_release(&hangman_lock);
+		panic("hangman_cancel: not waiting for lock %s (%p)\n",
+		      l->l_name, l);
+	}
+	a->a_waiting = NULL;
+
+	spinlock_release(&hangman_lock);
+}
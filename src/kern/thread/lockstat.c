@@ -0,0 +1,377 @@
+/*
+ * Copyright (c) 2015
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lock contention profiler.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <membar.h>
+#include <clock.h>
+#include <lockstat.h>
+
+/*
+ * Maximum number of distinct lock names we keep statistics for, and
+ * how much of each name we keep. Acquisitions of locks whose names
+ * don't fit in the table are lumped together under "(other)".
+ */
+#define LOCKSTAT_MAXCLASSES	128
+#define LOCKSTAT_NAMELEN	24
+
+struct lockstat_class {
+	char lc_name[LOCKSTAT_NAMELEN];
+	unsigned lc_acquires;		/* total acquisitions */
+	unsigned lc_contended;		/* acquisitions that had to wait */
+	uint64_t lc_waittime;		/* total ns spent waiting */
+	uint64_t lc_maxwait;		/* longest single wait, ns */
+	uint64_t lc_holdtime;		/* total ns held */
+	uint64_t lc_maxhold;		/* longest single hold, ns */
+};
+
+static struct lockstat_class lockstat_classes[LOCKSTAT_MAXCLASSES];
+static unsigned lockstat_numclasses;
+static volatile bool lockstat_enabled;
+
+/*
+ * The table is protected by a bare lock word rather than a struct
+ * spinlock, because acquiring a spinlock calls back into the hooks
+ * below (and into hangman's, which acquire another spinlock, which
+ * calls back into us...). The same goes for anything that might
+ * sleep, so no kmalloc here either.
+ */
+static volatile spinlock_data_t lockstat_word = SPINLOCK_DATA_INITIALIZER;
+
+static
+int
+lockstat_lock(void)
+{
+	int s;
+
+	s = splhigh();
+	while (1) {
+		if (spinlock_data_get(&lockstat_word) != 0) {
+			continue;
+		}
+		if (spinlock_data_testandset(&lockstat_word) != 0) {
+			continue;
+		}
+		break;
+	}
+	membar_store_any();
+	return s;
+}
+
+static
+void
+lockstat_unlock(int s)
+{
+	membar_any_store();
+	spinlock_data_set(&lockstat_word, 0);
+	splx(s);
+}
+
+/*
+ * Current time in nanoseconds. Never returns 0, since that's what
+ * the per-lock fields use for "not timed".
+ */
+static
+uint64_t
+lockstat_now(void)
+{
+	struct timespec ts;
+	uint64_t ns;
+
+	gettime(&ts);
+	ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	return ns == 0 ? 1 : ns;
+}
+
+/*
+ * Compare a lock name against a class name, which may have been
+ * truncated to fit.
+ */
+static
+bool
+lockstat_namematch(const char *classname, const char *name)
+{
+	unsigned i;
+
+	for (i=0; i<LOCKSTAT_NAMELEN - 1; i++) {
+		if (classname[i] != name[i]) {
+			return false;
+		}
+		if (classname[i] == 0) {
+			break;
+		}
+	}
+	return true;
+}
+
+/*
+ * Find (or make) the class for a lockable. Call with the table
+ * locked. The result is cached in the lockable; since HANGMAN_
+ * LOCKABLEINIT clears the cache, it stays right when the memory
+ * is reused for a different lock.
+ */
+static
+struct lockstat_class *
+lockstat_getclass(struct hangman_lockable *l)
+{
+	struct lockstat_class *lc;
+	unsigned i;
+
+	if (l->l_class != NULL) {
+		return l->l_class;
+	}
+
+	for (i=0; i<lockstat_numclasses; i++) {
+		lc = &lockstat_classes[i];
+		if (lockstat_namematch(lc->lc_name, l->l_name)) {
+			l->l_class = lc;
+			return lc;
+		}
+	}
+
+	if (lockstat_numclasses < LOCKSTAT_MAXCLASSES - 1) {
+		lc = &lockstat_classes[lockstat_numclasses++];
+		for (i=0; i<LOCKSTAT_NAMELEN - 1 && l->l_name[i]; i++) {
+			lc->lc_name[i] = l->l_name[i];
+		}
+		lc->lc_name[i] = 0;
+	}
+	else {
+		/* The last slot is the overflow bucket. */
+		lc = &lockstat_classes[LOCKSTAT_MAXCLASSES - 1];
+		strcpy(lc->lc_name, "(other)");
+	}
+	l->l_class = lc;
+	return lc;
+}
+
+/*
+ * Note that a is about to wait for l. If someone appears to hold it,
+ * this is a contended acquisition; start the wait clock. For
+ * spinlocks the check is unlocked and therefore only a hint, which
+ * is all we need for statistics.
+ */
+void
+lockstat_wait(struct hangman_actor *a, struct hangman_lockable *l)
+{
+	if (!lockstat_enabled || l->l_acquired == 0) {
+		a->a_waitstart = 0;
+		return;
+	}
+	a->a_waitstart = lockstat_now();
+}
+
+/*
+ * Note that a now holds l: charge the acquisition (and wait, if any)
+ * to l's class and start the hold clock.
+ */
+void
+lockstat_acquire(struct hangman_actor *a, struct hangman_lockable *l)
+{
+	struct lockstat_class *lc;
+	uint64_t now, wait;
+	int s;
+
+	if (!lockstat_enabled) {
+		a->a_waitstart = 0;
+		l->l_acquired = 0;
+		return;
+	}
+
+	now = lockstat_now();
+
+	s = lockstat_lock();
+	lc = lockstat_getclass(l);
+	lc->lc_acquires++;
+	if (a->a_waitstart != 0) {
+		wait = now - a->a_waitstart;
+		lc->lc_contended++;
+		lc->lc_waittime += wait;
+		if (wait > lc->lc_maxwait) {
+			lc->lc_maxwait = wait;
+		}
+	}
+	lockstat_unlock(s);
+
+	a->a_waitstart = 0;
+	l->l_acquired = now;
+}
+
+/*
+ * Note that a is releasing l: charge the hold time. Locks taken
+ * while collection was off have l_acquired == 0 and are skipped.
+ */
+void
+lockstat_release(struct hangman_actor *a, struct hangman_lockable *l)
+{
+	struct lockstat_class *lc;
+	uint64_t hold;
+	int s;
+
+	(void)a;
+
+	if (l->l_acquired == 0) {
+		return;
+	}
+	hold = lockstat_now() - l->l_acquired;
+	l->l_acquired = 0;
+
+	s = lockstat_lock();
+	lc = lockstat_getclass(l);
+	lc->lc_holdtime += hold;
+	if (hold > lc->lc_maxhold) {
+		lc->lc_maxhold = hold;
+	}
+	lockstat_unlock(s);
+}
+
+/*
+ * Note that a gave up waiting for l. The wait isn't charged to
+ * anyone, since there was no acquisition.
+ */
+void
+lockstat_cancel(struct hangman_actor *a, struct hangman_lockable *l)
+{
+	(void)l;
+	a->a_waitstart = 0;
+}
+
+////////////////////////////////////////////////////////////
+// Control interface (from the menu)
+
+void
+lockstat_enable(bool on)
+{
+	lockstat_enabled = on;
+}
+
+/*
+ * Zero the counters. The names are kept, because locks out there
+ * have pointers to their class cached.
+ */
+void
+lockstat_clear(void)
+{
+	struct lockstat_class *lc;
+	unsigned i;
+	int s;
+
+	s = lockstat_lock();
+	for (i=0; i<LOCKSTAT_MAXCLASSES; i++) {
+		lc = &lockstat_classes[i];
+		lc->lc_acquires = 0;
+		lc->lc_contended = 0;
+		lc->lc_waittime = 0;
+		lc->lc_maxwait = 0;
+		lc->lc_holdtime = 0;
+		lc->lc_maxhold = 0;
+	}
+	lockstat_unlock(s);
+}
+
+/*
+ * Ordering for the report: most contended first, ties broken by
+ * total wait time, then by acquisitions.
+ */
+static
+bool
+lockstat_before(const struct lockstat_class *a,
+		const struct lockstat_class *b)
+{
+	if (a->lc_contended != b->lc_contended) {
+		return a->lc_contended > b->lc_contended;
+	}
+	if (a->lc_waittime != b->lc_waittime) {
+		return a->lc_waittime > b->lc_waittime;
+	}
+	return a->lc_acquires > b->lc_acquires;
+}
+
+/*
+ * Print the MAXCLASSES most contended lock classes. We work on a
+ * snapshot so we don't hold the table lock while printing (kprintf
+ * takes locks, and those would be counted as we went).
+ */
+void
+lockstat_dump(unsigned maxclasses)
+{
+	struct lockstat_class *snap, tmp;
+	unsigned num, i, j;
+	int s;
+
+	snap = kmalloc(LOCKSTAT_MAXCLASSES * sizeof(*snap));
+	if (snap == NULL) {
+		kprintf("lockstat: Out of memory\n");
+		return;
+	}
+
+	s = lockstat_lock();
+	num = lockstat_numclasses;
+	memcpy(snap, lockstat_classes, num * sizeof(*snap));
+	if (lockstat_classes[LOCKSTAT_MAXCLASSES - 1].lc_acquires > 0) {
+		snap[num++] = lockstat_classes[LOCKSTAT_MAXCLASSES - 1];
+	}
+	lockstat_unlock(s);
+
+	/* insertion sort; the table is small */
+	for (i=1; i<num; i++) {
+		tmp = snap[i];
+		for (j=i; j>0 && lockstat_before(&tmp, &snap[j-1]); j--) {
+			snap[j] = snap[j-1];
+		}
+		snap[j] = tmp;
+	}
+
+	if (maxclasses > num) {
+		maxclasses = num;
+	}
+
+	kprintf("lockstat: collection %s; %u classes; times in us\n",
+		lockstat_enabled ? "on" : "off", num);
+	kprintf("%-23s %9s %9s %10s %8s %10s %8s\n", "class",
+		"acquires", "contended", "wait", "maxwait", "hold",
+		"maxhold");
+	for (i=0; i<maxclasses; i++) {
+		kprintf("%-23s %9u %9u %10llu %8llu %10llu %8llu\n",
+			snap[i].lc_name,
+			snap[i].lc_acquires, snap[i].lc_contended,
+			(unsigned long long)(snap[i].lc_waittime / 1000),
+			(unsigned long long)(snap[i].lc_maxwait / 1000),
+			(unsigned long long)(snap[i].lc_holdtime / 1000),
+			(unsigned long long)(snap[i].lc_maxhold / 1000));
+	}
+
+	kfree(snap);
+}
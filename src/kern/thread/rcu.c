@@ -0,0 +1,238 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Read-copy-update. See rcu.h for the interface.
+ *
+ * thread_switch bumps curcpu->c_rcu_qs every time it runs (it refuses
+ * to switch away from a thread inside a read section), so if a cpu's
+ * counter has moved, or the cpu is idle, any read section that was
+ * running there earlier has finished.
+ *
+ * Retired objects are queued on rcu_pending. The rcu thread takes the
+ * whole queue as a batch, snapshots every cpu's counter, polls once a
+ * tick until each one has moved, and then runs the batch's callbacks
+ * in the order they were queued.
+ */
+
+#include <types.h>
+#include <lib.h>
+#include <cpu.h>
+#include <spl.h>
+#include <spinlock.h>
+#include <wchan.h>
+#include <thread.h>
+#include <current.h>
+#include <clock.h>
+#include <rcu.h>
+
+static struct spinlock rcu_lock = SPINLOCK_NAMED_INITIALIZER("rcu");
+static struct wchan *rcu_wchan;		/* rcu thread waits for work here */
+static struct wchan *rcu_syncwchan;	/* synchronize_rcu callers */
+static struct rcu_head *rcu_pending;
+static struct rcu_head **rcu_pendingtail = &rcu_pending;
+
+/* Counter snapshot; only touched by the rcu thread. */
+static unsigned *rcu_snap;
+static unsigned rcu_nsnap;
+
+////////////////////////////////////////////////////////////
+// readers
+
+void
+rcu_read_lock(void)
+{
+	/* An idle cpu is taken to be quiescent; see rcu_wait_grace. */
+	KASSERT(!curthread->t_in_interrupt);
+	curthread->t_rcu_nest++;
+}
+
+void
+rcu_read_unlock(void)
+{
+	KASSERT(curthread->t_rcu_nest > 0);
+	curthread->t_rcu_nest--;
+}
+
+////////////////////////////////////////////////////////////
+// writers
+
+void
+call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *))
+{
+	head->rh_next = NULL;
+	head->rh_func = func;
+
+	spinlock_acquire(&rcu_lock);
+	*rcu_pendingtail = head;
+	rcu_pendingtail = &head->rh_next;
+	/* Before rcu_bootstrap, just queue; the rcu thread will find it. */
+	if (rcu_wchan != NULL) {
+		wchan_wakeone(rcu_wchan, &rcu_lock);
+	}
+	spinlock_release(&rcu_lock);
+}
+
+struct rcu_sync {
+	struct rcu_head rs_head;	/* must come first */
+	volatile bool rs_done;
+};
+
+static
+void
+rcu_sync_done(struct rcu_head *head)
+{
+	struct rcu_sync *rs = (struct rcu_sync *)head;
+
+	spinlock_acquire(&rcu_lock);
+	rs->rs_done = true;
+	wchan_wakeall(rcu_syncwchan, &rcu_lock);
+	spinlock_release(&rcu_lock);
+}
+
+void
+synchronize_rcu(void)
+{
+	struct rcu_sync rs;
+
+	KASSERT(curthread->t_rcu_nest == 0);
+	KASSERT(rcu_syncwchan != NULL);
+
+	rs.rs_done = false;
+	call_rcu(&rs.rs_head, rcu_sync_done);
+
+	spinlock_acquire(&rcu_lock);
+	while (!rs.rs_done) {
+		wchan_sleep(rcu_syncwchan, &rcu_lock);
+	}
+	spinlock_release(&rcu_lock);
+}
+
+////////////////////////////////////////////////////////////
+// grace periods
+
+/*
+ * Wait until every cpu has been through a quiescent state. The cpu
+ * we take the snapshot on counts as one already: we're running there,
+ * and readers aren't preempted.
+ */
+static
+void
+rcu_wait_grace(void)
+{
+	unsigned i, num, self;
+	struct cpu *c;
+	bool done;
+	int spl;
+
+	num = cpu_count();
+	KASSERT(num <= rcu_nsnap);
+
+	spl = splhigh();
+	self = curcpu->c_number;
+	for (i=0; i<num; i++) {
+		rcu_snap[i] = cpu_bynumber(i)->c_rcu_qs;
+	}
+	splx(spl);
+
+	while (1) {
+		done = true;
+		for (i=0; i<num; i++) {
+			if (i == self) {
+				continue;
+			}
+			c = cpu_bynumber(i);
+			if (c->c_rcu_qs == rcu_snap[i] && !c->c_isidle) {
+				done = false;
+				break;
+			}
+		}
+		if (done) {
+			break;
+		}
+		clocksleep_ticks(1);
+	}
+}
+
+static
+void
+rcu_thread(void *data1, unsigned long data2)
+{
+	struct rcu_head *batch, *next;
+
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		spinlock_acquire(&rcu_lock);
+		while (rcu_pending == NULL) {
+			wchan_sleep(rcu_wchan, &rcu_lock);
+		}
+		batch = rcu_pending;
+		rcu_pending = NULL;
+		rcu_pendingtail = &rcu_pending;
+		spinlock_release(&rcu_lock);
+
+		rcu_wait_grace();
+
+		while (batch != NULL) {
+			/* The callback may free the head. */
+			next = batch->rh_next;
+			batch->rh_func(batch);
+			batch = next;
+		}
+	}
+}
+
+void
+rcu_bootstrap(void)
+{
+	int result;
+
+	rcu_nsnap = cpu_count();
+	rcu_snap = kmalloc(rcu_nsnap * sizeof(rcu_snap[0]));
+	if (rcu_snap == NULL) {
+		panic("rcu_bootstrap: Out of memory\n");
+	}
+
+	rcu_syncwchan = wchan_create("rcu_sync");
+	if (rcu_syncwchan == NULL) {
+		panic("rcu_bootstrap: Out of memory\n");
+	}
+
+	rcu_wchan = wchan_create("rcu");
+	if (rcu_wchan == NULL) {
+		panic("rcu_bootstrap: Out of memory\n");
+	}
+
+	result = thread_fork("rcu", NULL, rcu_thread, NULL, 0);
+	if (result) {
+		panic("rcu_bootstrap: thread_fork: %s\n", strerror(result));
+	}
+}
@@ -0,0 +1,404 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Scheduler statistics: timing, reports, and the schedstat: device.
+ * The counters themselves are kept by thread.c; see schedstat.h.
+ */
+
+#include <types.h>
+#include <kern/errno.h>
+#include <kern/time.h>
+#include <lib.h>
+#include <uio.h>
+#include <cpu.h>
+#include <spinlock.h>
+#include <thread.h>
+#include <threadlist.h>
+#include <current.h>
+#include <clock.h>
+#include <vfs.h>
+#include <device.h>
+#include <schedstat.h>
+
+/* Size of a report, and the most threads listed in one. */
+#define SCHEDSTAT_BUFSIZE	8192
+#define SCHEDSTAT_MAXTHREADS	48
+
+/* Names for the IPI columns, indexed by IPI code. */
+static const char *const schedstat_ipinames[CPU_NIPICODES] = {
+	"panic", "offline", "unidle", "tlb", "call",
+};
+
+static volatile bool schedstat_timing;
+
+/*
+ * Snapshot of what a report says about one thread, taken under the
+ * run queue lock so it can be printed without it.
+ */
+struct schedstat_thread {
+	char st_name[16];
+	unsigned st_cpu;
+	bool st_running;
+	uint64_t st_runtime;
+	uint64_t st_waittime;
+};
+
+////////////////////////////////////////////////////////////
+// Hooks
+
+/*
+ * Current time in nanoseconds. Returns 0 until timing starts, and
+ * never afterwards, since 0 in t_stamp means "not timed".
+ */
+uint64_t
+schedstat_now(void)
+{
+	struct timespec ts;
+	uint64_t ns;
+
+	if (!schedstat_timing) {
+		return 0;
+	}
+	gettime(&ts);
+	ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	return ns == 0 ? 1 : ns;
+}
+
+/*
+ * Sample the run queue length. Called from hardclock, so idle cpus
+ * that have stopped their clock don't sample; their queues are empty
+ * anyway.
+ */
+void
+schedstat_hardclock(void)
+{
+	unsigned len;
+
+	len = curcpu->c_runqueue.tl_count;
+	if (len >= CPU_RQHIST) {
+		len = CPU_RQHIST - 1;
+	}
+	curcpu->c_rqhist[len]++;
+}
+
+void
+schedstat_clearcpu(struct cpu *c)
+{
+	unsigned i;
+
+	c->c_sw_voluntary = 0;
+	c->c_sw_preempt = 0;
+	for (i=0; i<CPU_RQHIST; i++) {
+		c->c_rqhist[i] = 0;
+	}
+	c->c_migrate_in = 0;
+	c->c_migrate_out = 0;
+	for (i=0; i<CPU_NIPICODES; i++) {
+		c->c_ipi_sent[i] = 0;
+		c->c_ipi_recv[i] = 0;
+	}
+	c->c_ipi_coalesced = 0;
+	c->c_wakeups = 0;
+	c->c_wakelat = 0;
+	c->c_wakelat_max = 0;
+}
+
+/*
+ * Zero every cpu's counters. Other cpus may be updating theirs as we
+ * go; an increment lost here or there doesn't matter.
+ */
+void
+schedstat_clear(void)
+{
+	unsigned i, num;
+
+	num = cpu_count();
+	for (i=0; i<num; i++) {
+		schedstat_clearcpu(cpu_bynumber(i));
+	}
+}
+
+////////////////////////////////////////////////////////////
+// Reports
+
+/*
+ * Advance the position in a report buffer of length LEN by N (the
+ * return value of snprintf), stopping at the terminating null.
+ */
+static
+size_t
+schedstat_advance(size_t pos, size_t len, int n)
+{
+	pos += n;
+	return pos < len ? pos : len - 1;
+}
+
+static
+void
+schedstat_snapthread(struct schedstat_thread *st, struct cpu *c,
+		     struct thread *t, uint64_t now)
+{
+	snprintf(st->st_name, sizeof(st->st_name), "%s", t->t_name);
+	st->st_cpu = c->c_number;
+	st->st_running = t == c->c_curthread;
+	st->st_runtime = t->t_runtime;
+	st->st_waittime = t->t_waittime;
+	if (t->t_stamp != 0 && now > t->t_stamp) {
+		/* Include the current slice (or wait) so far. */
+		if (st->st_running) {
+			st->st_runtime += now - t->t_stamp;
+		}
+		else {
+			st->st_waittime += now - t->t_stamp;
+		}
+	}
+}
+
+/*
+ * Report on cpu C into BUF, collecting its running and queued threads
+ * into THREADS (*NUMTHREADS of SCHEDSTAT_MAXTHREADS used so far).
+ */
+static
+size_t
+schedstat_reportcpu(char *buf, size_t len, size_t pos, struct cpu *c,
+		    struct schedstat_thread *threads, unsigned *numthreads)
+{
+	struct threadlistnode *tln;
+	struct schedstat_thread idle;
+	uint64_t now;
+	unsigned i;
+
+	now = schedstat_now();
+	spinlock_acquire(&c->c_runqueue_lock);
+	schedstat_snapthread(&idle, c, c->c_idlethread, now);
+	if (c->c_curthread != c->c_idlethread &&
+	    *numthreads < SCHEDSTAT_MAXTHREADS) {
+		schedstat_snapthread(&threads[(*numthreads)++], c,
+				     c->c_curthread, now);
+	}
+	for (tln = c->c_runqueue.tl_head.tln_next;
+	     tln->tln_self != NULL && *numthreads < SCHEDSTAT_MAXTHREADS;
+	     tln = tln->tln_next) {
+		schedstat_snapthread(&threads[(*numthreads)++], c,
+				     tln->tln_self, now);
+	}
+	spinlock_release(&c->c_runqueue_lock);
+
+	pos = schedstat_advance(pos, len, snprintf(buf + pos, len - pos,
+		"cpu%u: switches %u voluntary, %u preempted; idle %llu ms\n",
+		c->c_number, c->c_sw_voluntary, c->c_sw_preempt,
+		(unsigned long long)(idle.st_runtime / 1000000)));
+
+	pos = schedstat_advance(pos, len, snprintf(buf + pos, len - pos,
+		"cpu%u: runqueue length", c->c_number));
+	for (i=0; i<CPU_RQHIST; i++) {
+		pos = schedstat_advance(pos, len, snprintf(buf + pos,
+			len - pos, " %u%s:%u", i,
+			i == CPU_RQHIST - 1 ? "+" : "", c->c_rqhist[i]));
+	}
+
+	pos = schedstat_advance(pos, len, snprintf(buf + pos, len - pos,
+		"\ncpu%u: migrations %u in, %u out\ncpu%u: ipis sent/recv",
+		c->c_number, c->c_migrate_in, c->c_migrate_out,
+		c->c_number));
+	for (i=0; i<CPU_NIPICODES; i++) {
+		pos = schedstat_advance(pos, len, snprintf(buf + pos,
+			len - pos, " %s %u/%u", schedstat_ipinames[i],
+			c->c_ipi_sent[i], c->c_ipi_recv[i]));
+	}
+	pos = schedstat_advance(pos, len, snprintf(buf + pos, len - pos,
+		"; %u coalesced", c->c_ipi_coalesced));
+
+	pos = schedstat_advance(pos, len, snprintf(buf + pos, len - pos,
+		"\ncpu%u: wakeups %u, latency avg %llu us, max %llu us\n",
+		c->c_number, c->c_wakeups,
+		(unsigned long long)(c->c_wakeups == 0 ? 0 :
+				     c->c_wakelat / c->c_wakeups / 1000),
+		(unsigned long long)(c->c_wakelat_max / 1000)));
+
+	return pos;
+}
+
+/*
+ * Format a full report into BUF, returning its length. Only running
+ * and runnable threads are listed; sleeping ones aren't on any list
+ * we can get at.
+ */
+static
+size_t
+schedstat_report(char *buf, size_t len)
+{
+	struct schedstat_thread *threads;
+	unsigned i, num, numthreads;
+	size_t pos;
+
+	KASSERT(len > 0);
+	buf[0] = 0;
+
+	threads = kmalloc(SCHEDSTAT_MAXTHREADS * sizeof(*threads));
+	if (threads == NULL) {
+		return 0;
+	}
+	numthreads = 0;
+
+	pos = 0;
+	num = cpu_count();
+	for (i=0; i<num; i++) {
+		pos = schedstat_reportcpu(buf, len, pos, cpu_bynumber(i),
+					  threads, &numthreads);
+	}
+
+	pos = schedstat_advance(pos, len, snprintf(buf + pos, len - pos,
+		"%-16s %3s %5s %10s %10s\n",
+		"thread", "cpu", "state", "run ms", "wait ms"));
+	for (i=0; i<numthreads; i++) {
+		pos = schedstat_advance(pos, len, snprintf(buf + pos,
+			len - pos, "%-16s %3u %5s %10llu %10llu\n",
+			threads[i].st_name, threads[i].st_cpu,
+			threads[i].st_running ? "run" : "ready",
+			(unsigned long long)(threads[i].st_runtime / 1000000),
+			(unsigned long long)(threads[i].st_waittime / 1000000)));
+	}
+
+	kfree(threads);
+	return pos;
+}
+
+/*
+ * Print a report on the console (for the menu).
+ */
+void
+schedstat_dump(void)
+{
+	char *buf;
+
+	buf = kmalloc(SCHEDSTAT_BUFSIZE);
+	if (buf == NULL) {
+		kprintf("schedstat: Out of memory\n");
+		return;
+	}
+	schedstat_report(buf, SCHEDSTAT_BUFSIZE);
+	kprintf("%s", buf);
+	kfree(buf);
+}
+
+////////////////////////////////////////////////////////////
+// schedstat: device
+
+static
+int
+schedstat_eachopen(struct device *dev, int openflags)
+{
+	(void)dev;
+	(void)openflags;
+
+	return 0;
+}
+
+/*
+ * Reads generate a fresh report each time and return the part of it
+ * at the requested offset, so reading from the start to EOF gives a
+ * whole (if not exactly consistent) report. Writes clear the counters.
+ */
+static
+int
+schedstat_io(struct device *dev, struct uio *uio)
+{
+	char *buf;
+	size_t len;
+	int result;
+
+	(void)dev;
+
+	if (uio->uio_rw == UIO_WRITE) {
+		schedstat_clear();
+		uio->uio_resid = 0;
+		return 0;
+	}
+
+	buf = kmalloc(SCHEDSTAT_BUFSIZE);
+	if (buf == NULL) {
+		return ENOMEM;
+	}
+	len = schedstat_report(buf, SCHEDSTAT_BUFSIZE);
+
+	result = 0;
+	if (uio->uio_offset < (off_t)len) {
+		result = uiomove(buf + uio->uio_offset,
+				 len - uio->uio_offset, uio);
+	}
+	kfree(buf);
+	return result;
+}
+
+static
+int
+schedstat_ioctl(struct device *dev, int op, userptr_t data)
+{
+	(void)dev;
+	(void)op;
+	(void)data;
+
+	return EINVAL;
+}
+
+static const struct device_ops schedstat_devops = {
+	.devop_eachopen = schedstat_eachopen,
+	.devop_io = schedstat_io,
+	.devop_ioctl = schedstat_ioctl,
+};
+
+/*
+ * Start timing and attach schedstat:.
+ */
+void
+schedstat_bootstrap(void)
+{
+	struct device *dev;
+	int result;
+
+	schedstat_timing = true;
+
+	dev = kmalloc(sizeof(*dev));
+	if (dev == NULL) {
+		panic("schedstat_bootstrap: Out of memory\n");
+	}
+	dev->d_ops = &schedstat_devops;
+	dev->d_blocks = 0;
+	dev->d_blocksize = 1;
+	dev->d_devnumber = 0; /* assigned by vfs_adddev */
+	dev->d_data = NULL;
+
+	result = vfs_adddev("schedstat", dev, 0);
+	if (result) {
+		panic("schedstat_bootstrap: vfs_adddev: %s\n",
+		      strerror(result));
+	}
+}
@@ -41,6 +41,17 @@
 
 /*
  * Spinlocks.
+ *
+ * There are two implementations of the lock word, chosen with
+ * "options ticketlock" in the kernel config. The default is
+ * test-and-test-and-set, which is simple but unfair: whichever cpu
+ * happens to win the race after a release gets the lock, and every
+ * waiter hammers the same word with atomic operations. Ticket locks
+ * hand the lock off in arrival order and waiters only read while
+ * spinning, at the cost of an extra word per lock.
+ *
+ * Everything else (interrupt handling, holder tracking, deadlock
+ * detection) is the same either way.
  */
 
 
@@ -50,11 +61,28 @@
 void
 spinlock_init(struct spinlock *splk)
 {
+#if OPT_TICKETLOCK
+	spinlock_data_set(&splk->splk_next, 0);
+	spinlock_data_set(&splk->splk_owner, 0);
+#else
 	spinlock_data_set(&splk->splk_lock, 0);
+#endif
 	splk->splk_holder = NULL;
 	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, "spinlock");
 }
 
+#if OPT_HANGMAN || OPT_LOCKSTAT
+/*
+ * Name the spinlock for the benefit of hangman and lockstat. Call
+ * right after spinlock_init; the string must outlive the lock.
+ */
+void
+spinlock_setname(struct spinlock *splk, const char *name)
+{
+	HANGMAN_LOCKABLEINIT(&splk->splk_hangman, name);
+}
+#endif
+
 /*
  * Clean up spinlock.
  */
@@ -62,7 +90,12 @@ void
 spinlock_cleanup(struct spinlock *splk)
 {
 	KASSERT(splk->splk_holder == NULL);
+#if OPT_TICKETLOCK
+	KASSERT(spinlock_data_get(&splk->splk_next) ==
+		spinlock_data_get(&splk->splk_owner));
+#else
 	KASSERT(spinlock_data_get(&splk->splk_lock) == 0);
+#endif
 }
 
 /*
@@ -76,6 +109,9 @@ void
 spinlock_acquire(struct spinlock *splk)
 {
 	struct cpu *mycpu;
+#if OPT_TICKETLOCK
+	spinlock_data_t ticket;
+#endif
 
 	splraise(IPL_NONE, IPL_HIGH);
 
@@ -93,6 +129,17 @@ spinlock_acquire(struct spinlock *splk)
 		mycpu = NULL;
 	}
 
+#if OPT_TICKETLOCK
+	/*
+	 * Take a ticket and wait for our turn. Once we have the
+	 * ticket there's no backing out: everyone behind us is
+	 * waiting for us to take the lock and release it.
+	 */
+	ticket = spinlock_data_fetchinc(&splk->splk_next);
+	while (spinlock_data_get(&splk->splk_owner) != ticket) {
+		/* spin */
+	}
+#else
 	while (1) {
 		/*
 		 * Do test-test-and-set, that is, read first before
@@ -112,6 +159,7 @@ spinlock_acquire(struct spinlock *splk)
 		}
 		break;
 	}
+#endif
 
 	membar_store_any();
 	splk->splk_holder = mycpu;
@@ -137,7 +185,13 @@ spinlock_release(struct spinlock *splk)
 
 	splk->splk_holder = NULL;
 	membar_any_store();
+#if OPT_TICKETLOCK
+	/* Only the holder writes splk_owner, so no atomic op is needed. */
+	spinlock_data_set(&splk->splk_owner,
+			  spinlock_data_get(&splk->splk_owner) + 1);
+#else
 	spinlock_data_set(&splk->splk_lock, 0);
+#endif
 	spllower(IPL_HIGH, IPL_NONE);
 }
 
@@ -33,11 +33,13 @@
  */
 
 #include <types.h>
+#include <kern/errno.h>
 #include <lib.h>
 #include <spinlock.h>
 #include <wchan.h>
 #include <thread.h>
 #include <current.h>
+#include <clock.h>
 #include <synch.h>
 
 ////////////////////////////////////////////////////////////
@@ -68,7 +70,9 @@ sem_create(const char *name, unsigned initial_count)
 	}
 
 	spinlock_init(&sem->sem_lock);
+	spinlock_setname(&sem->sem_lock, sem->sem_name);
         sem->sem_count = initial_count;
+	sem->sem_handoff = false;
 
         return sem;
 }
@@ -100,6 +104,18 @@ P(struct semaphore *sem)
 
 	/* Use the semaphore spinlock to protect the wchan as well. */
 	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_handoff) {
+		/*
+		 * V leaves the count at 0 while anyone is waiting, and
+		 * gives it to the first waiter instead; so if we have
+		 * to sleep, being woken means we've got it.
+		 */
+		if (sem->sem_count == 0) {
+			wchan_sleep(sem->sem_wchan, &sem->sem_lock);
+			spinlock_release(&sem->sem_lock);
+			return;
+		}
+	}
         while (sem->sem_count == 0) {
 		/*
 		 *
@@ -108,10 +124,8 @@ P(struct semaphore *sem)
 		 * might "get" it on the first try even if other
 		 * threads are waiting. Apparently according to some
 		 * textbooks semaphores must for some reason have
-		 * strict ordering. Too bad. :-)
-		 *
-		 * Exercise: how would you implement strict FIFO
-		 * ordering?
+		 * strict ordering. Too bad. :-) Use handoff mode if
+		 * it matters.
 		 */
 		wchan_sleep(sem->sem_wchan, &sem->sem_lock);
         }
@@ -120,6 +134,51 @@ P(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+/*
+ * P with a timeout: give up after TICKS hardclocks. Returns 0 if we
+ * got the semaphore and ETIMEDOUT if not.
+ */
+int
+P_timeout(struct semaphore *sem, unsigned ticks)
+{
+	unsigned deadline;
+	int remaining;
+
+        KASSERT(sem != NULL);
+        KASSERT(curthread->t_in_interrupt == false);
+
+	deadline = timeout_ticks() + ticks;
+
+	spinlock_acquire(&sem->sem_lock);
+	if (sem->sem_handoff && sem->sem_count == 0) {
+		/*
+		 * As in P. If the timeout wakes us, V can't have picked
+		 * us, because the timeout takes us off the channel.
+		 */
+		remaining = deadline - timeout_ticks();
+		if (remaining <= 0 ||
+		    wchan_sleep_timeout(sem->sem_wchan, &sem->sem_lock,
+					remaining)) {
+			spinlock_release(&sem->sem_lock);
+			return ETIMEDOUT;
+		}
+		spinlock_release(&sem->sem_lock);
+		return 0;
+	}
+        while (sem->sem_count == 0) {
+		remaining = deadline - timeout_ticks();
+		if (remaining <= 0) {
+			spinlock_release(&sem->sem_lock);
+			return ETIMEDOUT;
+		}
+		wchan_sleep_timeout(sem->sem_wchan, &sem->sem_lock, remaining);
+        }
+        KASSERT(sem->sem_count > 0);
+        sem->sem_count--;
+	spinlock_release(&sem->sem_lock);
+	return 0;
+}
+
 void
 V(struct semaphore *sem)
 {
@@ -127,6 +186,16 @@ V(struct semaphore *sem)
 
 	spinlock_acquire(&sem->sem_lock);
 
+	if (sem->sem_handoff) {
+		/* Give it to the first waiter, if any; see P. */
+		if (wchan_wakeone(sem->sem_wchan, &sem->sem_lock) == NULL) {
+			sem->sem_count++;
+			KASSERT(sem->sem_count > 0);
+		}
+		spinlock_release(&sem->sem_lock);
+		return;
+	}
+
         sem->sem_count++;
         KASSERT(sem->sem_count > 0);
 	wchan_wakeone(sem->sem_wchan, &sem->sem_lock);
@@ -134,10 +203,208 @@ V(struct semaphore *sem)
 	spinlock_release(&sem->sem_lock);
 }
 
+void
+sem_set_handoff(struct semaphore *sem, bool on)
+{
+	KASSERT(sem != NULL);
+
+	spinlock_acquire(&sem->sem_lock);
+	KASSERT(wchan_isempty(sem->sem_wchan, &sem->sem_lock));
+	sem->sem_handoff = on;
+	spinlock_release(&sem->sem_lock);
+}
+
 ////////////////////////////////////////////////////////////
 //
 // Lock.
 
+/*
+ * Priority inheritance.
+ *
+ * Every lock that has waiters is on its holder's t_pilocks list,
+ * with lk_waitpri the highest priority among the waiters. A thread's
+ * effective priority is the highest of its base priority and the
+ * lk_waitpri of the locks on its list. A waiting thread records the
+ * lock in t_blockedon, so a boost can follow the chain from lock to
+ * holder to the lock that holder is waiting for, and so on.
+ *
+ * This state crosses locks, so it's protected by one global spinlock,
+ * which comes after lk_lock (and before the runqueue locks). Linking
+ * and unlinking a lock also happen under its lk_lock, so its holder
+ * can check lk_piowner without the global lock; and uncontended
+ * locks never touch it.
+ *
+ * A priority raised on behalf of a waiter that then gives up (timed
+ * out) isn't lowered again until the holder releases the lock.
+ */
+static struct spinlock lock_pi_lock = SPINLOCK_NAMED_INITIALIZER("lock_pi");
+
+/* Put LOCK on OWNER's list, if it isn't already. */
+static
+void
+lock_pi_link(struct lock *lock, struct thread *owner)
+{
+	KASSERT(spinlock_do_i_hold(&lock_pi_lock));
+
+	if (lock->lk_piowner == NULL) {
+		lock->lk_piowner = owner;
+		lock->lk_pinext = owner->t_pilocks;
+		owner->t_pilocks = lock;
+	}
+	KASSERT(lock->lk_piowner == owner);
+}
+
+/* Take LOCK off its owner's list. */
+static
+void
+lock_pi_unlink(struct lock *lock)
+{
+	struct lock **pp;
+
+	KASSERT(spinlock_do_i_hold(&lock_pi_lock));
+
+	pp = &lock->lk_piowner->t_pilocks;
+	while (*pp != lock) {
+		KASSERT(*pp != NULL);
+		pp = &(*pp)->lk_pinext;
+	}
+	*pp = lock->lk_pinext;
+	lock->lk_piowner = NULL;
+	lock->lk_pinext = NULL;
+	lock->lk_waitpri = THREAD_PRI_MIN;
+}
+
+/* Recompute T's effective priority from its base and its locks. */
+static
+void
+lock_pi_recompute(struct thread *t)
+{
+	struct lock *lock;
+	unsigned pri;
+
+	KASSERT(spinlock_do_i_hold(&lock_pi_lock));
+
+	pri = t->t_basepri;
+	for (lock = t->t_pilocks; lock != NULL; lock = lock->lk_pinext) {
+		if (lock->lk_waitpri > pri) {
+			pri = lock->lk_waitpri;
+		}
+	}
+	t->t_priority = pri;
+}
+
+/*
+ * Someone of priority PRI is waiting for LOCK: pass the priority to
+ * its holder, and on down the chain. This stops at the first thread
+ * that already runs at PRI or better, so it ends even if the chain
+ * is a deadlock cycle.
+ */
+static
+void
+lock_pi_boost(struct lock *lock, unsigned pri)
+{
+	struct thread *t;
+
+	KASSERT(spinlock_do_i_hold(&lock_pi_lock));
+
+	while (lock != NULL) {
+		if (lock->lk_waitpri < pri) {
+			lock->lk_waitpri = pri;
+		}
+		t = lock->lk_piowner;
+		if (t == NULL || t->t_priority >= pri) {
+			break;
+		}
+		t->t_priority = pri;
+		lock = t->t_blockedon;
+	}
+}
+
+/*
+ * About to wait for LOCK, whose lk_lock is held. Called before each
+ * sleep, since the holder may have changed since the last one.
+ */
+static
+void
+lock_pi_wait(struct lock *lock)
+{
+	spinlock_acquire(&lock_pi_lock);
+	curthread->t_blockedon = lock;
+	lock_pi_link(lock, lock->lk_holder);
+	lock_pi_boost(lock, curthread->t_priority);
+	spinlock_release(&lock_pi_lock);
+}
+
+/*
+ * Just got LOCK, whose lk_lock is held, maybe after waiting. If
+ * others are still waiting, inherit their priority.
+ */
+static
+void
+lock_pi_acquired(struct lock *lock)
+{
+	if (curthread->t_blockedon == NULL &&
+	    wchan_isempty(lock->lk_wchan, &lock->lk_lock)) {
+		/* The usual case. */
+		return;
+	}
+
+	spinlock_acquire(&lock_pi_lock);
+	curthread->t_blockedon = NULL;
+	if (!wchan_isempty(lock->lk_wchan, &lock->lk_lock)) {
+		lock_pi_link(lock, curthread);
+		lock->lk_waitpri = wchan_maxpriority(lock->lk_wchan,
+						     &lock->lk_lock);
+		if (lock->lk_waitpri > curthread->t_priority) {
+			curthread->t_priority = lock->lk_waitpri;
+		}
+	}
+	spinlock_release(&lock_pi_lock);
+}
+
+/*
+ * Gave up waiting for a lock.
+ */
+static
+void
+lock_pi_cancel(void)
+{
+	spinlock_acquire(&lock_pi_lock);
+	curthread->t_blockedon = NULL;
+	spinlock_release(&lock_pi_lock);
+}
+
+/*
+ * Releasing LOCK, whose lk_lock is held: drop anything inherited
+ * through it.
+ */
+static
+void
+lock_pi_release(struct lock *lock)
+{
+	if (lock->lk_piowner == NULL) {
+		return;
+	}
+
+	spinlock_acquire(&lock_pi_lock);
+	KASSERT(lock->lk_piowner == curthread);
+	lock_pi_unlink(lock);
+	lock_pi_recompute(curthread);
+	spinlock_release(&lock_pi_lock);
+}
+
+void
+lock_pi_setbasepri(struct thread *t, unsigned pri)
+{
+	spinlock_acquire(&lock_pi_lock);
+	t->t_basepri = pri;
+	lock_pi_recompute(t);
+	if (t->t_blockedon != NULL) {
+		lock_pi_boost(t->t_blockedon, t->t_priority);
+	}
+	spinlock_release(&lock_pi_lock);
+}
+
 struct lock *
 lock_create(const char *name)
 {
@@ -156,7 +423,19 @@ lock_create(const char *name)
 
 	HANGMAN_LOCKABLEINIT(&lock->lk_hangman, lock->lk_name);
 
-        // add stuff here as needed
+	lock->lk_wchan = wchan_create(lock->lk_name);
+	if (lock->lk_wchan == NULL) {
+		kfree(lock->lk_name);
+		kfree(lock);
+		return NULL;
+	}
+
+	spinlock_init(&lock->lk_lock);
+	lock->lk_holder = NULL;
+	lock->lk_handoff = false;
+	lock->lk_waitpri = THREAD_PRI_MIN;
+	lock->lk_piowner = NULL;
+	lock->lk_pinext = NULL;
 
         return lock;
 }
@@ -165,9 +444,12 @@ void
 lock_destroy(struct lock *lock)
 {
         KASSERT(lock != NULL);
+	KASSERT(lock->lk_holder == NULL);
+	KASSERT(lock->lk_piowner == NULL);
 
-        // add stuff here as needed
-
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&lock->lk_lock);
+	wchan_destroy(lock->lk_wchan);
         kfree(lock->lk_name);
         kfree(lock);
 }
@@ -175,36 +457,131 @@ lock_destroy(struct lock *lock)
 void
 lock_acquire(struct lock *lock)
 {
-	/* Call this (atomically) before waiting for a lock */
-	//HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
+	KASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
 
-        // Write this
+	spinlock_acquire(&lock->lk_lock);
+	if (lock->lk_holder == curthread) {
+		panic("Deadlock on lock %s\n", lock->lk_name);
+	}
 
-        (void)lock;  // suppress warning until code gets written
+	/* Call this (atomically) before waiting for a lock */
+	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
+
+	/*
+	 * In handoff mode lock_release may have made us the holder.
+	 * Otherwise, each time we look the holder may be someone new
+	 * that got in while we were off the wchan being woken, who
+	 * hasn't linked the lock or inherited anything; so link and
+	 * boost again before every sleep.
+	 */
+	while (lock->lk_holder != NULL && lock->lk_holder != curthread) {
+		lock_pi_wait(lock);
+		wchan_sleep(lock->lk_wchan, &lock->lk_lock);
+	}
+	lock->lk_holder = curthread;
+	lock_pi_acquired(lock);
 
 	/* Call this (atomically) once the lock is acquired */
-	//HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
+	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
+
+	spinlock_release(&lock->lk_lock);
+}
+
+/*
+ * lock_acquire with a timeout. Returns 0 if we got the lock and
+ * ETIMEDOUT if we gave up after TICKS hardclocks.
+ */
+int
+lock_acquire_timeout(struct lock *lock, unsigned ticks)
+{
+	unsigned deadline;
+	int remaining;
+
+	KASSERT(lock != NULL);
+	KASSERT(curthread->t_in_interrupt == false);
+
+	deadline = timeout_ticks() + ticks;
+
+	spinlock_acquire(&lock->lk_lock);
+	if (lock->lk_holder == curthread) {
+		panic("Deadlock on lock %s\n", lock->lk_name);
+	}
+
+	HANGMAN_WAIT(&curthread->t_hangman, &lock->lk_hangman);
+
+	/*
+	 * If we were handed the lock, keep it even if we're late. As in
+	 * lock_acquire, boost whoever holds it before every sleep.
+	 */
+	while (lock->lk_holder != NULL && lock->lk_holder != curthread) {
+		lock_pi_wait(lock);
+		remaining = deadline - timeout_ticks();
+		if (remaining <= 0) {
+			lock_pi_cancel();
+			HANGMAN_CANCEL(&curthread->t_hangman,
+				       &lock->lk_hangman);
+			spinlock_release(&lock->lk_lock);
+			return ETIMEDOUT;
+		}
+		wchan_sleep_timeout(lock->lk_wchan, &lock->lk_lock, remaining);
+	}
+	lock->lk_holder = curthread;
+	lock_pi_acquired(lock);
+
+	HANGMAN_ACQUIRE(&curthread->t_hangman, &lock->lk_hangman);
+
+	spinlock_release(&lock->lk_lock);
+	return 0;
 }
 
 void
 lock_release(struct lock *lock)
 {
-	/* Call this (atomically) when the lock is released */
-	//HANGMAN_RELEASE(&curthread->t_hangman, &lock->lk_hangman);
+	KASSERT(lock != NULL);
 
-        // Write this
+	spinlock_acquire(&lock->lk_lock);
+	KASSERT(lock->lk_holder == curthread);
+
+	/* Call this (atomically) when the lock is released */
+	HANGMAN_RELEASE(&curthread->t_hangman, &lock->lk_hangman);
 
-        (void)lock;  // suppress warning until code gets written
+	lock_pi_release(lock);
+	lock->lk_holder = NULL;
+	if (lock->lk_handoff) {
+		/*
+		 * Make the first waiter the holder before it runs, so
+		 * nobody can get in ahead of it. (NULL if none.)
+		 */
+		lock->lk_holder = wchan_wakeone(lock->lk_wchan,
+						&lock->lk_lock);
+	}
+	else {
+		wchan_wakeone(lock->lk_wchan, &lock->lk_lock);
+	}
+	spinlock_release(&lock->lk_lock);
 }
 
 bool
 lock_do_i_hold(struct lock *lock)
 {
-        // Write this
+	/*
+	 * Only we can set lk_holder to ourselves (or lock_release, in
+	 * handoff mode, while we're asleep), so no need to lock.
+	 */
+	return lock->lk_holder == curthread;
+}
 
-        (void)lock;  // suppress warning until code gets written
+void
+lock_set_handoff(struct lock *lock, bool on)
+{
+	KASSERT(lock != NULL);
 
-        return true; // dummy until code gets written
+	spinlock_acquire(&lock->lk_lock);
+	KASSERT(lock->lk_holder == NULL);
+	KASSERT(wchan_isempty(lock->lk_wchan, &lock->lk_lock));
+	lock->lk_handoff = on;
+	spinlock_release(&lock->lk_lock);
 }
 
 ////////////////////////////////////////////////////////////
@@ -228,7 +605,14 @@ cv_create(const char *name)
                 return NULL;
         }
 
-        // add stuff here as needed
+	cv->cv_wchan = wchan_create(cv->cv_name);
+	if (cv->cv_wchan == NULL) {
+		kfree(cv->cv_name);
+		kfree(cv);
+		return NULL;
+	}
+
+	spinlock_init(&cv->cv_lock);
 
         return cv;
 }
@@ -238,8 +622,9 @@ cv_destroy(struct cv *cv)
 {
         KASSERT(cv != NULL);
 
-        // add stuff here as needed
-
+	/* wchan_cleanup will assert if anyone's waiting on it */
+	spinlock_cleanup(&cv->cv_lock);
+	wchan_destroy(cv->cv_wchan);
         kfree(cv->cv_name);
         kfree(cv);
 }
@@ -247,23 +632,60 @@ cv_destroy(struct cv *cv)
 void
 cv_wait(struct cv *cv, struct lock *lock)
 {
-        // Write this
-        (void)cv;    // suppress warning until code gets written
-        (void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	/*
+	 * Take cv_lock before dropping the lock so a signal sent
+	 * between the release and the sleep isn't lost.
+	 */
+	spinlock_acquire(&cv->cv_lock);
+	lock_release(lock);
+	wchan_sleep(cv->cv_wchan, &cv->cv_lock);
+	spinlock_release(&cv->cv_lock);
+	lock_acquire(lock);
+}
+
+/*
+ * cv_wait with a timeout. Returns ETIMEDOUT if TICKS hardclocks went
+ * by without a signal, 0 otherwise. Either way the lock is held again
+ * on return.
+ */
+int
+cv_wait_timeout(struct cv *cv, struct lock *lock, unsigned ticks)
+{
+	bool expired;
+
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	spinlock_acquire(&cv->cv_lock);
+	lock_release(lock);
+	expired = wchan_sleep_timeout(cv->cv_wchan, &cv->cv_lock, ticks);
+	spinlock_release(&cv->cv_lock);
+	lock_acquire(lock);
+
+	return expired ? ETIMEDOUT : 0;
 }
 
 void
 cv_signal(struct cv *cv, struct lock *lock)
 {
-        // Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	spinlock_acquire(&cv->cv_lock);
+	wchan_wakeone(cv->cv_wchan, &cv->cv_lock);
+	spinlock_release(&cv->cv_lock);
 }
 
 void
 cv_broadcast(struct cv *cv, struct lock *lock)
 {
-	// Write this
-	(void)cv;    // suppress warning until code gets written
-	(void)lock;  // suppress warning until code gets written
+	KASSERT(cv != NULL);
+	KASSERT(lock_do_i_hold(lock));
+
+	spinlock_acquire(&cv->cv_lock);
+	wchan_wakeall(cv->cv_wchan, &cv->cv_lock);
+	spinlock_release(&cv->cv_lock);
 }
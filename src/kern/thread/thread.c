@@ -48,13 +48,19 @@
 #include <current.h>
 #include <synch.h>
 #include <addrspace.h>
+#include <membar.h>
 #include <mainbus.h>
 #include <vnode.h>
+#include <clock.h>
+#include <schedstat.h>
 
 
 /* Magic number used as a guard value on kernel thread stacks. */
 #define THREAD_STACK_MAGIC 0xbaadf00d
 
+/* Maximum number of exited threads kept for reuse on each cpu. */
+#define THREAD_CACHE_MAX 16
+
 /* Wait channel. A wchan is protected by an associated, passed-in spinlock. */
 struct wchan {
 	const char *wc_name;		/* name for this channel */
@@ -69,6 +75,12 @@ static struct cpuarray allcpus;
 /* Used to wait for secondary CPUs to come online. */
 static struct semaphore *cpu_startup_sem;
 
+/* Work stealing, used by the idle loop; see below. */
+static unsigned thread_steal(bool idle);
+
+/* Body of each cpu's idle thread; see below. */
+static void thread_idle(void *data1, unsigned long data2);
+
 ////////////////////////////////////////////////////////////
 
 /*
@@ -108,6 +120,54 @@ thread_checkstack(struct thread *thread)
 	}
 }
 
+/*
+ * Initialize (or reinitialize) the fields of a thread structure
+ * other than its name and stack.
+ */
+static
+void
+thread_initfields(struct thread *thread)
+{
+	thread->t_wchan_name = "NEW";
+	thread->t_state = S_READY;
+
+	/* Thread subsystem fields */
+	thread_machdep_init(&thread->t_machdep);
+	threadlistnode_init(&thread->t_listnode, thread);
+	thread->t_context = NULL;
+	thread->t_cpu = NULL;
+	thread->t_proc = NULL;
+	thread->t_lastrun = 0;
+	thread->t_affinity = THREAD_AFFINITY_ALL;
+	thread->t_basepri = THREAD_PRI_DEFAULT;
+	thread->t_priority = THREAD_PRI_DEFAULT;
+	thread->t_blockedon = NULL;
+	thread->t_pilocks = NULL;
+	thread->t_period = 0;
+	thread->t_reldeadline = 0;
+	thread->t_release = 0;
+	thread->t_deadline = 0;
+	thread->t_wchan = NULL;
+	thread->t_rcu_nest = 0;
+	thread->t_runtime = 0;
+	thread->t_runcharged = 0;
+	bzero(&thread->t_usage, sizeof(thread->t_usage));
+	thread->t_waittime = 0;
+	thread->t_stamp = 0;
+	thread->t_woken = false;
+	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+
+	/* Interrupt state fields */
+	thread->t_in_interrupt = false;
+	thread->t_curspl = IPL_HIGH;
+	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+
+	/* Public fields */
+	thread->t_tid = 0;
+
+	/* If you add to struct thread, be sure to initialize here */
+}
+
 /*
  * Create a thread. This is used both to create a first thread
  * for each CPU and to create subsequent forked threads.
@@ -130,26 +190,53 @@ thread_create(const char *name)
 		kfree(thread);
 		return NULL;
 	}
-	thread->t_wchan_name = "NEW";
-	thread->t_state = S_READY;
-
-	/* Thread subsystem fields */
-	thread_machdep_init(&thread->t_machdep);
-	threadlistnode_init(&thread->t_listnode, thread);
 	thread->t_stack = NULL;
-	thread->t_context = NULL;
-	thread->t_cpu = NULL;
-	thread->t_proc = NULL;
-	HANGMAN_ACTORINIT(&thread->t_hangman, thread->t_name);
+	thread_initfields(thread);
 
-	/* Interrupt state fields */
-	thread->t_in_interrupt = false;
-	thread->t_curspl = IPL_HIGH;
-	thread->t_iplhigh_count = 1; /* corresponding to t_curspl */
+	return thread;
+}
 
-	/* If you add to struct thread, be sure to initialize here */
+/*
+ * Create the idle thread for cpu C. This runs whenever C has nothing
+ * else to do. It is never put on a run queue; thread_switch picks it
+ * explicitly when the run queue is empty.
+ *
+ * Idling in a thread of its own, instead of on the stack of whatever
+ * thread happened to run last, means a thread that has been switched
+ * out is really off its cpu and is free to run elsewhere. Moving
+ * threads to the cpus their affinity masks allow depends on that.
+ */
+static
+void
+thread_idle_create(struct cpu *c)
+{
+	struct thread *t;
+	char namebuf[16];
+	int result;
 
-	return thread;
+	snprintf(namebuf, sizeof(namebuf), "<idle #%d>", c->c_number);
+	t = thread_create(namebuf);
+	if (t == NULL) {
+		panic("cpu_create: couldn't create idle thread\n");
+	}
+	t->t_stack = kmalloc(STACK_SIZE);
+	if (t->t_stack == NULL) {
+		panic("cpu_create: couldn't allocate idle stack\n");
+	}
+	thread_checkstack_init(t);
+	t->t_cpu = c;
+	t->t_affinity = 1U << c->c_number;
+
+	result = proc_addthread(kproc, t);
+	if (result) {
+		panic("cpu_create: proc_addthread: %s\n", strerror(result));
+	}
+
+	/* As in thread_fork, account for releasing the runqueue lock. */
+	t->t_iplhigh_count++;
+	switchframe_init(t, thread_idle, NULL, 0);
+
+	c->c_idlethread = t;
 }
 
 /*
@@ -176,17 +263,28 @@ cpu_create(unsigned hardware_number)
 	c->c_hardware_number = hardware_number;
 
 	c->c_curthread = NULL;
+	c->c_idlethread = NULL;
 	threadlist_init(&c->c_zombies);
+	threadlist_init(&c->c_threadcache);
 	c->c_hardclocks = 0;
+	c->c_rcu_qs = 0;
+	c->c_tickless = false;
+	c->c_idletick = 0;
 	c->c_spinlocks = 0;
 
 	c->c_isidle = false;
 	threadlist_init(&c->c_runqueue);
+	c->c_handoff = NULL;
 	spinlock_init(&c->c_runqueue_lock);
+	spinlock_setname(&c->c_runqueue_lock, "runqueue");
 
 	c->c_ipi_pending = 0;
 	c->c_numshootdown = 0;
+	c->c_calls = NULL;
+	c->c_callstail = &c->c_calls;
+	schedstat_clearcpu(c);
 	spinlock_init(&c->c_ipi_lock);
+	spinlock_setname(&c->c_ipi_lock, "ipi");
 
 	result = cpuarray_add(&allcpus, c, &c->c_number);
 	if (result != 0) {
@@ -247,11 +345,31 @@ cpu_create(unsigned hardware_number)
 		panic("cpu_create: proc_addthread:: %s\n", strerror(result));
 	}
 
+	thread_idle_create(c);
+
 	cpu_machdep_init(c);
 
 	return c;
 }
 
+/*
+ * Number of cpus, and lookup by software number, for code outside
+ * the thread system that needs to look at every cpu. cpus are never
+ * removed once created.
+ */
+unsigned
+cpu_count(void)
+{
+	return cpuarray_num(&allcpus);
+}
+
+struct cpu *
+cpu_bynumber(unsigned num)
+{
+	KASSERT(num < cpuarray_num(&allcpus));
+	return cpuarray_get(&allcpus, num);
+}
+
 /*
  * Destroy a thread.
  *
@@ -287,9 +405,88 @@ thread_destroy(struct thread *thread)
 	kfree(thread);
 }
 
+/*
+ * Thread recycling.
+ *
+ * Exited threads that have a stack are not freed right away; up to
+ * THREAD_CACHE_MAX of them are kept on a per-cpu list and handed back
+ * out by thread_fork, stack and all, so creating a thread doesn't
+ * have to go through kmalloc. The cache is only touched by the cpu
+ * it belongs to, with interrupts off.
+ */
+
+/*
+ * Put a zombie into the current cpu's thread cache, or destroy it if
+ * the cache is full or the thread can't be reused.
+ */
+static
+void
+thread_recycle(struct thread *thread)
+{
+	KASSERT(curthread->t_curspl > 0);
+	KASSERT(thread != curthread);
+	KASSERT(thread->t_state == S_ZOMBIE);
+	KASSERT(thread->t_proc == NULL);
+
+	if (thread->t_stack == NULL ||
+	    curcpu->c_threadcache.tl_count >= THREAD_CACHE_MAX) {
+		thread_destroy(thread);
+		return;
+	}
+
+	/* Don't recycle a stack that has been overrun. */
+	thread_checkstack(thread);
+
+	thread_machdep_cleanup(&thread->t_machdep);
+	thread->t_wchan_name = "CACHED";
+	threadlist_addtail(&curcpu->c_threadcache, thread);
+}
+
+/*
+ * Get a thread (with a stack) from the current cpu's thread cache
+ * and reinitialize it for use under the name NAME. Returns NULL if
+ * the cache is empty or we ran out of memory renaming it.
+ */
+static
+struct thread *
+thread_cache_get(const char *name)
+{
+	struct thread *thread;
+	char *newname;
+	int spl;
+
+	spl = splhigh();
+	thread = threadlist_remhead(&curcpu->c_threadcache);
+	splx(spl);
+
+	if (thread == NULL) {
+		return NULL;
+	}
+
+	/* Reuse the old name buffer if the new name fits in it. */
+	if (strlen(name) <= strlen(thread->t_name)) {
+		strcpy(thread->t_name, name);
+	}
+	else {
+		newname = kstrdup(name);
+		if (newname == NULL) {
+			thread_initfields(thread);
+			thread_destroy(thread);
+			return NULL;
+		}
+		kfree(thread->t_name);
+		thread->t_name = newname;
+	}
+
+	thread_initfields(thread);
+	thread_checkstack_init(thread);
+	return thread;
+}
+
 /*
  * Clean up zombies. (Zombies are threads that have exited but still
- * need to have thread_destroy called on them.)
+ * need to have thread_destroy called on them.) Zombies with reusable
+ * stacks go into the thread cache instead.
  *
  * The list of zombies is per-cpu.
  */
@@ -302,7 +499,7 @@ exorcise(void)
 	while ((z = threadlist_remhead(&curcpu->c_zombies)) != NULL) {
 		KASSERT(z != curthread);
 		KASSERT(z->t_state == S_ZOMBIE);
-		thread_destroy(z);
+		thread_recycle(z);
 	}
 }
 
@@ -442,30 +639,152 @@ thread_start_cpus(void)
 	cpu_startup_sem = NULL;
 }
 
+/*
+ * Wake up an idle cpu other than BUSY, if there is one, so it can
+ * come steal work. Idle cpus sleep without hardclocks, so otherwise
+ * they wouldn't notice. c_isidle is read unlocked; if we're wrong
+ * the worst case is a wasted IPI or a missed chance to steal.
+ */
+static
+void
+thread_kick_idle(struct cpu *busy)
+{
+	struct cpu *c;
+	unsigned i, num;
+
+	num = cpuarray_num(&allcpus);
+	for (i=0; i<num; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (c != busy && c != curcpu->c_self && c->c_isidle) {
+			ipi_send(c, IPI_UNIDLE);
+			return;
+		}
+	}
+}
+
+/*
+ * Choose a cpu for thread T, which may not stay on the one it's on:
+ * the least loaded one its affinity mask allows. Queue lengths are
+ * sampled without locking, as in thread_steal.
+ */
+static
+struct cpu *
+thread_pick_cpu(struct thread *t)
+{
+	struct cpu *c, *best;
+	unsigned i, num;
+
+	best = NULL;
+	num = cpuarray_num(&allcpus);
+	for (i=0; i<num; i++) {
+		c = cpuarray_get(&allcpus, i);
+		if (!THREAD_ALLOWED(t, c)) {
+			continue;
+		}
+		if (best == NULL ||
+		    c->c_runqueue.tl_count < best->c_runqueue.tl_count) {
+			best = c;
+		}
+	}
+	/* thread_setaffinity doesn't allow masks with no real cpus */
+	KASSERT(best != NULL);
+	return best;
+}
+
+/*
+ * Return true if thread A should run before thread B: periodic
+ * threads first, earliest deadline first, then by priority. Ties
+ * return false, so equals take turns.
+ */
+static
+bool
+thread_runs_before(struct thread *a, struct thread *b)
+{
+	if (a->t_period != 0 && b->t_period != 0) {
+		/* Tick counts wrap; compare the difference. */
+		return (int)(a->t_deadline - b->t_deadline) < 0;
+	}
+	if (a->t_period != 0 || b->t_period != 0) {
+		return a->t_period != 0;
+	}
+	return a->t_priority > b->t_priority;
+}
+
+/*
+ * Put T on cpu C's run queue, which must be locked, behind every
+ * thread that runs before it or with it (see thread_runs_before).
+ * When nothing is periodic and everyone has the same priority this
+ * is just addtail, and the loop doesn't run.
+ */
+static
+void
+thread_runqueue_insert(struct cpu *c, struct thread *t)
+{
+	struct threadlistnode *tln;
+
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+
+	tln = c->c_runqueue.tl_tail.tln_prev;
+	while (tln->tln_self != NULL && thread_runs_before(t, tln->tln_self)) {
+		tln = tln->tln_prev;
+	}
+	if (tln->tln_self == NULL) {
+		threadlist_addhead(&c->c_runqueue, t);
+	}
+	else {
+		threadlist_insertafter(&c->c_runqueue, tln->tln_self, t);
+	}
+}
+
 /*
  * Make a thread runnable.
  *
- * targetcpu might be curcpu; it might not be, too.
+ * targetcpu might be curcpu; it might not be, too. If the target
+ * thread isn't allowed on the cpu it last ran on, it's moved to one
+ * it is allowed on.
  */
 static
 void
 thread_make_runnable(struct thread *target, bool already_have_lock)
 {
 	struct cpu *targetcpu;
+	bool migrated = false;
 
 	/* Lock the run queue of the target thread's cpu. */
 	targetcpu = target->t_cpu;
 	if (already_have_lock) {
 		/* The target thread's cpu should be already locked. */
 		KASSERT(spinlock_do_i_hold(&targetcpu->c_runqueue_lock));
+		KASSERT(THREAD_ALLOWED(target, targetcpu));
 	}
 	else {
+		if (!THREAD_ALLOWED(target, targetcpu)) {
+			/*
+			 * The old cpu might still be switching away
+			 * from the thread (it holds its run queue lock
+			 * until it is off the thread's stack), so wait
+			 * for that before letting another cpu run it.
+			 */
+			spinlock_acquire(&targetcpu->c_runqueue_lock);
+			targetcpu->c_migrate_out++;
+			spinlock_release(&targetcpu->c_runqueue_lock);
+
+			targetcpu = thread_pick_cpu(target);
+			target->t_cpu = targetcpu;
+			target->t_lastrun = 0;
+			migrated = true;
+		}
 		spinlock_acquire(&targetcpu->c_runqueue_lock);
 	}
+	if (migrated) {
+		targetcpu->c_migrate_in++;
+	}
 	
 	/* Target thread is now ready to run; put it on the run queue. */
+	target->t_woken = target->t_state == S_SLEEP;
+	target->t_stamp = schedstat_now();
 	target->t_state = S_READY;
-	threadlist_addtail(&targetcpu->c_runqueue, target);
+	thread_runqueue_insert(targetcpu, target);
 
 	if (targetcpu->c_isidle && targetcpu != curcpu->c_self) {
 		/*
@@ -474,6 +793,13 @@ thread_make_runnable(struct thread *target, bool already_have_lock)
 		 */
 		ipi_send(targetcpu, IPI_UNIDLE);
 	}
+	else if (targetcpu->c_runqueue.tl_count > 1) {
+		/*
+		 * More work is queued here than the cpu can run right
+		 * now; give an idle cpu a chance to steal some.
+		 */
+		thread_kick_idle(targetcpu);
+	}
 
 	if (!already_have_lock) {
 		spinlock_release(&targetcpu->c_runqueue_lock);
@@ -499,18 +825,22 @@ thread_fork(const char *name,
 	struct thread *newthread;
 	int result;
 
-	newthread = thread_create(name);
+	/* Try for a recycled thread first; it already has a stack. */
+	newthread = thread_cache_get(name);
 	if (newthread == NULL) {
-		return ENOMEM;
-	}
-	
-	/* Allocate a stack */
-	newthread->t_stack = kmalloc(STACK_SIZE);
-	if (newthread->t_stack == NULL) {
-		thread_destroy(newthread);
-		return ENOMEM;
+		newthread = thread_create(name);
+		if (newthread == NULL) {
+			return ENOMEM;
+		}
+
+		/* Allocate a stack */
+		newthread->t_stack = kmalloc(STACK_SIZE);
+		if (newthread->t_stack == NULL) {
+			thread_destroy(newthread);
+			return ENOMEM;
+		}
+		thread_checkstack_init(newthread);
 	}
-	thread_checkstack_init(newthread);
 	
 	/*
 	 * Now we clone various fields from the parent thread.
@@ -518,6 +848,9 @@ thread_fork(const char *name,
 
 	/* Thread subsystem fields */
 	newthread->t_cpu = curthread->t_cpu;
+	newthread->t_affinity = curthread->t_affinity;
+	newthread->t_basepri = curthread->t_basepri;
+	newthread->t_priority = curthread->t_basepri;
 
 	/* Attach the new thread to its process */
 	if (proc == NULL) {
@@ -546,6 +879,75 @@ thread_fork(const char *name,
 	return 0;
 }
 
+/*
+ * Finish a context switch, in the context of the thread switched to:
+ * release the run queue lock taken in thread_switch, then find a
+ * proper home for the thread switched away from if it isn't allowed
+ * on this cpu. That can't be done until we're off its stack. Shared
+ * by the tail of thread_switch and thread_startup.
+ */
+static
+void
+thread_switch_done(void)
+{
+	struct thread *handoff;
+
+	handoff = curcpu->c_handoff;
+	curcpu->c_handoff = NULL;
+	spinlock_release(&curcpu->c_runqueue_lock);
+
+	if (handoff != NULL) {
+		thread_make_runnable(handoff, false);
+	}
+}
+
+/*
+ * Scheduler statistics for a switch from CUR to NEXT (see
+ * schedstat.c). Called with the run queue locked, after the idle
+ * loop, so the idle thread's run time is this cpu's idle time.
+ */
+static
+void
+thread_switch_account(struct thread *cur, struct thread *next,
+		      threadstate_t newstate)
+{
+	uint64_t now, lat;
+
+	if (cur != curcpu->c_idlethread) {
+		if (newstate == S_READY && cur->t_in_interrupt) {
+			curcpu->c_sw_preempt++;
+			cur->t_usage.u_nivcsw++;
+		}
+		else {
+			curcpu->c_sw_voluntary++;
+			cur->t_usage.u_nvcsw++;
+		}
+	}
+
+	now = schedstat_now();
+	if (now == 0) {
+		return;
+	}
+	if (cur->t_stamp != 0) {
+		cur->t_runtime += now - cur->t_stamp;
+	}
+	cur->t_stamp = now;
+
+	if (next != cur && next->t_stamp != 0) {
+		lat = now - next->t_stamp;
+		next->t_waittime += lat;
+		if (next->t_woken) {
+			curcpu->c_wakeups++;
+			curcpu->c_wakelat += lat;
+			if (lat > curcpu->c_wakelat_max) {
+				curcpu->c_wakelat_max = lat;
+			}
+		}
+	}
+	next->t_woken = false;
+	next->t_stamp = now;
+}
+
 /*
  * High level, machine-independent context switch code.
  *
@@ -580,14 +982,36 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		return;
 	}
 
+	/*
+	 * RCU readers aren't preempted, and mustn't block. Otherwise,
+	 * getting here means this cpu isn't in a read section, so
+	 * count a quiescent state. See rcu.c.
+	 */
+	if (cur->t_rcu_nest > 0) {
+		KASSERT(newstate == S_READY);
+		splx(spl);
+		return;
+	}
+	curcpu->c_rcu_qs++;
+
 	/* Check the stack guard band. */
 	thread_checkstack(cur);
 
 	/* Lock the run queue. */
 	spinlock_acquire(&curcpu->c_runqueue_lock);
 
-	/* Micro-optimization: if nothing to do, just return */
-	if (newstate == S_READY && threadlist_isempty(&curcpu->c_runqueue)) {
+	/*
+	 * Micro-optimization: if nothing to do, just return. (Unless
+	 * we're the idle thread, which needs to go idle, or we aren't
+	 * allowed on this cpu any more and need to leave.) Nothing to
+	 * do includes when everything queued would run after us: we'd
+	 * just be requeued at the front.
+	 */
+	next = threadlist_isempty(&curcpu->c_runqueue) ? NULL :
+		curcpu->c_runqueue.tl_head.tln_next->tln_self;
+	if (newstate == S_READY &&
+	    (next == NULL || thread_runs_before(cur, next)) &&
+	    cur != curcpu->c_idlethread && THREAD_ALLOWED(cur, curcpu)) {
 		spinlock_release(&curcpu->c_runqueue_lock);
 		splx(spl);
 		return;
@@ -598,10 +1022,21 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	    case S_RUN:
 		panic("Illegal S_RUN in thread_switch\n");
 	    case S_READY:
-		thread_make_runnable(cur, true /*have lock*/);
+		if (cur == curcpu->c_idlethread) {
+			/* The idle thread is never queued. */
+		}
+		else if (THREAD_ALLOWED(cur, curcpu)) {
+			thread_make_runnable(cur, true /*have lock*/);
+		}
+		else {
+			/* Requeue elsewhere once off its stack. */
+			KASSERT(curcpu->c_handoff == NULL);
+			curcpu->c_handoff = cur;
+		}
 		break;
 	    case S_SLEEP:
 		cur->t_wchan_name = wc->wc_name;
+		cur->t_wchan = wc;
 		/*
 		 * Add the thread to the list in the wait channel, and
 		 * unlock same. To avoid a race with someone else
@@ -619,10 +1054,14 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 		break;
 	}
 	cur->t_state = newstate;
+	cur->t_lastrun = curcpu->c_hardclocks;
 
 	/*
-	 * Get the next thread. While there isn't one, call cpu_idle().
-	 * curcpu->c_isidle must be true when cpu_idle is
+	 * Get the next thread. If there isn't one, switch to the idle
+	 * thread; only the idle thread actually idles.
+	 *
+	 * In the idle thread, while there isn't a next thread, call
+	 * cpu_idle(). curcpu->c_isidle must be true when cpu_idle is
 	 * called. Unlock the runqueue while idling too, to make sure
 	 * things can be added to it.
 	 *
@@ -635,19 +1074,41 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	 * Note that c_isidle becomes true briefly even if we don't go
 	 * idle. However, because one is supposed to hold the runqueue
 	 * lock to look at it, this should not be visible or matter.
+	 *
+	 * Before actually idling, try to steal work from the busiest
+	 * other cpu. If that finds something, go around again without
+	 * waiting for an interrupt.
+	 *
+	 * While idle we stop taking hardclocks (see clock.c), so an
+	 * idle cpu doesn't poll for work to steal; instead
+	 * thread_make_runnable wakes one up when a queue backs up.
 	 */
 
-	/* The current cpu is now idle. */
-	curcpu->c_isidle = true;
-	do {
+	if (cur != curcpu->c_idlethread) {
 		next = threadlist_remhead(&curcpu->c_runqueue);
 		if (next == NULL) {
-			spinlock_release(&curcpu->c_runqueue_lock);
-			cpu_idle();
-			spinlock_acquire(&curcpu->c_runqueue_lock);
+			next = curcpu->c_idlethread;
 		}
-	} while (next == NULL);
-	curcpu->c_isidle = false;
+	}
+	else {
+		/* The current cpu is now idle. */
+		curcpu->c_isidle = true;
+		do {
+			next = threadlist_remhead(&curcpu->c_runqueue);
+			if (next == NULL) {
+				spinlock_release(&curcpu->c_runqueue_lock);
+				if (thread_steal(true) == 0) {
+					hardclock_idle();
+					cpu_idle();
+					hardclock_unidle();
+				}
+				spinlock_acquire(&curcpu->c_runqueue_lock);
+			}
+		} while (next == NULL);
+		curcpu->c_isidle = false;
+	}
+
+	thread_switch_account(cur, next, newstate);
 
 	/*
 	 * Note that curcpu->c_curthread may be the same variable as
@@ -714,7 +1175,7 @@ thread_switch(threadstate_t newstate, struct wchan *wc, struct spinlock *lk)
 	cur->t_state = S_RUN;
 
 	/* Unlock the run queue. */
-	spinlock_release(&curcpu->c_runqueue_lock);
+	thread_switch_done();
 
 	/* Activate our address space in the MMU. */
 	as_activate();
@@ -747,7 +1208,7 @@ thread_startup(void (*entrypoint)(void *data1, unsigned long data2),
 	cur->t_state = S_RUN;
 
 	/* Release the runqueue lock acquired in thread_switch. */
-	spinlock_release(&curcpu->c_runqueue_lock);
+	thread_switch_done();
 
 	/* Activate our address space in the MMU. */
 	as_activate();
@@ -808,144 +1269,393 @@ thread_yield(void)
 	thread_switch(S_READY, NULL, NULL);
 }
 
+/*
+ * The idle thread. Each time it's switched to it goes idle in
+ * thread_switch until something becomes runnable, switches to that,
+ * and comes back here when there's nothing to do again.
+ */
+static
+void
+thread_idle(void *data1, unsigned long data2)
+{
+	(void)data1;
+	(void)data2;
+
+	while (1) {
+		thread_switch(S_READY, NULL, NULL);
+	}
+}
+
 ////////////////////////////////////////////////////////////
 
 /*
  * Scheduler.
  *
- * This is called periodically from hardclock(). It should reshuffle
- * the current CPU's run queue by job priority.
+ * This is called periodically from hardclock(). It reshuffles the
+ * current CPU's run queue by job priority.
+ *
+ * The run queue is kept in order (periodic threads by deadline, then
+ * everyone else by priority) as threads are added, but a queued
+ * thread's priority can change (it inherits a priority through a lock
+ * it holds, or someone calls thread_setpriority), so sort it again
+ * now and then. Within a priority, threads run in round-robin fashion.
  */
 
 void
 schedule(void)
 {
-	/*
-	 * You can write this. If we do nothing, threads will run in
-	 * round-robin fashion.
-	 */
+	struct threadlist old;
+	struct thread *t;
+
+	spinlock_acquire(&curcpu->c_runqueue_lock);
+	if (curcpu->c_runqueue.tl_count > 1) {
+		threadlist_init(&old);
+		while ((t = threadlist_remhead(&curcpu->c_runqueue)) != NULL) {
+			threadlist_addtail(&old, t);
+		}
+		/* Reinserting in order keeps equal priorities in order. */
+		while ((t = threadlist_remhead(&old)) != NULL) {
+			thread_runqueue_insert(curcpu, t);
+		}
+		threadlist_cleanup(&old);
+	}
+	spinlock_release(&curcpu->c_runqueue_lock);
 }
 
 /*
  * Thread migration.
  *
- * This is also called periodically from hardclock(). If the current
- * CPU is busy and other CPUs are idle, or less busy, it should move
- * threads across to those other other CPUs.
+ * Load is balanced by pulling work rather than pushing it: a cpu that
+ * runs out of things to do (or has noticeably less to do than some
+ * other cpu) steals ready threads off the tail of the busiest run
+ * queue. Idle cpus do this from the idle loop in thread_switch, so
+ * they pick up work as soon as it exists instead of waiting for a
+ * busy cpu to get around to giving some away; busy cpus do it
+ * periodically from hardclock() via thread_consider_migration().
  *
  * Migrating threads isn't free because of cache affinity; a thread's
  * working cache set will end up having to be moved to the other CPU,
- * which is fairly slow. The tradeoff between this performance loss
- * and the performance loss due to underutilization of some CPUs is
- * something that needs to be tuned and probably is workload-specific.
- *
- * For here and now, because we know we're running on System/161 and
- * System/161 does not (yet) model such cache effects, we'll be very
- * aggressive.
+ * which is fairly slow. So a thread that ran on its cpu within the
+ * last STEAL_AFFINITY_HARDCLOCKS ticks is considered cache-hot and is
+ * left where it is. System/161 does not (yet) model such cache
+ * effects, so this is kept short.
  */
-void
-thread_consider_migration(void)
+
+/* Threads that ran this recently (in hardclocks) are not stolen. */
+#define STEAL_AFFINITY_HARDCLOCKS	2
+
+/*
+ * Check if thread T, which is on the run queue of cpu C, may be
+ * moved to the current cpu. Call with C's run queue locked.
+ */
+static
+bool
+thread_can_steal(struct cpu *c, struct thread *t)
 {
-	unsigned my_count, total_count, one_share, to_send;
-	unsigned i, numcpus;
-	struct cpu *c;
-	struct threadlist victims;
-	struct thread *t;
+	KASSERT(spinlock_do_i_hold(&c->c_runqueue_lock));
+	KASSERT(t->t_cpu == c);
 
-	my_count = total_count = 0;
-	numcpus = cpuarray_num(&allcpus);
-	for (i=0; i<numcpus; i++) {
-		c = cpuarray_get(&allcpus, i);
-		spinlock_acquire(&c->c_runqueue_lock);
-		total_count += c->c_runqueue.tl_count;
-		if (c == curcpu->c_self) {
-			my_count = c->c_runqueue.tl_count;
-		}
-		spinlock_release(&c->c_runqueue_lock);
+	/*
+	 * A cpu's curthread should never be visible on its run queue,
+	 * because cpus idle in their own idle threads. But if it were,
+	 * that cpu would still be running on the thread's stack, and
+	 * migrating it would cause two cpus to run on the same stack
+	 * at once. Leave it alone.
+	 */
+	if (t == c->c_curthread) {
+		return false;
 	}
 
-	one_share = DIVROUNDUP(total_count, numcpus);
-	if (my_count < one_share) {
-		return;
+	/* Don't take threads that aren't allowed here. */
+	if (!THREAD_ALLOWED(t, curcpu)) {
+		return false;
 	}
 
-	to_send = my_count - one_share;
-	threadlist_init(&victims);
-	spinlock_acquire(&curcpu->c_runqueue_lock);
-	for (i=0; i<to_send; i++) {
-		t = threadlist_remtail(&curcpu->c_runqueue);
-		threadlist_addhead(&victims, t);
+	/* Leave cache-hot threads where they are. */
+	if (c->c_hardclocks - t->t_lastrun < STEAL_AFFINITY_HARDCLOCKS) {
+		return false;
 	}
-	spinlock_release(&curcpu->c_runqueue_lock);
 
-	for (i=0; i < numcpus && to_send > 0; i++) {
+	return true;
+}
+
+/*
+ * Steal ready threads from the busiest other cpu and put them on our
+ * own run queue. If IDLE is true we have nothing at all to run, so
+ * take up to half of whatever is waiting there; otherwise take half
+ * the difference, and only if it's worth bothering. Returns the
+ * number of threads stolen.
+ *
+ * The caller must not be holding any run queue locks. The queue
+ * lengths are sampled without locking; they're only used to choose a
+ * victim, and if they're stale we just steal less (or nothing) and
+ * try again later. This way only the victim's run queue is locked,
+ * and never at the same time as our own.
+ */
+static
+unsigned
+thread_steal(bool idle)
+{
+	struct cpu *c, *victim;
+	struct threadlist stolen;
+	struct thread *t, *prev;
+	unsigned i, numcpus, count, mycount, maxcount, want;
+
+	numcpus = cpuarray_num(&allcpus);
+	mycount = idle ? 0 : curcpu->c_runqueue.tl_count;
+
+	victim = NULL;
+	maxcount = 0;
+	for (i=0; i<numcpus; i++) {
 		c = cpuarray_get(&allcpus, i);
 		if (c == curcpu->c_self) {
 			continue;
 		}
-		spinlock_acquire(&c->c_runqueue_lock);
-		while (c->c_runqueue.tl_count < one_share && to_send > 0) {
-			t = threadlist_remhead(&victims);
-			/*
-			 * Ordinarily, curthread will not appear on
-			 * the run queue. However, it can under the
-			 * following circumstances:
-			 *   - it went to sleep;
-			 *   - the processor became idle, so it
-			 *     remained curthread;
-			 *   - it was reawakened, so it was put on the
-			 *     run queue;
-			 *   - and the processor hasn't fully unidled
-			 *     yet, so all these things are still true.
-			 *
-			 * If the timer interrupt happens at (almost)
-			 * exactly the proper moment, we can come here
-			 * while things are in this state and see
-			 * curthread. However, *migrating* curthread
-			 * can cause bad things to happen (Exercise:
-			 * Why? And what?) so shuffle it to the end of
-			 * the list and decrement to_send in order to
-			 * skip it. Then it goes back on our own run
-			 * queue below.
-			 */
-			if (t == curthread) {
-				threadlist_addtail(&victims, t);
-				to_send--;
-				continue;
-			}
+		count = c->c_runqueue.tl_count;
+		if (count > maxcount) {
+			maxcount = count;
+			victim = c;
+		}
+	}
 
-			t->t_cpu = c;
-			threadlist_addtail(&c->c_runqueue, t);
-			DEBUG(DB_THREADS,
-			      "Migrated thread %s: cpu %u -> %u",
-			      t->t_name, curcpu->c_number, c->c_number);
-			to_send--;
-			if (c->c_isidle) {
-				/*
-				 * Other processor is idle; send
-				 * interrupt to make sure it unidles.
-				 */
-				ipi_send(c, IPI_UNIDLE);
-			}
+	if (idle) {
+		if (maxcount == 0) {
+			return 0;
 		}
-		spinlock_release(&c->c_runqueue_lock);
+		want = DIVROUNDUP(maxcount, 2);
 	}
+	else {
+		if (maxcount < mycount + 2) {
+			return 0;
+		}
+		want = (maxcount - mycount) / 2;
+	}
+	KASSERT(victim != NULL);
+
+	threadlist_init(&stolen);
 
 	/*
-	 * Because the code above isn't atomic, the thread counts may have
-	 * changed while we were working and we may end up with leftovers.
-	 * Don't panic; just put them back on our own run queue.
+	 * Walk the victim's queue from the tail, since those threads
+	 * would otherwise wait longest. Fetch the previous thread
+	 * before moving T, because removing T clears its links.
 	 */
-	if (!threadlist_isempty(&victims)) {
+	spinlock_acquire(&victim->c_runqueue_lock);
+	t = victim->c_runqueue.tl_tail.tln_prev->tln_self;
+	while (t != NULL && stolen.tl_count < want) {
+		prev = t->t_listnode.tln_prev->tln_self;
+		if (thread_can_steal(victim, t)) {
+			threadlist_remove(&victim->c_runqueue, t);
+			t->t_cpu = curcpu->c_self;
+			t->t_lastrun = 0;
+			threadlist_addhead(&stolen, t);
+			victim->c_migrate_out++;
+			DEBUG(DB_THREADS, "Stole thread %s: cpu %u -> %u",
+			      t->t_name, victim->c_number, curcpu->c_number);
+		}
+		t = prev;
+	}
+	spinlock_release(&victim->c_runqueue_lock);
+
+	count = stolen.tl_count;
+	if (count > 0) {
 		spinlock_acquire(&curcpu->c_runqueue_lock);
-		while ((t = threadlist_remhead(&victims)) != NULL) {
-			threadlist_addtail(&curcpu->c_runqueue, t);
+		while ((t = threadlist_remhead(&stolen)) != NULL) {
+			thread_runqueue_insert(curcpu, t);
 		}
+		curcpu->c_migrate_in += count;
 		spinlock_release(&curcpu->c_runqueue_lock);
 	}
+	threadlist_cleanup(&stolen);
+
+	return count;
+}
+
+/*
+ * Periodic load balancing, called from hardclock(). A busy cpu that
+ * has noticeably less queued work than some other cpu pulls some of
+ * it over.
+ */
+void
+thread_consider_migration(void)
+{
+	(void)thread_steal(false);
+}
+
+/*
+ * CPU affinity.
+ *
+ * A thread's affinity mask is checked whenever it is queued
+ * (thread_make_runnable moves it to an allowed cpu if need be), when
+ * it switches out (thread_switch hands it off to an allowed cpu), and
+ * when other cpus look for threads to steal. The mask is a single
+ * word, so it's read and written without locking; a thread that
+ * misses a change just moves at its next context switch.
+ */
+int
+thread_setaffinity(struct thread *t, uint32_t mask)
+{
+	unsigned numcpus;
+
+	numcpus = cpuarray_num(&allcpus);
+	if (numcpus < 32) {
+		mask &= (1U << numcpus) - 1;
+	}
+	if (mask == 0) {
+		return EINVAL;
+	}
+
+	t->t_affinity = mask;
+
+	/* If we can't stay here, leave now. */
+	if (t == curthread && !THREAD_ALLOWED(t, curcpu)) {
+		thread_yield();
+	}
+	return 0;
+}
+
+uint32_t
+thread_getaffinity(struct thread *t)
+{
+	return t->t_affinity;
+}
+
+/*
+ * Bind the current thread to cpu CPUNUM.
+ */
+int
+thread_pin(unsigned cpunum)
+{
+	if (cpunum >= cpuarray_num(&allcpus)) {
+		return EINVAL;
+	}
+	return thread_setaffinity(curthread, 1U << cpunum);
+}
+
+/*
+ * Priorities. The bookkeeping for priority inheritance is done by
+ * the lock code, so setting the base priority goes through it.
+ * Yield afterwards in case something queued should now run first.
+ */
+void
+thread_setpriority(struct thread *t, unsigned pri)
+{
+	KASSERT(pri <= THREAD_PRI_MAX);
+
+	lock_pi_setbasepri(t, pri);
+	if (t == curthread) {
+		thread_yield();
+	}
+}
+
+unsigned
+thread_getpriority(struct thread *t)
+{
+	return t->t_priority;
+}
+
+/*
+ * Periodic threads. The deadline fields are only written by the
+ * thread itself, and read by whoever queues it, so no locking.
+ */
+int
+thread_setperiodic(unsigned period, unsigned deadline)
+{
+	struct thread *cur = curthread;
+
+	if (period == 0) {
+		cur->t_period = 0;
+		return 0;
+	}
+	if (deadline == 0 || deadline > period) {
+		return EINVAL;
+	}
+
+	cur->t_reldeadline = deadline;
+	cur->t_release = timeout_ticks();
+	cur->t_deadline = cur->t_release + deadline;
+	cur->t_period = period;
+	return 0;
+}
+
+unsigned
+thread_waitperiod(void)
+{
+	struct thread *cur = curthread;
+	unsigned now, next, missed;
+
+	KASSERT(cur->t_period != 0);
+
+	now = timeout_ticks();
+	next = cur->t_release + cur->t_period;
+	missed = 0;
+	while ((int)(next - now) < 0) {
+		next += cur->t_period;
+		missed++;
+	}
+
+	/* Set the new deadline first; it's what we'll be queued by. */
+	cur->t_release = next;
+	cur->t_deadline = next + cur->t_reldeadline;
+	clocksleep_until(next);
+	return missed;
+}
+
+/*
+ * Run time of the current thread so far. The current slice isn't in
+ * t_runtime yet; t_stamp is when it started. Interrupts are off so a
+ * switch can't move t_stamp while we look.
+ */
+uint64_t
+thread_runtime(void)
+{
+	struct thread *cur = curthread;
+	uint64_t now, runtime;
+	int spl;
+
+	spl = splhigh();
+	now = schedstat_now();
+	runtime = cur->t_runtime;
+	if (cur->t_stamp != 0 && now > cur->t_stamp) {
+		runtime += now - cur->t_stamp;
+	}
+	splx(spl);
+	return runtime;
+}
+
+/*
+ * Take the current thread's usage since it was last taken. The run
+ * time charged so far is remembered in t_runcharged, since
+ * t_runtime itself has to keep counting for schedstat.
+ */
+void
+thread_takeusage(struct usage *u)
+{
+	struct thread *cur = curthread;
+	uint64_t runtime;
+	int spl;
+
+	runtime = thread_runtime();
+
+	/* Switch accounting updates t_usage; keep it out meanwhile. */
+	spl = splhigh();
+	*u = cur->t_usage;
+	bzero(&cur->t_usage, sizeof(cur->t_usage));
+	splx(spl);
+
+	u->u_runtime = runtime - cur->t_runcharged;
+	cur->t_runcharged = runtime;
+}
 
-	KASSERT(threadlist_isempty(&victims));
-	threadlist_cleanup(&victims);
+void
+usage_add(struct usage *to, const struct usage *from)
+{
+	to->u_runtime += from->u_runtime;
+	to->u_systime += from->u_systime;
+	to->u_minflt += from->u_minflt;
+	to->u_nvcsw += from->u_nvcsw;
+	to->u_nivcsw += from->u_nivcsw;
+	to->u_inbytes += from->u_inbytes;
+	to->u_outbytes += from->u_outbytes;
 }
 
 ////////////////////////////////////////////////////////////
@@ -1012,9 +1722,77 @@ wchan_sleep(struct wchan *wc, struct spinlock *lk)
 }
 
 /*
- * Wake up one thread sleeping on a wait channel.
+ * State for wchan_sleep_timeout, on the sleeper's stack.
+ */
+struct wchan_timeout {
+	struct timeout wt_timeout;
+	struct wchan *wt_wc;
+	struct spinlock *wt_lk;
+	struct thread *wt_thread;
+	bool wt_expired;
+};
+
+/*
+ * Timeout function for wchan_sleep_timeout: if the thread is still
+ * on the channel, take it off and wake it up. If it isn't, it was
+ * already woken normally and there's nothing to do.
  */
+static
 void
+wchan_timeout_expire(void *data)
+{
+	struct wchan_timeout *wt = data;
+	struct thread *target = wt->wt_thread;
+
+	spinlock_acquire(wt->wt_lk);
+	if (target->t_wchan == wt->wt_wc) {
+		threadlist_remove(&wt->wt_wc->wc_threads, target);
+		target->t_wchan = NULL;
+		wt->wt_expired = true;
+		thread_make_runnable(target, false);
+	}
+	spinlock_release(wt->wt_lk);
+}
+
+/*
+ * Like wchan_sleep, but give up after TICKS hardclocks if nobody
+ * wakes us. Returns true if we timed out.
+ *
+ * The timeout function takes LK, so we have to cancel the timeout
+ * before relocking LK rather than after.
+ */
+bool
+wchan_sleep_timeout(struct wchan *wc, struct spinlock *lk, unsigned ticks)
+{
+	struct wchan_timeout wt;
+
+	KASSERT(!curthread->t_in_interrupt);
+	KASSERT(spinlock_do_i_hold(lk));
+	KASSERT(curcpu->c_spinlocks == 1);
+
+	wt.wt_wc = wc;
+	wt.wt_lk = lk;
+	wt.wt_thread = curthread;
+	wt.wt_expired = false;
+	timeout_init(&wt.wt_timeout, wchan_timeout_expire, &wt);
+
+	/*
+	 * If it goes off before we're on the channel, it'll wait for
+	 * LK, which we hold until thread_switch has put us there.
+	 */
+	timeout_add(&wt.wt_timeout, ticks);
+	thread_switch(S_SLEEP, wc, lk);
+	timeout_del(&wt.wt_timeout);
+
+	spinlock_acquire(lk);
+	return wt.wt_expired;
+}
+
+/*
+ * Wake up the longest-waiting thread on a wait channel, and return
+ * it (NULL if there was none).
+ */
+struct thread *
 wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 {
 	struct thread *target;
@@ -1026,8 +1804,9 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 
 	if (target == NULL) {
 		/* Nobody was sleeping. */
-		return;
+		return NULL;
 	}
+	target->t_wchan = NULL;
 
 	/*
 	 * Note that thread_make_runnable acquires a runqueue lock
@@ -1038,6 +1817,7 @@ wchan_wakeone(struct wchan *wc, struct spinlock *lk)
 	 */
 
 	thread_make_runnable(target, false);
+	return target;
 }
 
 /*
@@ -1058,13 +1838,15 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	 * private list.
 	 */
 	while ((target = threadlist_remhead(&wc->wc_threads)) != NULL) {
+		target->t_wchan = NULL;
 		threadlist_addtail(&list, target);
 	}
 
 	/*
 	 * We could conceivably sort by cpu first to cause fewer lock
-	 * ops and fewer IPIs, but for now at least don't bother. Just
-	 * make each thread runnable.
+	 * ops, but for now at least don't bother. Just make each
+	 * thread runnable. (Wakeups to the same idle cpu don't cost
+	 * an IPI each; see ipi_post.)
 	 */
 	while ((target = threadlist_remhead(&list)) != NULL) {
 		thread_make_runnable(target, false);
@@ -1073,6 +1855,28 @@ wchan_wakeall(struct wchan *wc, struct spinlock *lk)
 	threadlist_cleanup(&list);
 }
 
+/*
+ * Return the highest priority of the threads sleeping on the channel,
+ * or THREAD_PRI_MIN if there are none.
+ */
+unsigned
+wchan_maxpriority(struct wchan *wc, struct spinlock *lk)
+{
+	struct threadlistnode *tln;
+	unsigned pri;
+
+	KASSERT(spinlock_do_i_hold(lk));
+
+	pri = THREAD_PRI_MIN;
+	for (tln = wc->wc_threads.tl_head.tln_next; tln->tln_self != NULL;
+	     tln = tln->tln_next) {
+		if (tln->tln_self->t_priority > pri) {
+			pri = tln->tln_self->t_priority;
+		}
+	}
+	return pri;
+}
+
 /*
  * Return nonzero if there are no threads sleeping on the channel.
  * This is meant to be used only for diagnostic purposes.
@@ -1094,6 +1898,30 @@ wchan_isempty(struct wchan *wc, struct spinlock *lk)
  * Machine-independent IPI handling
  */
 
+/*
+ * Post IPI number CODE to TARGET, whose IPI lock is held. Only
+ * interrupt it if nothing is pending there already; if something
+ * is, it hasn't taken the interrupt yet, and will see our bit when
+ * it does.
+ */
+static
+void
+ipi_post(struct cpu *target, int code)
+{
+	KASSERT(spinlock_do_i_hold(&target->c_ipi_lock));
+
+	if (code < CPU_NIPICODES) {
+		curcpu->c_ipi_sent[code]++;
+	}
+	if (target->c_ipi_pending != 0) {
+		curcpu->c_ipi_coalesced++;
+		target->c_ipi_pending |= (uint32_t)1 << code;
+		return;
+	}
+	target->c_ipi_pending = (uint32_t)1 << code;
+	mainbus_send_ipi(target);
+}
+
 /*
  * Send an IPI (inter-processor interrupt) to the specified CPU.
  */
@@ -1103,8 +1931,7 @@ ipi_send(struct cpu *target, int code)
 	KASSERT(code >= 0 && code < 32);
 
 	spinlock_acquire(&target->c_ipi_lock);
-	target->c_ipi_pending |= (uint32_t)1 << code;
-	mainbus_send_ipi(target);
+	ipi_post(target, code);
 	spinlock_release(&target->c_ipi_lock);
 }
 
@@ -1153,24 +1980,123 @@ ipi_tlbshootdown(struct cpu *target, const struct tlbshootdown *mapping)
 		target->c_numshootdown = n+1;
 	}
 
-	target->c_ipi_pending |= (uint32_t)1 << IPI_TLBSHOOTDOWN;
-	mainbus_send_ipi(target);
+	ipi_post(target, IPI_TLBSHOOTDOWN);
 
 	spinlock_release(&target->c_ipi_lock);
 }
 
+/*
+ * Queue a function call for another cpu.
+ */
+void
+ipi_call(struct cpu *target, struct ipi_call *call)
+{
+	KASSERT(target != curcpu->c_self);
+
+	call->ic_next = NULL;
+	call->ic_done = false;
+
+	spinlock_acquire(&target->c_ipi_lock);
+	*target->c_callstail = call;
+	target->c_callstail = &call->ic_next;
+	ipi_post(target, IPI_CALL);
+	spinlock_release(&target->c_ipi_lock);
+}
+
+/*
+ * Wait for a queued call to finish.
+ */
+void
+ipi_call_wait(struct ipi_call *call)
+{
+	KASSERT(curthread->t_in_interrupt == false);
+	KASSERT(curcpu->c_spinlocks == 0);
+
+	while (!call->ic_done) {
+		/* spin */
+	}
+	membar_any_any();
+}
+
+/*
+ * Run FUNC(ARG) on all the other cpus and wait. Everything is queued
+ * before we wait for any of it, so the cpus run it in parallel.
+ */
+int
+ipi_broadcast_call(void (*func)(void *), void *arg)
+{
+	struct ipi_call *calls;
+	struct cpu *c;
+	unsigned i, num;
+	int spl;
+
+	num = cpuarray_num(&allcpus);
+	calls = kmalloc(num * sizeof(*calls));
+	if (calls == NULL) {
+		return ENOMEM;
+	}
+
+	/* Don't migrate while deciding which cpu is "us". */
+	spl = splhigh();
+	for (i=0; i<num; i++) {
+		c = cpuarray_get(&allcpus, i);
+		calls[i].ic_func = func;
+		calls[i].ic_arg = arg;
+		if (c == curcpu->c_self) {
+			calls[i].ic_done = true;
+		}
+		else {
+			ipi_call(c, &calls[i]);
+		}
+	}
+	splx(spl);
+
+	for (i=0; i<num; i++) {
+		ipi_call_wait(&calls[i]);
+	}
+
+	kfree(calls);
+	return 0;
+}
+
+/*
+ * Run the calls queued for this cpu, in order. The caller may free
+ * each one as soon as it's marked done, so don't touch it after that.
+ */
+static
+void
+ipi_runcalls(struct ipi_call *call)
+{
+	struct ipi_call *next;
+
+	while (call != NULL) {
+		next = call->ic_next;
+		call->ic_func(call->ic_arg);
+		membar_any_any();
+		call->ic_done = true;
+		call = next;
+	}
+}
+
 /*
  * Handle an incoming interprocessor interrupt.
  */
 void
 interprocessor_interrupt(void)
 {
+	struct ipi_call *calls;
 	uint32_t bits;
 	unsigned i;
 
 	spinlock_acquire(&curcpu->c_ipi_lock);
 	bits = curcpu->c_ipi_pending;
 
+	for (i=0; i<CPU_NIPICODES; i++) {
+		if (bits & (1U << i)) {
+			curcpu->c_ipi_recv[i]++;
+		}
+	}
+
 	if (bits & (1U << IPI_PANIC)) {
 		/* panic on another cpu - just stop dead */
 		spinlock_release(&curcpu->c_ipi_lock);
@@ -1205,7 +2131,16 @@ interprocessor_interrupt(void)
 		}
 		curcpu->c_numshootdown = 0;
 	}
+	calls = NULL;
+	if (bits & (1U << IPI_CALL)) {
+		/* Take the whole queue; run it after unlocking. */
+		calls = curcpu->c_calls;
+		curcpu->c_calls = NULL;
+		curcpu->c_callstail = &curcpu->c_calls;
+	}
 
 	curcpu->c_ipi_pending = 0;
 	spinlock_release(&curcpu->c_ipi_lock);
+
+	ipi_runcalls(calls);
 }
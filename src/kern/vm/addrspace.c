@@ -54,6 +54,9 @@ as_create(void)
 	 * Initialize as needed.
 	 */
 
+	spinlock_init(&as->as_lock);
+	as->as_refcount = 1;
+
 	return as;
 }
 
@@ -84,9 +87,34 @@ as_destroy(struct addrspace *as)
 	 * Clean up as needed.
 	 */
 
+	spinlock_cleanup(&as->as_lock);
 	kfree(as);
 }
 
+void
+as_incref(struct addrspace *as)
+{
+	spinlock_acquire(&as->as_lock);
+	KASSERT(as->as_refcount > 0);
+	as->as_refcount++;
+	spinlock_release(&as->as_lock);
+}
+
+void
+as_decref(struct addrspace *as)
+{
+	unsigned refcount;
+
+	spinlock_acquire(&as->as_lock);
+	KASSERT(as->as_refcount > 0);
+	refcount = --as->as_refcount;
+	spinlock_release(&as->as_lock);
+
+	if (refcount == 0) {
+		as_destroy(as);
+	}
+}
+
 void
 as_activate(void)
 {
@@ -180,3 +208,27 @@ as_define_stack(struct addrspace *as, vaddr_t *stackptr)
 	return 0;
 }
 
+int
+as_define_thread_stack(struct addrspace *as, unsigned *slot,
+		       vaddr_t *stackptr)
+{
+	/*
+	 * Write this.
+	 */
+
+	(void)as;
+	(void)slot;
+	(void)stackptr;
+	return ENOSYS;
+}
+
+void
+as_release_thread_stack(struct addrspace *as, unsigned slot)
+{
+	/*
+	 * Write this.
+	 */
+
+	(void)as;
+	(void)slot;
+}
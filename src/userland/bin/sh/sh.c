@@ -45,6 +45,7 @@
 #include <limits.h>
 #include <errno.h>
 #include <err.h>
+#include <spawn.h>
 
 #ifdef HOST
 #include "hostcompat.h"
@@ -371,6 +372,7 @@ docommand(char *buf, struct exitinfo *ei)
 	char *s;
 	pid_t pid;
 	int status;
+	int result;
 	int bg=0;
 	time_t startsecs, endsecs;
 	unsigned long startnsecs, endnsecs;
@@ -421,27 +423,16 @@ docommand(char *buf, struct exitinfo *ei)
 		__time(&startsecs, &startnsecs);
 	}
 
-	pid = fork();
-	switch (pid) {
-		case -1:
-			/* error */
-			warn("fork");
-			exitinfo_exit(ei, 255);
-			return;
-		case 0:
-			/* child */
-			execvp(args[0], args);
-			warn("%s", args[0]);
-			/*
-			 * Use _exit() instead of exit() in the child
-			 * process to avoid calling atexit() functions,
-			 * which would cause hostcompat (if present) to
-			 * reset the tty state and mess up our input
-			 * handling.
-			 */
-			_exit(1);
-		default:
-			break;
+	/*
+	 * Spawn rather than fork and exec, so the shell's address
+	 * space isn't copied just to be thrown away.
+	 */
+	result = posix_spawnp(&pid, args[0], NULL, NULL, args, NULL);
+	if (result) {
+		errno = result;
+		warn("%s", args[0]);
+		exitinfo_exit(ei, 1);
+		return;
 	}
 
 	/* parent */
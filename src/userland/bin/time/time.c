@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * time - run a command and report the resources it used.
+ * usage: time command [args...]
+ *
+ * Prints the elapsed (real) time, the user and system cpu time, the
+ * number of TLB faults and context switches, and the bytes read and
+ * written, all totalled over the command and any children it waited
+ * for. Exits with the command's exit code.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <errno.h>
+#include <err.h>
+
+/*
+ * Print a time as seconds with two decimals.
+ */
+static
+void
+printtime(const char *what, time_t secs, unsigned long usecs)
+{
+	warnx("%8lld.%02lu %s", (long long)secs, usecs / 10000, what);
+}
+
+int
+main(int argc, char *argv[])
+{
+	time_t startsecs, endsecs;
+	unsigned long startnsecs, endnsecs;
+	struct rusage ru;
+	pid_t pid;
+	int result, status;
+
+	if (argc < 2) {
+		errx(1, "Usage: time command [args...]");
+	}
+
+	__time(&startsecs, &startnsecs);
+
+	result = posix_spawnp(&pid, argv[1], NULL, NULL, argv + 1, NULL);
+	if (result) {
+		errno = result;
+		err(1, "%s", argv[1]);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+
+	__time(&endsecs, &endnsecs);
+	if (endnsecs < startnsecs) {
+		endnsecs += 1000000000;
+		endsecs--;
+	}
+
+	if (getrusage(RUSAGE_CHILDREN, &ru) < 0) {
+		err(1, "getrusage");
+	}
+
+	printtime("real", endsecs - startsecs, (endnsecs - startnsecs) / 1000);
+	printtime("user", ru.ru_utime.tv_sec, ru.ru_utime.tv_usec);
+	printtime("sys", ru.ru_stime.tv_sec, ru.ru_stime.tv_usec);
+	warnx("%11llu TLB faults", (unsigned long long)ru.ru_minflt);
+	warnx("%11llu voluntary context switches",
+	      (unsigned long long)ru.ru_nvcsw);
+	warnx("%11llu involuntary context switches",
+	      (unsigned long long)ru.ru_nivcsw);
+	warnx("%11llu bytes read", (unsigned long long)ru.ru_inbytes);
+	warnx("%11llu bytes written", (unsigned long long)ru.ru_oubytes);
+
+	return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
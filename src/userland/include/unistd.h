@@ -42,6 +42,7 @@
 #include <kern/ioctl.h>
 #include <kern/reboot.h>
 #include <kern/seek.h>
+#include <kern/spawn.h>
 #include <kern/time.h>
 #include <kern/unistd.h>
 #include <kern/wait.h>
@@ -147,6 +148,17 @@ ssize_t readlink(const char *path, char *buf, size_t buflen);
 int dup2(int filehandle, int newhandle);
 int pipe(int filehandles[2]);
 int __time(time_t *seconds, unsigned long *nanoseconds);
+int nanosleep(const struct timespec *req, struct timespec *rem);
+int sched_setaffinity(pid_t pid, unsigned mask);
+int sched_getaffinity(pid_t pid, unsigned *mask);
+int __thread_create(void (*start)(void *, void *), void *func, void *arg);
+int thread_join(int tid, int *status);
+__DEAD void thread_exit(int status);
+int futex_wait(volatile int *addr, int expected,
+	       const struct timespec *timeout);
+int futex_wake(volatile int *addr, int count);
+pid_t __spawn(const char *path, char *const *argv,
+	      const struct spawn_action *actions, int nactions);
 ssize_t __getcwd(char *buf, size_t buflen);
 /* stat - see sys/stat.h */
 /* lstat - see sys/stat.h */
@@ -158,5 +170,8 @@ ssize_t __getcwd(char *buf, size_t buflen);
 int execvp(const char *prog, char *const *args); /* calls execv */
 char *getcwd(char *buf, size_t buflen);		/* calls __getcwd */
 time_t time(time_t *seconds);			/* calls __time */
+int usleep(unsigned usecs);			/* calls nanosleep */
+int thread_create(int (*func)(void *), void *arg); /* calls __thread_create */
+int threadfork(void (*func)(void));		/* calls __thread_create */
 
 #endif /* _UNISTD_H_ */
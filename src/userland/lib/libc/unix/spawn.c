@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <spawn.h>
+
+/*
+ * posix_spawn and friends, on top of the __spawn system call.
+ */
+
+int
+posix_spawn_file_actions_init(posix_spawn_file_actions_t *fa)
+{
+	fa->__nactions = 0;
+	return 0;
+}
+
+int
+posix_spawn_file_actions_destroy(posix_spawn_file_actions_t *fa)
+{
+	(void)fa;
+	return 0;
+}
+
+/*
+ * Append an action; the caller fills it in.
+ */
+static
+struct spawn_action *
+spawn_addaction(posix_spawn_file_actions_t *fa, int type, int fd)
+{
+	struct spawn_action *sa;
+
+	if (fa->__nactions >= SPAWN_ACTIONS_MAX) {
+		return NULL;
+	}
+	sa = &fa->__actions[fa->__nactions++];
+	sa->sa_type = type;
+	sa->sa_fd = fd;
+	sa->sa_newfd = -1;
+	sa->sa_flags = 0;
+	sa->sa_path = NULL;
+	return sa;
+}
+
+/*
+ * The path isn't copied, so it has to stay around until the spawn.
+ */
+int
+posix_spawn_file_actions_addopen(posix_spawn_file_actions_t *fa, int fd,
+				 const char *path, int flags, mode_t mode)
+{
+	struct spawn_action *sa;
+
+	(void)mode;
+
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+	sa = spawn_addaction(fa, SPAWN_OPEN, fd);
+	if (sa == NULL) {
+		return ENOMEM;
+	}
+	sa->sa_path = path;
+	sa->sa_flags = flags;
+	return 0;
+}
+
+int
+posix_spawn_file_actions_addclose(posix_spawn_file_actions_t *fa, int fd)
+{
+	if (fd < 0 || fd >= OPEN_MAX) {
+		return EBADF;
+	}
+	if (spawn_addaction(fa, SPAWN_CLOSE, fd) == NULL) {
+		return ENOMEM;
+	}
+	return 0;
+}
+
+int
+posix_spawn_file_actions_adddup2(posix_spawn_file_actions_t *fa, int fd,
+				 int newfd)
+{
+	struct spawn_action *sa;
+
+	if (fd < 0 || fd >= OPEN_MAX || newfd < 0 || newfd >= OPEN_MAX) {
+		return EBADF;
+	}
+	sa = spawn_addaction(fa, SPAWN_DUP2, fd);
+	if (sa == NULL) {
+		return ENOMEM;
+	}
+	sa->sa_newfd = newfd;
+	return 0;
+}
+
+int
+posix_spawn(pid_t *pid, const char *path,
+	    const posix_spawn_file_actions_t *fa,
+	    const posix_spawnattr_t *attr,
+	    char *const argv[], char *const envp[])
+{
+	pid_t child;
+
+	(void)envp;
+
+	if (attr != NULL) {
+		return EINVAL;
+	}
+	child = __spawn(path, argv, fa ? fa->__actions : NULL,
+			fa ? fa->__nactions : 0);
+	if (child < 0) {
+		return errno;
+	}
+	if (pid != NULL) {
+		*pid = child;
+	}
+	return 0;
+}
+
+/*
+ * Like posix_spawn, but search $PATH for FILE the way execvp does.
+ */
+int
+posix_spawnp(pid_t *pid, const char *file,
+	     const posix_spawn_file_actions_t *fa,
+	     const posix_spawnattr_t *attr,
+	     char *const argv[], char *const envp[])
+{
+	const char *searchpath, *s, *t;
+	char progpath[PATH_MAX];
+	size_t len;
+	int result;
+
+	if (strchr(file, '/') != NULL) {
+		return posix_spawn(pid, file, fa, attr, argv, envp);
+	}
+
+	searchpath = getenv("PATH");
+	if (searchpath == NULL) {
+		return ENOENT;
+	}
+
+	for (s = searchpath; s != NULL; s = t) {
+		t = strchr(s, ':');
+		if (t != NULL) {
+			len = t - s;
+			/* advance past the colon */
+			t++;
+		}
+		else {
+			len = strlen(s);
+		}
+		if (len == 0) {
+			continue;
+		}
+		if (len >= sizeof(progpath)) {
+			continue;
+		}
+		memcpy(progpath, s, len);
+		snprintf(progpath + len, sizeof(progpath) - len, "/%s", file);
+		result = posix_spawn(pid, progpath, fa, attr, argv, envp);
+		switch (result) {
+		    case ENOENT:
+		    case ENOTDIR:
+		    case ENOEXEC:
+			/* routine errors, try next dir */
+			break;
+		    default:
+			/* success, or let's fail */
+			return result;
+		}
+	}
+	return ENOENT;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+
+/*
+ * User threads. The kernel starts a new thread at the START function
+ * passed to __thread_create, with the other two arguments in the
+ * argument registers; these start functions run the thread's own
+ * function and make sure the thread exits when it returns.
+ */
+
+static
+void
+thread_start(void *func, void *arg)
+{
+	int (*f)(void *) = func;
+
+	thread_exit(f(arg));
+}
+
+static
+void
+threadfork_start(void *func, void *arg)
+{
+	void (*f)(void) = func;
+
+	(void)arg;
+	f();
+	thread_exit(0);
+}
+
+/*
+ * Start a thread running FUNC(ARG). Its exit status (for thread_join)
+ * is FUNC's return value. Returns the new thread's id.
+ */
+int
+thread_create(int (*func)(void *), void *arg)
+{
+	return __thread_create(thread_start, func, arg);
+}
+
+/*
+ * Older interface used by the userthreads test.
+ */
+int
+threadfork(void (*func)(void))
+{
+	return __thread_create(threadfork_start, func, NULL);
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <uthread.h>
+
+/*
+ * User-level mutexes and condition variables built on futexes.
+ *
+ * The mutex is the three-state one from Drepper's "Futexes Are
+ * Tricky": 0 is unlocked, 1 is locked with nobody waiting, and 2 is
+ * locked with (possibly) somebody waiting. Only unlocking a mutex in
+ * state 2 makes a system call.
+ */
+
+/*
+ * Atomic compare-and-swap: if *P is OLD, set it to NEW. Returns the
+ * value that was in *P.
+ *
+ * This uses LL/SC, like spinlock_data_testandset in the kernel. Note
+ * that there must be no other memory accesses between the LL and the
+ * SC. The SC can fail even though the value matched (e.g. if we took
+ * an interrupt), in which case we go around again.
+ */
+static
+int
+atomic_cas(volatile int *p, int old, int new)
+{
+	int x, y;
+
+	do {
+		y = 0;
+		__asm volatile(
+			".set push;"		/* save assembler mode */
+			".set mips32;"		/* allow MIPS32 instructions */
+			".set volatile;"	/* avoid unwanted optimization */
+			"ll %0, 0(%2);"		/*   x = *p */
+			"bne %0, %3, 1f;"	/*   if (x != old) goto 1 */
+			"move %1, %4;"		/*   y = new */
+			"sc %1, 0(%2);"		/*   *p = y; y = success? */
+			"1:"
+			".set pop"		/* restore assembler mode */
+			: "=&r" (x), "+&r" (y)
+			: "r" (p), "r" (old), "r" (new)
+			: "memory");
+	} while (x == old && y == 0);
+
+	return x;
+}
+
+/*
+ * Atomically store NEW in *P and return the old value.
+ */
+static
+int
+atomic_swap(volatile int *p, int new)
+{
+	int old;
+
+	do {
+		old = *p;
+	} while (atomic_cas(p, old, new) != old);
+	return old;
+}
+
+void
+umutex_init(struct umutex *m)
+{
+	m->um_state = 0;
+}
+
+int
+umutex_trylock(struct umutex *m)
+{
+	if (atomic_cas(&m->um_state, 0, 1) != 0) {
+		errno = EBUSY;
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Take the lock assuming there may be waiters: leave it in state 2
+ * so whoever unlocks it next wakes someone.
+ */
+static
+void
+umutex_lock_contended(struct umutex *m)
+{
+	while (atomic_swap(&m->um_state, 2) != 0) {
+		(void)futex_wait(&m->um_state, 2, NULL);
+	}
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+	if (atomic_cas(&m->um_state, 0, 1) == 0) {
+		return;
+	}
+	umutex_lock_contended(m);
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+	if (atomic_swap(&m->um_state, 0) == 2) {
+		(void)futex_wake(&m->um_state, 1);
+	}
+}
+
+/*
+ * The condition variable is a sequence number. A waiter notes it
+ * before releasing the mutex and sleeps only if it hasn't changed
+ * since, so a signal sent in between isn't lost. Wakeups can be
+ * spurious, as usual; callers recheck their condition.
+ */
+
+void
+ucond_init(struct ucond *c)
+{
+	c->uc_seq = 0;
+}
+
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+	int seq;
+
+	seq = c->uc_seq;
+	umutex_unlock(m);
+	(void)futex_wait(&c->uc_seq, seq, NULL);
+
+	/* Other threads may be waiting for the mutex behind us. */
+	umutex_lock_contended(m);
+}
+
+void
+ucond_signal(struct ucond *c)
+{
+	int seq;
+
+	do {
+		seq = c->uc_seq;
+	} while (atomic_cas(&c->uc_seq, seq, seq + 1) != seq);
+	(void)futex_wake(&c->uc_seq, 1);
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+	int seq;
+
+	do {
+		seq = c->uc_seq;
+	} while (atomic_cas(&c->uc_seq, seq, seq + 1) != seq);
+	/* Only our own threads can be waiting; wake them all. */
+	(void)futex_wake(&c->uc_seq, THREAD_MAX);
+}
@@ -34,51 +34,56 @@
  *      The file it cats is "catfile". This should be created in advance.
  *
  * This test should itself run correctly when the basic system calls
- * are complete. It may be helpful for scheduler performance analysis.
+ * and posix_spawn are complete. It may be helpful for scheduler
+ * performance analysis.
  */
 
 #include <unistd.h>
+#include <errno.h>
 #include <err.h>
+#include <spawn.h>
 
 static char *hargv[2] = { (char *)"hog", NULL };
 static char *cargv[3] = { (char *)"cat", (char *)"catfile", NULL };
 
-#define MAXPROCS  6
-static int pids[MAXPROCS], npids;
+static int npids;
 
 static
 void
 spawnv(const char *prog, char **argv)
 {
-	int pid = fork();
-	switch (pid) {
-	    case -1:
-		err(1, "fork");
-	    case 0:
-		/* child */
-		execv(prog, argv);
+	pid_t pid;
+	int result;
+
+	result = posix_spawn(&pid, prog, NULL, NULL, argv, NULL);
+	if (result) {
+		errno = result;
 		err(1, "%s", prog);
-	    default:
-		/* parent */
-		pids[npids++] = pid;
-		break;
 	}
+	npids++;
 }
 
+/*
+ * Collect the children in whatever order they finish.
+ */
 static
 void
 waitall(void)
 {
 	int i, status;
+	pid_t pid;
+
 	for (i=0; i<npids; i++) {
-		if (waitpid(pids[i], &status, 0)<0) {
-			warn("waitpid for %d", pids[i]);
+		pid = waitpid(-1, &status, 0);
+		if (pid<0) {
+			warn("waitpid");
+			return;
 		}
 		else if (WIFSIGNALED(status)) {
-			warnx("pid %d: signal %d", pids[i], WTERMSIG(status));
+			warnx("pid %d: signal %d", pid, WTERMSIG(status));
 		}
 		else if (WEXITSTATUS(status) != 0) {
-			warnx("pid %d: exit %d", pids[i], WEXITSTATUS(status));
+			warnx("pid %d: exit %d", pid, WEXITSTATUS(status));
 		}
 	}
 }
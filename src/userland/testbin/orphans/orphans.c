@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * orphans - test that orphaned and waited-for processes are reaped.
+ *
+ * Each round forks a middle process that forks several children
+ * and exits without waiting for them: some of the children exit
+ * before it does and some after. Every one of them is an orphan the
+ * kernel has to reap. Enough rounds are run that leaking process
+ * structures would show up as fork failing (kmalloc running dry).
+ * The middle processes themselves are reaped once waited for, so
+ * waiting for one a second time must fail.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <err.h>
+
+#define ROUNDS		200
+#define NKIDS		8
+
+static
+void
+spin(unsigned n)
+{
+	volatile unsigned i;
+
+	for (i=0; i<n; i++) {
+		/* nothing */
+	}
+}
+
+/*
+ * Fork the children and exit, leaving the slow ones running.
+ */
+static
+void
+middle(int round)
+{
+	pid_t pid;
+	int i;
+
+	pid = 0;
+	for (i=0; i<NKIDS; i++) {
+		pid = fork();
+		if (pid < 0) {
+			warn("round %d: fork", round);
+			_exit(255);
+		}
+		if (pid == 0) {
+			/* Odd children outlive the middle process. */
+			spin((i % 2) ? 200000 : 0);
+			_exit(0);
+		}
+	}
+	_exit(0);
+}
+
+int
+main(void)
+{
+	pid_t pid;
+	int round, status;
+
+	for (round=0; round<ROUNDS; round++) {
+		pid = fork();
+		if (pid < 0) {
+			err(1, "round %d: fork", round);
+		}
+		if (pid == 0) {
+			middle(round);
+		}
+		if (waitpid(pid, &status, 0) < 0) {
+			err(1, "round %d: waitpid", round);
+		}
+		if (status != 0) {
+			errx(1, "round %d: middle process failed", round);
+		}
+
+		/* Reaped once waited for. */
+		if (waitpid(pid, &status, 0) >= 0) {
+			errx(1, "round %d: waited for twice", round);
+		}
+
+		if ((round + 1) % 50 == 0) {
+			printf("orphans: %d rounds\n", round + 1);
+		}
+	}
+
+	printf("orphans: passed\n");
+	return 0;
+}
@@ -0,0 +1,193 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * procbench - time the process system calls.
+ * usage: procbench [iterations]
+ *
+ * Runs each benchmark for the given number of iterations (default
+ * 100) and prints one line per benchmark with the mean, median, 99th
+ * percentile, minimum and maximum time per iteration, in
+ * microseconds, in key=value form so runs can be compared by script:
+ *
+ *    fork       fork a child that exits at once, and waitpid for it
+ *    forkexec   fork a child that execs /bin/true, and waitpid for it
+ *    spawn      posix_spawn /bin/true and waitpid for it
+ *
+ * The kernel menu has the same in pb1 and pb2.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <spawn.h>
+#include <errno.h>
+#include <err.h>
+
+#define DEFAULT_ITERS	100
+#define MAX_ITERS	1000
+#define PROGRAM		"/bin/true"
+
+static char *progargv[2] = { (char *)"true", NULL };
+static unsigned long long samples[MAX_ITERS];
+
+/*
+ * Current time in nanoseconds.
+ */
+static
+unsigned long long
+now(void)
+{
+	time_t secs;
+	unsigned long nsecs;
+
+	__time(&secs, &nsecs);
+	return (unsigned long long)secs * 1000000000ULL + nsecs;
+}
+
+static
+void
+waitfor(const char *name, pid_t pid)
+{
+	int status;
+
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "%s: waitpid", name);
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		errx(1, "%s: child failed (status %d)", name, status);
+	}
+}
+
+static
+void
+dofork(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		_exit(0);
+	}
+	waitfor("fork", pid);
+}
+
+static
+void
+doforkexec(void)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		execv(PROGRAM, progargv);
+		warn("%s", PROGRAM);
+		_exit(1);
+	}
+	waitfor("forkexec", pid);
+}
+
+static
+void
+dospawn(void)
+{
+	pid_t pid;
+	int result;
+
+	result = posix_spawn(&pid, PROGRAM, NULL, NULL, progargv, NULL);
+	if (result) {
+		errno = result;
+		err(1, "posix_spawn %s", PROGRAM);
+	}
+	waitfor("spawn", pid);
+}
+
+static
+int
+cmpsample(const void *av, const void *bv)
+{
+	const unsigned long long *a = av, *b = bv;
+
+	return *a < *b ? -1 : *a > *b;
+}
+
+static
+void
+bench(const char *name, void (*func)(void), unsigned n)
+{
+	unsigned long long start, total;
+	unsigned i;
+
+	total = 0;
+	for (i=0; i<n; i++) {
+		start = now();
+		func();
+		samples[i] = now() - start;
+		total += samples[i];
+	}
+
+	qsort(samples, n, sizeof(samples[0]), cmpsample);
+	printf("bench=%s n=%u mean_us=%llu median_us=%llu p99_us=%llu "
+	       "min_us=%llu max_us=%llu\n", name, n,
+	       total / n / 1000,
+	       samples[n / 2] / 1000,
+	       samples[(n * 99 + 99) / 100 - 1] / 1000,
+	       samples[0] / 1000,
+	       samples[n - 1] / 1000);
+}
+
+int
+main(int argc, char *argv[])
+{
+	unsigned n;
+
+	n = DEFAULT_ITERS;
+	if (argc > 2) {
+		errx(1, "Usage: procbench [iterations]");
+	}
+	if (argc == 2) {
+		n = atoi(argv[1]);
+		if (n == 0 || n > MAX_ITERS) {
+			errx(1, "iterations must be 1-%d", MAX_ITERS);
+		}
+	}
+
+	bench("fork", dofork, n);
+	bench("forkexec", doforkexec, n);
+	bench("spawn", dospawn, n);
+	return 0;
+}
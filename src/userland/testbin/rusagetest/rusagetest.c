@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * rusagetest - test getrusage.
+ *
+ * Forks a child that does some computing and writes a known number
+ * of bytes, and checks that the child's usage shows up under
+ * RUSAGE_CHILDREN only once it has been waited for, and then only
+ * once however many times it's waited for.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+
+#define NBYTES		1000
+#define SPINS		2000000
+
+static volatile unsigned spinner;
+
+static
+void
+child(void)
+{
+	char buf[NBYTES];
+	unsigned i;
+	int fd;
+
+	for (i=0; i<SPINS; i++) {
+		spinner++;
+	}
+
+	memset(buf, 'x', sizeof(buf));
+	fd = open("null:", O_WRONLY);
+	if (fd < 0) {
+		warn("child: null:");
+		_exit(1);
+	}
+	if (write(fd, buf, sizeof(buf)) != NBYTES) {
+		warn("child: write");
+		_exit(1);
+	}
+	close(fd);
+	_exit(0);
+}
+
+static
+void
+getchildren(struct rusage *ru)
+{
+	if (getrusage(RUSAGE_CHILDREN, ru) < 0) {
+		err(1, "getrusage");
+	}
+}
+
+int
+main(void)
+{
+	struct rusage before, after, again, self;
+	pid_t pid;
+	int status;
+
+	getchildren(&before);
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		child();
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (status != 0) {
+		errx(1, "child failed");
+	}
+
+	getchildren(&after);
+	if (after.ru_oubytes - before.ru_oubytes != NBYTES) {
+		errx(1, "child wrote %llu bytes, expected %d",
+		     (unsigned long long)(after.ru_oubytes - before.ru_oubytes),
+		     NBYTES);
+	}
+	if (after.ru_minflt == before.ru_minflt) {
+		errx(1, "child took no TLB faults");
+	}
+	if (after.ru_utime.tv_sec == before.ru_utime.tv_sec &&
+	    after.ru_utime.tv_usec == before.ru_utime.tv_usec) {
+		errx(1, "child used no time");
+	}
+	printf("rusagetest: child's usage ok\n");
+
+	/* Waiting again fails or not, but mustn't count it twice. */
+	(void)waitpid(pid, &status, 0);
+	getchildren(&again);
+	if (again.ru_oubytes != after.ru_oubytes) {
+		errx(1, "child counted twice");
+	}
+	printf("rusagetest: counted once\n");
+
+	if (getrusage(RUSAGE_SELF, &self) < 0) {
+		err(1, "getrusage self");
+	}
+	if (self.ru_minflt == 0) {
+		errx(1, "no TLB faults of our own");
+	}
+	if (getrusage(12345, &self) == 0) {
+		errx(1, "bad who accepted");
+	}
+	printf("rusagetest: passed\n");
+	return 0;
+}
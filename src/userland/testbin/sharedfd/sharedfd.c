@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * sharedfd - test file descriptors shared by fork and dup2.
+ *
+ * Opens a file, dup2s it to a second descriptor, and forks several
+ * workers that write fixed-size records through both descriptors at
+ * once, then close them and exit. Meanwhile the parent closes one of
+ * its own copies. Since all the descriptors share one open file (and
+ * one offset), every record should land in its own place: the file
+ * should end up holding exactly all the records, none torn or
+ * overwritten, and the parent's remaining descriptor should still
+ * work afterwards.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <err.h>
+
+#define OUTFILE		"sharedfd.out"
+#define DUPFD		10
+#define NWORKERS	4
+#define NRECS		50
+#define RECLEN		32
+
+static
+void
+worker(int fd, char letter)
+{
+	char rec[RECLEN];
+	ssize_t len;
+	int i;
+
+	memset(rec, letter, RECLEN - 1);
+	rec[RECLEN - 1] = '\n';
+	for (i=0; i<NRECS; i++) {
+		len = write((i % 2) ? DUPFD : fd, rec, RECLEN);
+		if (len != RECLEN) {
+			warn("worker %c: write", letter);
+			_exit(1);
+		}
+	}
+	if (close(fd) < 0 || close(DUPFD) < 0) {
+		warn("worker %c: close", letter);
+		_exit(1);
+	}
+	_exit(0);
+}
+
+static
+void
+check(void)
+{
+	char rec[RECLEN];
+	unsigned counts[NWORKERS];
+	ssize_t len;
+	int fd, i, n;
+
+	for (i=0; i<NWORKERS; i++) {
+		counts[i] = 0;
+	}
+
+	fd = open(OUTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", OUTFILE);
+	}
+	for (n=0; ; n++) {
+		len = read(fd, rec, RECLEN);
+		if (len < 0) {
+			err(1, "%s: read", OUTFILE);
+		}
+		if (len == 0) {
+			break;
+		}
+		if (len != RECLEN || rec[RECLEN - 1] != '\n' ||
+		    rec[0] < 'a' || rec[0] >= 'a' + NWORKERS) {
+			errx(1, "record %d is garbled", n);
+		}
+		for (i=1; i<RECLEN - 1; i++) {
+			if (rec[i] != rec[0]) {
+				errx(1, "record %d is torn", n);
+			}
+		}
+		counts[rec[0] - 'a']++;
+	}
+	close(fd);
+
+	for (i=0; i<NWORKERS; i++) {
+		if (counts[i] != NRECS) {
+			errx(1, "worker %c: %u records, expected %d",
+			     'a' + i, counts[i], NRECS);
+		}
+	}
+}
+
+int
+main(void)
+{
+	pid_t pids[NWORKERS];
+	off_t pos;
+	int fd, i, status, failed;
+
+	fd = open(OUTFILE, O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	if (fd < 0) {
+		err(1, "%s", OUTFILE);
+	}
+	if (dup2(fd, DUPFD) < 0) {
+		err(1, "dup2");
+	}
+
+	for (i=0; i<NWORKERS; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			err(1, "fork");
+		}
+		if (pids[i] == 0) {
+			worker(fd, 'a' + i);
+		}
+	}
+
+	/* The workers still have theirs; this mustn't close the file. */
+	if (close(fd) < 0) {
+		err(1, "close");
+	}
+
+	failed = 0;
+	for (i=0; i<NWORKERS; i++) {
+		if (waitpid(pids[i], &status, 0) < 0) {
+			err(1, "waitpid");
+		}
+		if (status != 0) {
+			warnx("worker %c failed", 'a' + i);
+			failed = 1;
+		}
+	}
+	if (failed) {
+		return 1;
+	}
+
+	/* The offset is shared, so it's where the last record ended. */
+	pos = lseek(DUPFD, 0, SEEK_CUR);
+	if (pos != NWORKERS * NRECS * RECLEN) {
+		errx(1, "offset is %lld, expected %d", (long long)pos,
+		     NWORKERS * NRECS * RECLEN);
+	}
+	if (close(DUPFD) < 0) {
+		err(1, "close");
+	}
+
+	check();
+	remove(OUTFILE);
+
+	printf("sharedfd: passed\n");
+	return 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * spawntest - test posix_spawn.
+ *
+ * Spawns copies of itself (in a child mode selected by argv[1]) to
+ * check that arguments arrive intact and that file actions are done
+ * before the program starts, then checks that spawning something
+ * that doesn't exist fails without leaving a child behind.
+ *
+ * Children exit 0 if they're happy and 1 if not.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <spawn.h>
+#include <err.h>
+
+#define PROG		"/testbin/spawntest"
+#define OUTFILE		"spawntest.out"
+#define MESSAGE		"spawned child was here\n"
+
+static char arg_long[1000];
+
+/*
+ * Child: check the arguments are the ones the parent sends.
+ */
+static
+int
+child_args(int argc, char *argv[])
+{
+	if (argc != 5) {
+		warnx("child: argc %d, expected 5", argc);
+		return 1;
+	}
+	if (strcmp(argv[2], "") || strcmp(argv[3], "two words") ||
+	    strcmp(argv[4], arg_long) || argv[5] != NULL) {
+		warnx("child: arguments garbled");
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Child: stdout should be the file, and fd 3 should have been closed.
+ */
+static
+int
+child_fds(void)
+{
+	if (write(STDOUT_FILENO, MESSAGE, strlen(MESSAGE)) < 0) {
+		warn("child: write to stdout");
+		return 1;
+	}
+	if (write(3, "x", 1) >= 0 || errno != EBADF) {
+		warnx("child: fd 3 still open");
+		return 1;
+	}
+	return 0;
+}
+
+static
+void
+spawnwait(const posix_spawn_file_actions_t *fa, char *argv[])
+{
+	pid_t pid;
+	int result, status;
+
+	result = posix_spawn(&pid, PROG, fa, NULL, argv, NULL);
+	if (result) {
+		errno = result;
+		err(1, "posix_spawn %s %s", PROG, argv[1]);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	if (status != 0) {
+		errx(1, "%s child failed", argv[1]);
+	}
+}
+
+int
+main(int argc, char *argv[])
+{
+	posix_spawn_file_actions_t fa;
+	char *cargv[6];
+	char buf[64];
+	pid_t pid;
+	int fd, result;
+	ssize_t len;
+
+	memset(arg_long, 'a', sizeof(arg_long) - 1);
+	arg_long[sizeof(arg_long) - 1] = 0;
+
+	if (argc > 1 && !strcmp(argv[1], "args")) {
+		return child_args(argc, argv);
+	}
+	if (argc > 1 && !strcmp(argv[1], "fds")) {
+		return child_fds();
+	}
+
+	/* Arguments. */
+	cargv[0] = (char *)PROG;
+	cargv[1] = (char *)"args";
+	cargv[2] = (char *)"";
+	cargv[3] = (char *)"two words";
+	cargv[4] = arg_long;
+	cargv[5] = NULL;
+	spawnwait(NULL, cargv);
+	printf("spawntest: arguments ok\n");
+
+	/* File actions. fd 3 is open here and closed in the child. */
+	fd = open("con:", O_WRONLY);
+	if (fd < 0) {
+		err(1, "con:");
+	}
+	if (fd != 3) {
+		result = dup2(fd, 3);
+		if (result < 0) {
+			err(1, "dup2");
+		}
+		close(fd);
+	}
+	posix_spawn_file_actions_init(&fa);
+	posix_spawn_file_actions_addopen(&fa, 4, OUTFILE,
+					 O_WRONLY|O_CREAT|O_TRUNC, 0664);
+	posix_spawn_file_actions_adddup2(&fa, 4, STDOUT_FILENO);
+	posix_spawn_file_actions_addclose(&fa, 4);
+	posix_spawn_file_actions_addclose(&fa, 3);
+	cargv[1] = (char *)"fds";
+	cargv[2] = NULL;
+	spawnwait(&fa, cargv);
+	posix_spawn_file_actions_destroy(&fa);
+	close(3);
+
+	fd = open(OUTFILE, O_RDONLY);
+	if (fd < 0) {
+		err(1, "%s", OUTFILE);
+	}
+	len = read(fd, buf, sizeof(buf) - 1);
+	if (len < 0) {
+		err(1, "%s: read", OUTFILE);
+	}
+	buf[len] = 0;
+	close(fd);
+	remove(OUTFILE);
+	if (strcmp(buf, MESSAGE)) {
+		errx(1, "child's output was <%s>", buf);
+	}
+	printf("spawntest: file actions ok\n");
+
+	/* Failure. */
+	result = posix_spawn(&pid, "/testbin/no-such-program", NULL, NULL,
+			     cargv, NULL);
+	if (result != ENOENT) {
+		errx(1, "spawning a missing program gave %d, expected ENOENT",
+		     result);
+	}
+	printf("spawntest: missing program ok\n");
+
+	printf("spawntest: passed\n");
+	return 0;
+}
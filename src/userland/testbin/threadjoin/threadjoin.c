@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * threadjoin - test thread_create and thread_join.
+ *
+ * Starts as many threads as a process can have, each of which sums
+ * its own slice of a shared array and exits with the result. The
+ * main thread joins them all and checks the sums. Then it checks
+ * that bad joins fail, that thread ids and stacks are reused once
+ * collected, and that a process forked by a thread only gets that
+ * thread's stack.
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+#include <limits.h>
+#include <errno.h>
+#include <stdio.h>
+#include <err.h>
+
+#define NPERTHREAD	1000
+#define NTHREADS	(THREAD_MAX - 1)
+
+static int numbers[NTHREADS * NPERTHREAD];
+
+static
+int
+sum(void *arg)
+{
+	unsigned slice = (unsigned)arg;
+	int i, total;
+
+	total = 0;
+	for (i=0; i<NPERTHREAD; i++) {
+		total += numbers[slice * NPERTHREAD + i];
+	}
+	return total;
+}
+
+static
+void
+runall(void)
+{
+	int tids[NTHREADS];
+	int i, status, expected;
+
+	for (i=0; i<NTHREADS; i++) {
+		tids[i] = thread_create(sum, (void *)i);
+		if (tids[i] < 0) {
+			err(1, "thread_create %d", i);
+		}
+	}
+
+	/* There's no room for another one. */
+	if (thread_create(sum, NULL) >= 0) {
+		errx(1, "thread_create succeeded past THREAD_MAX");
+	}
+
+	for (i=0; i<NTHREADS; i++) {
+		if (thread_join(tids[i], &status) < 0) {
+			err(1, "thread_join %d", tids[i]);
+		}
+		expected = i * NPERTHREAD * NPERTHREAD +
+			NPERTHREAD * (NPERTHREAD - 1) / 2;
+		if (status != expected) {
+			errx(1, "thread %d: sum %d, expected %d",
+			     i, status, expected);
+		}
+	}
+}
+
+/*
+ * Run in a thread while another is still unjoined. The child has
+ * one thread, on our stack, so it can create every thread but the
+ * main one and this one.
+ */
+static
+int
+forker(void *arg)
+{
+	int tids[NTHREADS - 1];
+	int i, status;
+	pid_t pid;
+
+	(void)arg;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		for (i=0; i<NTHREADS - 1; i++) {
+			tids[i] = thread_create(sum, (void *)i);
+			if (tids[i] < 0) {
+				err(1, "child: thread_create %d", i);
+			}
+		}
+		for (i=0; i<NTHREADS - 1; i++) {
+			if (thread_join(tids[i], NULL) < 0) {
+				err(1, "child: thread_join %d", tids[i]);
+			}
+		}
+		_exit(0);
+	}
+	if (waitpid(pid, &status, 0) < 0) {
+		err(1, "waitpid");
+	}
+	return status;
+}
+
+int
+main(void)
+{
+	int i, tid, status;
+
+	for (i=0; i<NTHREADS * NPERTHREAD; i++) {
+		numbers[i] = i;
+	}
+
+	runall();
+
+	/* Joining something that's already been joined fails. */
+	tid = thread_create(sum, NULL);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+	if (thread_join(tid, NULL) < 0) {
+		err(1, "thread_join");
+	}
+	if (thread_join(tid, NULL) == 0 || errno != ESRCH) {
+		errx(1, "second thread_join of %d didn't fail with ESRCH",
+		     tid);
+	}
+	if (thread_join(THREAD_MAX, NULL) == 0 || errno != ESRCH) {
+		errx(1, "thread_join of a bad id didn't fail with ESRCH");
+	}
+
+	/* Ids and stacks get reused. */
+	runall();
+
+	/* Forking from a thread. */
+	tid = thread_create(sum, NULL);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+	i = thread_create(forker, NULL);
+	if (i < 0) {
+		err(1, "thread_create");
+	}
+	if (thread_join(i, &status) < 0 || thread_join(tid, NULL) < 0) {
+		err(1, "thread_join");
+	}
+	if (status != 0) {
+		errx(1, "child of a thread couldn't create threads");
+	}
+
+	printf("threadjoin: passed\n");
+	return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * umutextest - test the futex-based user-level mutexes and condition
+ * variables in <uthread.h>.
+ *
+ * First, several threads bump a shared counter under a mutex, with
+ * a short spin inside the critical section so they really
+ * contend; the total must come out right. Then a producer and a
+ * consumer pass numbers through a one-slot buffer using two
+ * condition variables.
+ */
+
+#include <unistd.h>
+#include <limits.h>
+#include <stdio.h>
+#include <err.h>
+#include <uthread.h>
+
+#define NTHREADS	(THREAD_MAX - 1)
+#define NBUMPS		2000
+#define NITEMS		500
+
+static struct umutex lock = UMUTEX_INITIALIZER;
+static volatile int counter;
+
+static struct ucond notempty = UCOND_INITIALIZER;
+static struct ucond notfull = UCOND_INITIALIZER;
+static volatile int slot, full;
+
+static
+int
+bumper(void *arg)
+{
+	volatile int spin;
+	int i, val;
+
+	(void)arg;
+	for (i=0; i<NBUMPS; i++) {
+		umutex_lock(&lock);
+		val = counter;
+		for (spin=0; spin<20; spin++) {
+			/* widen the race window */
+		}
+		counter = val + 1;
+		umutex_unlock(&lock);
+	}
+	return 0;
+}
+
+static
+int
+producer(void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i=1; i<=NITEMS; i++) {
+		umutex_lock(&lock);
+		while (full) {
+			ucond_wait(&notfull, &lock);
+		}
+		slot = i;
+		full = 1;
+		ucond_signal(&notempty);
+		umutex_unlock(&lock);
+	}
+	return 0;
+}
+
+static
+int
+consumer(void *arg)
+{
+	int i, total;
+
+	(void)arg;
+	total = 0;
+	for (i=1; i<=NITEMS; i++) {
+		umutex_lock(&lock);
+		while (!full) {
+			ucond_wait(&notempty, &lock);
+		}
+		total += slot;
+		full = 0;
+		ucond_signal(&notfull);
+		umutex_unlock(&lock);
+	}
+	return total;
+}
+
+static
+int
+start(int (*func)(void *))
+{
+	int tid;
+
+	tid = thread_create(func, NULL);
+	if (tid < 0) {
+		err(1, "thread_create");
+	}
+	return tid;
+}
+
+static
+int
+join(int tid)
+{
+	int status;
+
+	if (thread_join(tid, &status) < 0) {
+		err(1, "thread_join");
+	}
+	return status;
+}
+
+int
+main(void)
+{
+	int tids[NTHREADS];
+	int i, ptid, ctid, total;
+
+	printf("umutextest: mutex...\n");
+	for (i=0; i<NTHREADS; i++) {
+		tids[i] = start(bumper);
+	}
+	for (i=0; i<NTHREADS; i++) {
+		join(tids[i]);
+	}
+	if (counter != NTHREADS * NBUMPS) {
+		errx(1, "counter is %d, expected %d",
+		     counter, NTHREADS * NBUMPS);
+	}
+
+	printf("umutextest: condition variables...\n");
+	ctid = start(consumer);
+	ptid = start(producer);
+	join(ptid);
+	total = join(ctid);
+	if (total != NITEMS * (NITEMS + 1) / 2) {
+		errx(1, "consumer got %d, expected %d",
+		     total, NITEMS * (NITEMS + 1) / 2);
+	}
+
+	printf("umutextest: passed\n");
+	return 0;
+}
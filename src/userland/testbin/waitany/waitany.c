@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2000, 2001, 2002, 2003, 2004, 2005, 2008, 2009
+ *	The President and Fellows of Harvard College.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the University nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE UNIVERSITY AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE UNIVERSITY OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * waitany - test waitpid for any child, and WNOHANG.
+ *
+ * Forks children that run for different lengths of time and exit
+ * with their index, then collects them with waitpid(-1) as they
+ * finish: each must come back exactly once with its own status.
+ * A child still running must give 0 with WNOHANG, and once they
+ * are all collected waitpid(-1) must fail with ECHILD.
+ */
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include <err.h>
+
+#define NKIDS		8
+#define SPIN		400000
+
+static pid_t pids[NKIDS];
+
+static
+void
+spin(unsigned n)
+{
+	volatile unsigned i;
+
+	for (i=0; i<n; i++) {
+		/* nothing */
+	}
+}
+
+static
+pid_t
+spawnkid(int i, unsigned n)
+{
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		err(1, "fork");
+	}
+	if (pid == 0) {
+		spin(n);
+		_exit(i);
+	}
+	return pid;
+}
+
+/*
+ * The later children do less work, so they should mostly finish
+ * first; the order is printed, but only the statuses are checked.
+ */
+static
+void
+anyorder(void)
+{
+	int i, j, status;
+	pid_t pid;
+	int seen[NKIDS];
+
+	for (i=0; i<NKIDS; i++) {
+		pids[i] = spawnkid(i, (NKIDS - 1 - i) * SPIN);
+		seen[i] = 0;
+	}
+
+	printf("waitany: order:");
+	for (j=0; j<NKIDS; j++) {
+		pid = waitpid(-1, &status, 0);
+		if (pid < 0) {
+			err(1, "waitpid(-1)");
+		}
+		for (i=0; i<NKIDS && pids[i] != pid; i++) {
+			/* nothing */
+		}
+		if (i == NKIDS) {
+			errx(1, "waitpid(-1) returned stranger %d", pid);
+		}
+		if (seen[i]) {
+			errx(1, "child %d collected twice", i);
+		}
+		seen[i] = 1;
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != i) {
+			errx(1, "child %d: bad status %d", i, status);
+		}
+		printf(" %d", i);
+	}
+	printf("\n");
+
+	if (waitpid(-1, &status, 0) >= 0) {
+		errx(1, "waitpid(-1) with no children succeeded");
+	}
+	if (errno != ECHILD) {
+		err(1, "waitpid(-1) with no children");
+	}
+}
+
+static
+void
+nohang(void)
+{
+	int status;
+	pid_t pid, ret;
+
+	pid = spawnkid(0, NKIDS * SPIN);
+
+	ret = waitpid(pid, &status, WNOHANG);
+	if (ret < 0) {
+		err(1, "waitpid(WNOHANG)");
+	}
+	if (ret != 0) {
+		/* Possible on a very fast machine, but unlikely. */
+		warnx("child finished before WNOHANG poll");
+		return;
+	}
+	if (waitpid(-1, &status, WNOHANG) != 0) {
+		errx(1, "waitpid(-1, WNOHANG) did not return 0");
+	}
+
+	if (waitpid(-1, &status, 0) != pid) {
+		err(1, "waitpid(-1)");
+	}
+	if (waitpid(-1, &status, WNOHANG) >= 0 || errno != ECHILD) {
+		errx(1, "waitpid(-1, WNOHANG) with no children did not fail");
+	}
+}
+
+int
+main(void)
+{
+	anyorder();
+	nohang();
+	printf("waitany: passed\n");
+	return 0;
+}